@@ -0,0 +1,509 @@
+package quota
+
+import (
+	"bufio"
+	"errors"
+	"fmt"
+	"io"
+	"math/bits"
+	"os"
+	"strconv"
+	"strings"
+	"sync"
+	"syscall"
+)
+
+// idChunk 覆盖 65536 个连续 ID
+type idChunk struct {
+	words [1024]uint64
+	used  int
+}
+
+// idBitmap 是 32 位 ID 空间上的两级稀疏位图：高 16 位选块，块按需分配，
+// 几千个零散 ID 只占几块 8 KiB 的内存
+type idBitmap struct {
+	chunks map[uint32]*idChunk
+}
+
+func newIDBitmap() *idBitmap {
+	return &idBitmap{chunks: make(map[uint32]*idChunk)}
+}
+
+func (b *idBitmap) set(id uint32) {
+	c := b.chunks[id>>16]
+	if c == nil {
+		c = &idChunk{}
+		b.chunks[id>>16] = c
+	}
+	w, bit := (id&0xffff)>>6, uint64(1)<<(id&63)
+	if c.words[w]&bit == 0 {
+		c.words[w] |= bit
+		c.used++
+	}
+}
+
+func (b *idBitmap) clear(id uint32) {
+	c := b.chunks[id>>16]
+	if c == nil {
+		return
+	}
+	w, bit := (id&0xffff)>>6, uint64(1)<<(id&63)
+	if c.words[w]&bit != 0 {
+		c.words[w] &^= bit
+		c.used--
+		if c.used == 0 {
+			delete(b.chunks, id>>16)
+		}
+	}
+}
+
+func (b *idBitmap) has(id uint32) bool {
+	return b.word(id>>16, (id&0xffff)>>6)&(uint64(1)<<(id&63)) != 0
+}
+
+func (b *idBitmap) word(chunk, w uint32) uint64 {
+	if c := b.chunks[chunk]; c != nil {
+		return c.words[w]
+	}
+	return 0
+}
+
+func (b *idBitmap) full(chunk uint32) bool {
+	c := b.chunks[chunk]
+	return c != nil && c.used == 1<<16
+}
+
+// nextFree 返回 [from, max] 中第一个在 a、b 里都没有置位的 ID。
+// 按 64 位字跳过，整块占满时整块跳过，连续分配时摊还 O(1)。
+func nextFree(a, b *idBitmap, from, max uint32) (uint32, bool) {
+	for id := uint64(from); id <= uint64(max); {
+		chunk := uint32(id >> 16)
+		if a.full(chunk) || b.full(chunk) {
+			id = uint64(chunk+1) << 16
+			continue
+		}
+		w := uint32(id&0xffff) >> 6
+		used := a.word(chunk, w) | b.word(chunk, w)
+		used |= uint64(1)<<(id&63) - 1 // 忽略 from 之前的位
+		if used != ^uint64(0) {
+			found := id&^63 + uint64(bits.TrailingZeros64(^used))
+			if found > uint64(max) {
+				return 0, false
+			}
+			return uint32(found), true
+		}
+		id = id&^63 + 64
+	}
+	return 0, false
+}
+
+// ProjectIDRange 是可分配的项目 ID 闭区间
+type ProjectIDRange struct {
+	Min, Max uint32
+}
+
+// ProjectIDAllocatorOptions 控制 NewProjectIDAllocator
+type ProjectIDAllocatorOptions struct {
+	// Ranges 按顺序尝试，前一个用完才用下一个；为空时为 [1, 2^31-1]
+	Ranges []ProjectIDRange
+	// LockFile 是多进程共享的预留记录：分配在 flock 保护下追加到该文件，
+	// 其他进程下次分配前读入增量，所以尚未设置限额的 ID 也不会被重复分配。为空时只在进程内互斥。
+	LockFile string
+	// ProjidFile 为空时读 /etc/projid；文件不存在不算错误
+	ProjidFile string
+	// Index 非空时其中的项目 ID 视为已用
+	Index *ProjectIndex
+	// VolumeDirs 中每个目录的直接子目录视为卷根，读出它们的项目 ID 视为已用
+	VolumeDirs []string
+}
+
+// ProjectIDAllocator 分配未被占用的项目 ID。已用 ID 来自内核配额记录（Q_XGETNEXTQUOTA/Q_GETNEXTQUOTA）、
+// /etc/projid、项目索引和卷根目录，加上 LockFile 中的预留，一并放在稀疏位图里。
+type ProjectIDAllocator struct {
+	path string
+	dev  uint64 // path 所在文件系统的 st_dev，分配的 ID 只对它有效
+	opts ProjectIDAllocatorOptions
+
+	mu       sync.Mutex
+	used     *idBitmap
+	reserved *idBitmap
+	cursors  []uint32
+
+	ledger *os.File
+	epoch  uint64
+	offset int64
+	lines  int
+}
+
+const projectLedgerMagic = "quota-projid-ledger v1 epoch "
+
+// NewProjectIDAllocator 为 path 所在文件系统建立分配器
+func NewProjectIDAllocator(path string, opts ProjectIDAllocatorOptions) (*ProjectIDAllocator, error) {
+	if len(opts.Ranges) == 0 {
+		opts.Ranges = []ProjectIDRange{{Min: 1, Max: 1<<31 - 1}}
+	}
+	for _, r := range opts.Ranges {
+		if r.Min == 0 || r.Min > r.Max {
+			return nil, fmt.Errorf("无效的项目 ID 区间: [%d, %d]", r.Min, r.Max)
+		}
+	}
+	if opts.ProjidFile == "" {
+		opts.ProjidFile = "/etc/projid"
+	}
+	dev, err := pathDev(path)
+	if err != nil {
+		return nil, err
+	}
+
+	a := &ProjectIDAllocator{
+		path:     path,
+		dev:      dev,
+		opts:     opts,
+		reserved: newIDBitmap(),
+		cursors:  make([]uint32, len(opts.Ranges)),
+	}
+	for i, r := range opts.Ranges {
+		a.cursors[i] = r.Min
+	}
+
+	if opts.LockFile != "" {
+		f, err := os.OpenFile(opts.LockFile, os.O_RDWR|os.O_CREATE, 0644)
+		if err != nil {
+			return nil, err
+		}
+		a.ledger = f
+	}
+
+	if err := a.Refresh(); err != nil {
+		a.Close()
+		return nil, err
+	}
+	return a, nil
+}
+
+// Refresh 重新收集已用 ID；其他途径设置了配额或项目后调用
+func (a *ProjectIDAllocator) Refresh() error {
+	used := newIDBitmap()
+	used.set(0)
+
+	it, err := IterateQuotas(a.path, ProjQuota, 0, 0)
+	if err == nil {
+		for it.Next() {
+			for _, info := range it.Batch() {
+				used.set(info.ID)
+			}
+		}
+		err = it.Err()
+		it.Close()
+	}
+	// 没有开启项目配额时内核里没有记录，只靠其他来源
+	var qerr *QuotaError
+	if err != nil && !(errors.As(err, &qerr) && (qerr.Code == int(syscall.ESRCH) || qerr.Code == int(syscall.ENOSYS))) {
+		return err
+	}
+
+	if err := readProjidFile(a.opts.ProjidFile, used); err != nil {
+		return err
+	}
+	if a.opts.Index != nil {
+		for _, id := range a.opts.Index.Projects() {
+			used.set(id)
+		}
+	}
+	for _, dir := range a.opts.VolumeDirs {
+		entries, err := os.ReadDir(dir)
+		if err != nil {
+			return err
+		}
+		for _, e := range entries {
+			if !e.IsDir() {
+				continue
+			}
+			if id, err := getProjectID(dir + "/" + e.Name()); err == nil {
+				used.set(uint32(id))
+			}
+		}
+	}
+
+	a.mu.Lock()
+	a.used = used
+	a.mu.Unlock()
+	return nil
+}
+
+func readProjidFile(file string, used *idBitmap) error {
+	f, err := os.Open(file)
+	if err != nil {
+		if os.IsNotExist(err) {
+			return nil
+		}
+		return err
+	}
+	defer f.Close()
+
+	s := bufio.NewScanner(f)
+	for s.Scan() {
+		line := s.Text()
+		if line == "" || line[0] == '#' {
+			continue
+		}
+		fields := strings.Split(line, ":")
+		if len(fields) < 2 {
+			continue
+		}
+		if id, err := strconv.ParseUint(fields[1], 10, 32); err == nil {
+			used.set(uint32(id))
+		}
+	}
+	return s.Err()
+}
+
+// Allocate 分配一个 ID 并记为预留，直到 Release
+func (a *ProjectIDAllocator) Allocate() (uint32, error) {
+	ids, err := a.AllocateN(1)
+	if err != nil {
+		return 0, err
+	}
+	return ids[0], nil
+}
+
+// AllocateN 在同一次加锁内分配 n 个 ID，批量建卷时只付一次 flock 和读增量的代价
+func (a *ProjectIDAllocator) AllocateN(n int) ([]uint32, error) {
+	a.mu.Lock()
+	defer a.mu.Unlock()
+
+	unlock, err := a.lockLedger()
+	if err != nil {
+		return nil, err
+	}
+	defer unlock()
+
+	ids := make([]uint32, 0, n)
+	for len(ids) < n {
+		id, ok := a.pick()
+		if !ok {
+			break
+		}
+		a.reserved.set(id)
+		ids = append(ids, id)
+	}
+
+	var record strings.Builder
+	for _, id := range ids {
+		fmt.Fprintf(&record, "+%d\n", id)
+	}
+	if err := a.appendLedger(record.String(), len(ids)); err != nil {
+		for _, id := range ids {
+			a.reserved.clear(id)
+		}
+		return nil, err
+	}
+	if len(ids) < n {
+		return ids, fmt.Errorf("项目 ID 区间已用尽: 需要 %d 个，只分配到 %d 个", n, len(ids))
+	}
+	return ids, nil
+}
+
+// pick 依次在各区间里从游标处向后找空闲 ID，找不到再从区间起点绕回
+func (a *ProjectIDAllocator) pick() (uint32, bool) {
+	for i, r := range a.opts.Ranges {
+		cursor := a.cursors[i]
+		id, ok := nextFree(a.used, a.reserved, cursor, r.Max)
+		if !ok && cursor > r.Min {
+			id, ok = nextFree(a.used, a.reserved, r.Min, cursor-1)
+		}
+		if ok {
+			a.cursors[i] = id + 1
+			if id == r.Max {
+				a.cursors[i] = r.Min
+			}
+			return id, true
+		}
+	}
+	return 0, false
+}
+
+// Release 取消预留，通常在卷删除、配额记录也已移除之后调用
+func (a *ProjectIDAllocator) Release(id uint32) error {
+	a.mu.Lock()
+	defer a.mu.Unlock()
+
+	unlock, err := a.lockLedger()
+	if err != nil {
+		return err
+	}
+	defer unlock()
+
+	// 先清掉再追加：追加可能触发压缩，压缩写出的是内存中的集合
+	wasReserved := a.reserved.has(id)
+	a.reserved.clear(id)
+	if err := a.appendLedger(fmt.Sprintf("-%d\n", id), 1); err != nil {
+		if wasReserved {
+			a.reserved.set(id)
+		}
+		return err
+	}
+	return nil
+}
+
+// Close 关闭预留文件；预留记录保留在文件中
+func (a *ProjectIDAllocator) Close() error {
+	if a.ledger == nil {
+		return nil
+	}
+	err := a.ledger.Close()
+	a.ledger = nil
+	return err
+}
+
+// lockLedger 加 flock 并读入其他进程追加的预留；没有 LockFile 时什么也不做
+func (a *ProjectIDAllocator) lockLedger() (func(), error) {
+	if a.ledger == nil {
+		return func() {}, nil
+	}
+	fd := int(a.ledger.Fd())
+	if err := syscall.Flock(fd, syscall.LOCK_EX); err != nil {
+		return nil, err
+	}
+	unlock := func() { syscall.Flock(fd, syscall.LOCK_UN) }
+
+	if err := a.syncLedger(); err != nil {
+		unlock()
+		return nil, err
+	}
+	return unlock, nil
+}
+
+// syncLedger 只读上次读到的位置之后的增量；文件被压缩过（epoch 变化）时整体重读
+func (a *ProjectIDAllocator) syncLedger() error {
+	header := make([]byte, len(projectLedgerMagic)+21)
+	n, err := a.ledger.ReadAt(header, 0)
+	if err != nil && err != io.EOF {
+		return err
+	}
+	if n == 0 {
+		// 新文件
+		return a.rewriteLedger()
+	}
+
+	line, _, _ := strings.Cut(string(header[:n]), "\n")
+	if !strings.HasPrefix(line, projectLedgerMagic) {
+		return fmt.Errorf("无法识别的项目 ID 预留文件: %s", a.opts.LockFile)
+	}
+	epoch, err := strconv.ParseUint(strings.TrimPrefix(line, projectLedgerMagic), 10, 64)
+	if err != nil {
+		return fmt.Errorf("无法识别的项目 ID 预留文件: %s", a.opts.LockFile)
+	}
+	st, err := a.ledger.Stat()
+	if err != nil {
+		return err
+	}
+	if epoch != a.epoch || a.offset == 0 || st.Size() < a.offset {
+		a.epoch = epoch
+		a.reserved = newIDBitmap()
+		a.offset = int64(len(line) + 1)
+		a.lines = 0
+	}
+
+	r := bufio.NewReader(io.NewSectionReader(a.ledger, a.offset, st.Size()-a.offset))
+	for {
+		rec, err := r.ReadString('\n')
+		if err == io.EOF {
+			if rec != "" {
+				// 写入中途崩溃留下的不完整尾行，截掉以免和下一条记录粘在一起
+				return a.ledger.Truncate(a.offset)
+			}
+			return nil
+		}
+		if err != nil {
+			return err
+		}
+		a.offset += int64(len(rec))
+		a.lines++
+		if len(rec) < 3 {
+			continue
+		}
+		id, err := strconv.ParseUint(rec[1:len(rec)-1], 10, 32)
+		if err != nil {
+			continue
+		}
+		switch rec[0] {
+		case '+':
+			a.reserved.set(uint32(id))
+		case '-':
+			a.reserved.clear(uint32(id))
+		}
+	}
+}
+
+// appendLedger 追加 count 条记录；记录远多于仍有效的预留时就地压缩，并换新的 epoch 通知其他进程重读
+func (a *ProjectIDAllocator) appendLedger(record string, count int) error {
+	if a.ledger == nil || record == "" {
+		return nil
+	}
+	if _, err := a.ledger.WriteAt([]byte(record), a.offset); err != nil {
+		return err
+	}
+	a.offset += int64(len(record))
+	a.lines += count
+
+	live := 0
+	for _, c := range a.reserved.chunks {
+		live += c.used
+	}
+	if a.lines > 4096 && a.lines > 4*live {
+		return a.rewriteLedger()
+	}
+	return nil
+}
+
+// rewriteLedger 把当前预留集合写成新的文件内容；必须持有 flock。
+// 原地覆盖重写而不是改名替换，因为其他进程的 flock 落在同一个 inode 上。
+// 先把全部预留作为普通记录追加到末尾并落盘，再从头覆盖、截断：覆盖到一半时崩溃，
+// 重放“新内容的前缀 + 旧记录的后缀 + 追加的全集”得到的仍是同一个集合，
+// 至多多出一条由断开处拼接出的预留，不会丢失预留；
+// 覆盖不占用新的块，不会因空间不足半途失败。追加失败时旧内容原样保留。
+func (a *ProjectIDAllocator) rewriteLedger() error {
+	var records strings.Builder
+	lines := 0
+	for chunk, c := range a.reserved.chunks {
+		for w, word := range c.words {
+			for word != 0 {
+				bit := bits.TrailingZeros64(word)
+				word &= word - 1
+				fmt.Fprintf(&records, "+%d\n", chunk<<16|uint32(w)<<6|uint32(bit))
+				lines++
+			}
+		}
+	}
+	// epoch 补零到固定宽度，覆盖到一半时文件头总是完整的一行
+	data := []byte(fmt.Sprintf("%s%020d\n%s", projectLedgerMagic, a.epoch+1, records.String()))
+
+	if a.offset > 0 && records.Len() > 0 {
+		_, err := a.ledger.WriteAt([]byte(records.String()), a.offset)
+		if err == nil {
+			err = a.ledger.Sync()
+		}
+		if err != nil {
+			a.ledger.Truncate(a.offset)
+			return err
+		}
+	}
+
+	_, err := a.ledger.WriteAt(data, 0)
+	if err == nil {
+		err = a.ledger.Truncate(int64(len(data)))
+	}
+	if err == nil {
+		err = a.ledger.Sync()
+	}
+	if err != nil {
+		// 文件内容仍然等价，但位置已不可信，下次加锁时整体重读
+		a.offset = 0
+		return err
+	}
+	a.epoch++
+	a.offset = int64(len(data))
+	a.lines = lines
+	return nil
+}
@@ -0,0 +1,31 @@
+package quota
+
+import (
+	"runtime"
+)
+
+// 单次批量调用在 C 端最多使用的线程数
+const maxBatchWorkers = 8
+
+// batchWorkers 为一次批量操作选择 C 端线程数：小批量单线程即可，大批量按 CPU 数并行
+func batchWorkers(n int) int {
+	workers := n/1024 + 1
+	if p := runtime.GOMAXPROCS(0); workers > p {
+		workers = p
+	}
+	if workers > maxBatchWorkers {
+		workers = maxBatchWorkers
+	}
+	return workers
+}
+
+// batchErrors 把 C 端逐条返回的 errno 转成与输入一一对应的错误切片
+func batchErrors(codes []int32, message func(code int32) string) []error {
+	errs := make([]error, len(codes))
+	for i, code := range codes {
+		if code != 0 {
+			errs[i] = &QuotaError{Code: int(code), Message: message(code)}
+		}
+	}
+	return errs
+}
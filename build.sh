@@ -2,9 +2,23 @@
 
 echo "Building unified binary for Linux (XFS + EXT4)..."
 
+# 编译公共 C 源文件
+echo "Compiling common C sources..."
+gcc -c -Wall -Wextra -I. pkg/common/quota_common.c -o pkg/common/quota_common.o && \
+    gcc -c -Wall -Wextra -I. pkg/common/quota_project.c -o pkg/common/quota_project.o && \
+    gcc -c -Wall -Wextra -I. pkg/common/quota_usage.c -o pkg/common/quota_usage.o && \
+    gcc -c -Wall -Wextra -I. pkg/common/quota_project_roots.c -o pkg/common/quota_project_roots.o
+if [ $? -ne 0 ]; then
+    echo "Failed to compile common C sources"
+    exit 1
+fi
+
 # 编译 EXT4 C 源文件
 echo "Compiling EXT4 C sources..."
-gcc -c -Wall -Wextra -I. pkg/ext4/quota_ext4.c -o pkg/ext4/quota_ext4.o
+gcc -c -Wall -Wextra -I. pkg/ext4/quota_ext4.c -o pkg/ext4/quota_ext4.o && \
+    gcc -c -Wall -Wextra -I. pkg/ext4/quota_ext4_fast.c -o pkg/ext4/quota_ext4_fast.o && \
+    gcc -c -Wall -Wextra -I. pkg/ext4/quota_ext4_direct.c -o pkg/ext4/quota_ext4_direct.o && \
+    gcc -c -Wall -Wextra -I. pkg/ext4/quota_ext4_seed.c -o pkg/ext4/quota_ext4_seed.o
 if [ $? -ne 0 ]; then
     echo "Failed to compile EXT4 C sources"
     exit 1
@@ -12,7 +26,8 @@ fi
 
 # 编译 XFS C 源文件
 echo "Compiling XFS C sources..."
-gcc -c -Wall -Wextra -I. pkg/xfs/quota_xfs.c -o pkg/xfs/quota_xfs.o
+gcc -c -Wall -Wextra -I. pkg/xfs/quota_xfs.c -o pkg/xfs/quota_xfs.o && \
+    gcc -c -Wall -Wextra -I. pkg/xfs/quota_xfs_census.c -o pkg/xfs/quota_xfs_census.o
 if [ $? -ne 0 ]; then
     echo "Failed to compile XFS C sources"
     exit 1
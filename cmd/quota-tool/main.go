@@ -4,7 +4,11 @@ import (
 	"fmt"
 	"log"
 	"os"
+	"path/filepath"
 	"strconv"
+	"strings"
+	"syscall"
+	"time"
 
 	"github.com/terminus-io/quota"
 )
@@ -24,6 +28,14 @@ func printUsage() {
 	fmt.Println("  remove       Remove quota limits")
 	fmt.Println("  test         Run comprehensive tests")
 	fmt.Println("  detect       Detect filesystem type")
+	fmt.Println("  census       Count inodes and space per owner with XFS bulkstat")
+	fmt.Println("  usage        Count inodes and space per owner by walking a tree")
+	fmt.Println("  index        Build an index of the directories where each project starts")
+	fmt.Println("  where        Look up the directories of a project in an index")
+	fmt.Println("  alloc-id     Reserve unused project IDs")
+	fmt.Println("  provision    Create project directories with IDs and limits in one batch")
+	fmt.Println("  gc           Remove project quotas that no directory uses any more")
+	fmt.Println("  reconcile    Bring quota limits in line with a desired state file")
 	fmt.Println()
 	fmt.Println("Examples:")
 	fmt.Println("  Detect filesystem:")
@@ -31,6 +43,7 @@ func printUsage() {
 	fmt.Println()
 	fmt.Println("  Set project ID:")
 	fmt.Println("    quota-tool set-project /mnt/data 100")
+	fmt.Println("    quota-tool set-project /mnt/data 100 /var/tmp/data.ckpt   (resumable)")
 	fmt.Println()
 	fmt.Println("  Set quota:")
 	fmt.Println("    quota-tool set /mnt/data 1000 1048576 921600 100000 90000")
@@ -50,6 +63,29 @@ func printUsage() {
 	fmt.Println("  Remove quota:")
 	fmt.Println("    quota-tool remove /mnt/data 1000")
 	fmt.Println()
+	fmt.Println("  Census (XFS only, compared with kernel accounting):")
+	fmt.Println("    quota-tool census /mnt/data [project|user|group]")
+	fmt.Println()
+	fmt.Println("  Usage without quota accounting (optional cache for fast re-scans):")
+	fmt.Println("    quota-tool usage /mnt/data/projects project /var/tmp/projects.usage")
+	fmt.Println()
+	fmt.Println("  Find where a project lives:")
+	fmt.Println("    quota-tool index /mnt/data /var/lib/quota/data.index")
+	fmt.Println("    quota-tool where /var/lib/quota/data.index 4711")
+	fmt.Println()
+	fmt.Println("  Reserve project IDs (shared with other provisioners through the lock file):")
+	fmt.Println("    quota-tool alloc-id /mnt/data /var/lib/quota/data.ids 10000-19999 5")
+	fmt.Println()
+	fmt.Println("  Provision project directories (one \"path id bhard bsoft ihard isoft\" per line, id 0 = allocate):")
+	fmt.Println("    quota-tool provision volumes.txt /var/lib/quota/data.ids")
+	fmt.Println()
+	fmt.Println("  Remove orphaned project quotas (dry run first, then at most 50 per second):")
+	fmt.Println("    quota-tool gc /mnt/data /mnt/data/volumes dry-run")
+	fmt.Println("    quota-tool gc /mnt/data /mnt/data/volumes,/mnt/data/cache 50")
+	fmt.Println()
+	fmt.Println("  Reconcile limits (one \"type id bhard bsoft ihard isoft\" per line; unlisted IDs of those types are removed):")
+	fmt.Println("    quota-tool reconcile /mnt/data desired.txt dry-run")
+	fmt.Println()
 	fmt.Println("  Run tests:")
 	fmt.Println("    quota-tool test /mnt/data 1000")
 }
@@ -362,7 +398,364 @@ func detectFileSystem(path string) {
 	fmt.Printf("Filesystem: %s\n", fstype)
 }
 
-func setProjectID(path string, projectIDStr string) {
+func census(path string, typeStr string) {
+	var qtype quota.QuotaType
+	switch typeStr {
+	case "user", "usr", "u":
+		qtype = quota.UserQuota
+	case "group", "grp", "g":
+		qtype = quota.GroupQuota
+	case "project", "proj", "p":
+		qtype = quota.ProjQuota
+	default:
+		log.Fatalf("Invalid quota type: %s (must be user, group, or project)", typeStr)
+	}
+
+	start := time.Now()
+	infos, stats, err := quota.Census(path, qtype)
+	if err != nil {
+		log.Fatalf("Failed to run census: %v", err)
+	}
+	fmt.Printf("Scanned %d inodes with bulkstat v%d in %s\n", stats.Inodes, stats.BulkVersion, time.Since(start).Round(time.Millisecond))
+
+	if len(infos) == 0 {
+		fmt.Println("No inodes found")
+		return
+	}
+
+	// 内核记账不可用（配额未开启等）时只打印普查结果
+	ids := make([]uint32, len(infos))
+	for i, info := range infos {
+		ids[i] = info.ID
+	}
+	kernel, errs, err := quota.GetQuotas(path, qtype, ids)
+	if err != nil {
+		kernel = nil
+	}
+
+	fmt.Println()
+	fmt.Printf("%-10s %12s %14s %12s %14s\n", "ID", "Inodes", "Space (KiB)", "Kern Inodes", "Kern Space")
+	for i, info := range infos {
+		kernInodes, kernBlocks := "-", "-"
+		if kernel != nil && errs[i] == nil {
+			kernInodes = strconv.FormatUint(kernel[i].CurrentInodes, 10)
+			kernBlocks = strconv.FormatUint(kernel[i].CurrentBlocks, 10)
+		}
+		fmt.Printf("%-10d %12d %14d %12s %14s\n", info.ID, info.CurrentInodes, info.CurrentBlocks, kernInodes, kernBlocks)
+	}
+	fmt.Printf("\nTotal: %d ID(s)\n", len(infos))
+}
+
+func scanUsage(path string, typeStr string, cache string) {
+	var qtype quota.QuotaType
+	switch typeStr {
+	case "user", "usr", "u":
+		qtype = quota.UserQuota
+	case "group", "grp", "g":
+		qtype = quota.GroupQuota
+	case "project", "proj", "p":
+		qtype = quota.ProjQuota
+	default:
+		log.Fatalf("Invalid quota type: %s (must be user, group, or project)", typeStr)
+	}
+
+	infos, stats, err := quota.ScanUsage(path, qtype, quota.UsageScanOptions{Cache: cache})
+	if err != nil {
+		log.Fatalf("Failed to scan usage: %v", err)
+	}
+	fmt.Printf("Scanned %d dirs (%d from cache) and %d files in %s, %d duplicate hardlinks, %d skipped\n",
+		stats.Dirs, stats.Cached, stats.Files, stats.Elapsed.Round(time.Millisecond), stats.Hardlinks, stats.Skipped)
+
+	fmt.Println()
+	fmt.Printf("%-10s %12s %14s\n", "ID", "Inodes", "Space (KiB)")
+	for _, info := range infos {
+		fmt.Printf("%-10d %12d %14d\n", info.ID, info.CurrentInodes, info.CurrentBlocks)
+	}
+	fmt.Printf("\nTotal: %d ID(s)\n", len(infos))
+}
+
+func buildProjectIndex(path string, file string) {
+	start := time.Now()
+	index, err := quota.BuildProjectIndex(path, file, 0)
+	if err != nil {
+		log.Fatalf("Failed to build project index: %v", err)
+	}
+	defer index.Close()
+
+	roots := 0
+	for _, id := range index.Projects() {
+		roots += len(index.Lookup(id))
+	}
+	fmt.Printf("✓ Indexed %d project(s) with %d root dir(s) under %s in %s\n",
+		len(index.Projects()), roots, index.Root(), time.Since(start).Round(time.Millisecond))
+}
+
+func lookupProject(file string, projectIDStr string) {
+	projectID, err := strconv.ParseUint(projectIDStr, 10, 32)
+	if err != nil {
+		log.Fatalf("Invalid project ID value: %v", err)
+	}
+
+	index, err := quota.OpenProjectIndex(file)
+	if err != nil {
+		log.Fatalf("Failed to open project index: %v", err)
+	}
+	defer index.Close()
+
+	roots := index.Lookup(uint32(projectID))
+	if len(roots) == 0 {
+		fmt.Printf("Project %d not found under %s (index built %s)\n", projectID, index.Root(), index.BuiltAt().Format(time.RFC3339))
+		return
+	}
+	for _, root := range roots {
+		fmt.Println(root)
+	}
+}
+
+func allocProjectIDs(path string, lockFile string, args []string) {
+	opts := quota.ProjectIDAllocatorOptions{LockFile: lockFile}
+	if len(args) > 0 {
+		lo, hi, ok := strings.Cut(args[0], "-")
+		min, err1 := strconv.ParseUint(lo, 10, 32)
+		max, err2 := strconv.ParseUint(hi, 10, 32)
+		if !ok || err1 != nil || err2 != nil {
+			log.Fatalf("Invalid range: %s (must be min-max)", args[0])
+		}
+		opts.Ranges = []quota.ProjectIDRange{{Min: uint32(min), Max: uint32(max)}}
+	}
+	count := 1
+	if len(args) > 1 {
+		n, err := strconv.Atoi(args[1])
+		if err != nil || n < 1 {
+			log.Fatalf("Invalid count: %s", args[1])
+		}
+		count = n
+	}
+
+	allocator, err := quota.NewProjectIDAllocator(path, opts)
+	if err != nil {
+		log.Fatalf("Failed to create allocator: %v", err)
+	}
+	defer allocator.Close()
+
+	ids, err := allocator.AllocateN(count)
+	for _, id := range ids {
+		fmt.Println(id)
+	}
+	if err != nil {
+		log.Fatalf("Failed to allocate project IDs: %v", err)
+	}
+}
+
+func provisionProjects(specFile string, lockFile string) {
+	data, err := os.ReadFile(specFile)
+	if err != nil {
+		log.Fatalf("Failed to read spec file: %v", err)
+	}
+
+	var specs []quota.ProvisionSpec
+	needAlloc := false
+	for n, line := range strings.Split(string(data), "\n") {
+		fields := strings.Fields(line)
+		if len(fields) == 0 || strings.HasPrefix(fields[0], "#") {
+			continue
+		}
+		if len(fields) != 6 {
+			log.Fatalf("Line %d: expected \"path id bhard bsoft ihard isoft\"", n+1)
+		}
+		var values [5]uint64
+		for i, f := range fields[1:] {
+			bits := 64
+			if i == 0 {
+				bits = 32
+			}
+			if values[i], err = strconv.ParseUint(f, 10, bits); err != nil {
+				log.Fatalf("Line %d: invalid value %s", n+1, f)
+			}
+		}
+		specs = append(specs, quota.ProvisionSpec{
+			Path:           fields[0],
+			ProjectID:      uint32(values[0]),
+			BlockHardLimit: values[1],
+			BlockSoftLimit: values[2],
+			InodeHardLimit: values[3],
+			InodeSoftLimit: values[4],
+		})
+		needAlloc = needAlloc || values[0] == 0
+	}
+	if len(specs) == 0 {
+		log.Fatalf("No directories in %s", specFile)
+	}
+
+	opts := quota.ProvisionOptions{Verify: true}
+	if needAlloc {
+		if lockFile == "" {
+			log.Fatalf("Project ID 0 needs a lock file to allocate from")
+		}
+		// Project IDs are per filesystem: one allocator for each mount that needs IDs.
+		// They share the lock file, so an ID reserved on one mount is skipped on the others too.
+		seen := make(map[uint64]bool)
+		for _, spec := range specs {
+			if spec.ProjectID != 0 {
+				continue
+			}
+			dir := filepath.Dir(filepath.Clean(spec.Path))
+			var st syscall.Stat_t
+			if err := syscall.Stat(dir, &st); err != nil {
+				log.Fatalf("Failed to stat %s: %v", dir, err)
+			}
+			if seen[uint64(st.Dev)] {
+				continue
+			}
+			seen[uint64(st.Dev)] = true
+			allocator, err := quota.NewProjectIDAllocator(dir, quota.ProjectIDAllocatorOptions{LockFile: lockFile})
+			if err != nil {
+				log.Fatalf("Failed to create allocator for %s: %v", dir, err)
+			}
+			defer allocator.Close()
+			opts.Allocators = append(opts.Allocators, allocator)
+		}
+	}
+
+	results, timings, err := quota.ProvisionProjects(specs, opts)
+	for _, r := range results {
+		if r.Err != nil {
+			fmt.Printf("✗ %s: %v\n", r.Path, r.Err)
+		} else {
+			fmt.Printf("✓ %s: project %d (created: %v)\n", r.Path, r.ProjectID, r.Created)
+		}
+	}
+	fmt.Printf("\nResolve %s, mkdir %s, project ID %s, limits %s, verify %s, rollback %s\n",
+		timings.Resolve.Round(time.Microsecond), timings.Mkdir.Round(time.Microsecond),
+		timings.ProjectID.Round(time.Microsecond), timings.Limits.Round(time.Microsecond),
+		timings.Verify.Round(time.Microsecond), timings.Rollback.Round(time.Microsecond))
+	if err != nil {
+		log.Fatalf("Provisioning failed: %v", err)
+	}
+}
+
+func collectOrphans(path string, roots string, args []string) {
+	opts := quota.GCOptions{Roots: strings.Split(roots, ",")}
+	for _, arg := range args {
+		if arg == "dry-run" {
+			opts.DryRun = true
+			continue
+		}
+		rate, err := strconv.ParseFloat(arg, 64)
+		if err != nil || rate <= 0 {
+			log.Fatalf("Invalid option: %s (must be dry-run or a rate per second)", arg)
+		}
+		opts.Rate = rate
+	}
+
+	report, err := quota.CollectOrphanProjects(path, opts)
+	if report != nil {
+		fmt.Printf("Scanned %d project quota(s) and %d dir(s); %d project(s) in use\n", report.Records, report.Dirs, report.InUse)
+		if opts.DryRun {
+			for _, id := range report.Orphans {
+				fmt.Printf("  would remove project %d\n", id)
+			}
+			fmt.Printf("\n%d orphaned project quota(s) found in %s (dry run)\n", len(report.Orphans), report.Elapsed.Round(time.Millisecond))
+		} else {
+			for id, ferr := range report.Failed {
+				fmt.Printf("  ✗ project %d: %v\n", id, ferr)
+			}
+			fmt.Printf("\n✓ Removed %d of %d orphaned project quota(s), %d skipped as in use, in %s\n",
+				len(report.Removed), len(report.Orphans), len(report.Skipped), report.Elapsed.Round(time.Millisecond))
+		}
+	}
+	if err != nil {
+		log.Fatalf("Failed to collect orphaned project quotas: %v", err)
+	}
+}
+
+func reconcileQuotas(path string, specFile string, args []string) {
+	data, err := os.ReadFile(specFile)
+	if err != nil {
+		log.Fatalf("Failed to read desired state: %v", err)
+	}
+
+	var desired []quota.QuotaLimit
+	for n, line := range strings.Split(string(data), "\n") {
+		fields := strings.Fields(line)
+		if len(fields) == 0 || strings.HasPrefix(fields[0], "#") {
+			continue
+		}
+		if len(fields) != 6 {
+			log.Fatalf("Line %d: expected \"type id bhard bsoft ihard isoft\"", n+1)
+		}
+		var qtype quota.QuotaType
+		switch fields[0] {
+		case "user", "usr", "u":
+			qtype = quota.UserQuota
+		case "group", "grp", "g":
+			qtype = quota.GroupQuota
+		case "project", "proj", "p":
+			qtype = quota.ProjQuota
+		default:
+			log.Fatalf("Line %d: invalid quota type %s", n+1, fields[0])
+		}
+		var values [5]uint64
+		for i, f := range fields[1:] {
+			bits := 64
+			if i == 0 {
+				bits = 32
+			}
+			if values[i], err = strconv.ParseUint(f, 10, bits); err != nil {
+				log.Fatalf("Line %d: invalid value %s", n+1, f)
+			}
+		}
+		desired = append(desired, quota.QuotaLimit{
+			ID:             uint32(values[0]),
+			Type:           qtype,
+			BlockHardLimit: values[1],
+			BlockSoftLimit: values[2],
+			InodeHardLimit: values[3],
+			InodeSoftLimit: values[4],
+		})
+	}
+
+	opts := quota.ReconcileOptions{}
+	for _, arg := range args {
+		switch arg {
+		case "dry-run":
+			opts.DryRun = true
+		case "keep":
+			opts.KeepUnlisted = true
+		default:
+			log.Fatalf("Invalid option: %s (must be dry-run or keep)", arg)
+		}
+	}
+
+	report, err := quota.ReconcileWithOptions(path, desired, opts)
+	if report != nil {
+		verb := "Set"
+		if opts.DryRun {
+			verb = "Would set"
+		}
+		for _, l := range report.Set {
+			fmt.Printf("  %s type=%d id=%d bhard=%d bsoft=%d ihard=%d isoft=%d\n", verb, l.Type, l.ID,
+				l.BlockHardLimit, l.BlockSoftLimit, l.InodeHardLimit, l.InodeSoftLimit)
+		}
+		verb = "Removed"
+		if opts.DryRun {
+			verb = "Would remove"
+		}
+		for _, info := range report.Removed {
+			fmt.Printf("  %s type=%d id=%d\n", verb, info.Type, info.ID)
+		}
+		for _, f := range report.Failed {
+			fmt.Printf("  ✗ type=%d id=%d: %v\n", f.Type, f.ID, f.Err)
+		}
+		fmt.Printf("\n%d listed, %d unchanged, %d set, %d removed in %s\n", report.Listed, report.Unchanged,
+			len(report.Set), len(report.Removed), report.Elapsed.Round(time.Millisecond))
+	}
+	if err != nil {
+		log.Fatalf("Failed to reconcile quotas: %v", err)
+	}
+}
+
+func setProjectID(path string, projectIDStr string, checkpoint string) {
 	projectID, err := strconv.ParseUint(projectIDStr, 10, 32)
 	if err != nil {
 		log.Fatalf("Invalid project ID value: %v", err)
@@ -370,12 +763,18 @@ func setProjectID(path string, projectIDStr string) {
 
 	fmt.Printf("Setting project ID %d for path=%s\n", projectID, path)
 
-	err = quota.SetProjectIDRecursive(path, int(projectID))
+	stats, err := quota.SetProjectIDRecursiveWithOptions(path, int(projectID), quota.ProjectTagOptions{
+		Progress: func(s quota.ProjectTagStats) {
+			fmt.Printf("  %d dirs, %d files (%d already set), %d subtrees resumed, %d skipped (%.0f entries/s)\n",
+				s.Dirs, s.Files, s.Unchanged, s.Resumed, s.Skipped, s.Rate())
+		},
+		Checkpoint: checkpoint,
+	})
 	if err != nil {
 		log.Fatalf("Failed to set project ID: %v", err)
 	}
 
-	fmt.Println("✓ Project ID set successfully")
+	fmt.Printf("✓ Project ID set on %d dirs and %d files in %s\n", stats.Dirs, stats.Files, stats.Elapsed.Round(time.Millisecond))
 }
 
 func main() {
@@ -396,10 +795,14 @@ func main() {
 
 	case "set-project":
 		if len(os.Args) < 4 {
-			fmt.Println("Usage: quota-tool set-project <path> <project_id>")
+			fmt.Println("Usage: quota-tool set-project <path> <project_id> [checkpoint_file]")
 			os.Exit(1)
 		}
-		setProjectID(os.Args[2], os.Args[3])
+		checkpoint := ""
+		if len(os.Args) > 4 {
+			checkpoint = os.Args[4]
+		}
+		setProjectID(os.Args[2], os.Args[3], checkpoint)
 
 	case "get":
 		if len(os.Args) < 4 {
@@ -443,6 +846,78 @@ func main() {
 		}
 		detectFileSystem(os.Args[2])
 
+	case "census":
+		if len(os.Args) < 3 {
+			fmt.Println("Usage: quota-tool census <path> [type]")
+			os.Exit(1)
+		}
+		typeStr := "project"
+		if len(os.Args) > 3 {
+			typeStr = os.Args[3]
+		}
+		census(os.Args[2], typeStr)
+
+	case "usage":
+		if len(os.Args) < 3 {
+			fmt.Println("Usage: quota-tool usage <path> [type] [cache_file]")
+			os.Exit(1)
+		}
+		typeStr := "project"
+		if len(os.Args) > 3 {
+			typeStr = os.Args[3]
+		}
+		cache := ""
+		if len(os.Args) > 4 {
+			cache = os.Args[4]
+		}
+		scanUsage(os.Args[2], typeStr, cache)
+
+	case "index":
+		if len(os.Args) < 4 {
+			fmt.Println("Usage: quota-tool index <path> <index_file>")
+			os.Exit(1)
+		}
+		buildProjectIndex(os.Args[2], os.Args[3])
+
+	case "where":
+		if len(os.Args) < 4 {
+			fmt.Println("Usage: quota-tool where <index_file> <project_id>")
+			os.Exit(1)
+		}
+		lookupProject(os.Args[2], os.Args[3])
+
+	case "alloc-id":
+		if len(os.Args) < 4 {
+			fmt.Println("Usage: quota-tool alloc-id <path> <lock_file> [min-max] [count]")
+			os.Exit(1)
+		}
+		allocProjectIDs(os.Args[2], os.Args[3], os.Args[4:])
+
+	case "provision":
+		if len(os.Args) < 3 {
+			fmt.Println("Usage: quota-tool provision <spec_file> [lock_file]")
+			os.Exit(1)
+		}
+		lockFile := ""
+		if len(os.Args) > 3 {
+			lockFile = os.Args[3]
+		}
+		provisionProjects(os.Args[2], lockFile)
+
+	case "gc":
+		if len(os.Args) < 4 {
+			fmt.Println("Usage: quota-tool gc <path> <root[,root...]> [dry-run] [rate]")
+			os.Exit(1)
+		}
+		collectOrphans(os.Args[2], os.Args[3], os.Args[4:])
+
+	case "reconcile":
+		if len(os.Args) < 4 {
+			fmt.Println("Usage: quota-tool reconcile <path> <desired_file> [dry-run] [keep]")
+			os.Exit(1)
+		}
+		reconcileQuotas(os.Args[2], os.Args[3], os.Args[4:])
+
 	case "-h", "--help", "help":
 		printUsage()
 
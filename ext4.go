@@ -2,7 +2,7 @@ package quota
 
 /*
 #cgo CFLAGS: -Wall -Wextra -I${SRCDIR}/pkg/ext4
-#cgo LDFLAGS: ${SRCDIR}/pkg/ext4/quota_ext4.o ${SRCDIR}/pkg/ext4/quota_ext4_fast.o ${SRCDIR}/pkg/ext4/quota_ext4_direct.o
+#cgo LDFLAGS: ${SRCDIR}/pkg/ext4/quota_ext4.o ${SRCDIR}/pkg/ext4/quota_ext4_fast.o ${SRCDIR}/pkg/ext4/quota_ext4_direct.o ${SRCDIR}/pkg/ext4/quota_ext4_seed.o
 #include <stdlib.h>
 #include "quota_ext4.h"
 */
@@ -14,118 +14,78 @@ import (
 
 type EXT4Manager struct{}
 
+var ext4Backend = quotaBackend{
+	setQuota:  ext4SetQuota,
+	setQuotas: ext4SetQuotas,
+	getQuota:  ext4GetQuota,
+	getQuotas: ext4GetQuotas,
+	list: func(m *mountHandle, path string, qtype int, maxID uint32) ([]QuotaInfo, error) {
+		return listEXT4Adaptive(m, qtype, maxID)
+	},
+	iterate:     ext4IterateQuotas,
+	removeQuota: ext4RemoveQuota,
+	testQuota:   ext4TestQuota,
+}
+
 func (m *EXT4Manager) SetQuota(path string, id uint32, qtype QuotaType, bhard, bsoft, ihard, isoft uint64) error {
-	return ext4SetQuota(path, id, int(qtype), bhard, bsoft, ihard, isoft)
+	return doMount(path, func(mh *mountHandle) error {
+		return ext4SetQuota(mh.handle, id, int(qtype), bhard, bsoft, ihard, isoft)
+	})
+}
+
+func (m *EXT4Manager) SetQuotas(path string, limits []QuotaLimit) ([]error, error) {
+	return withMount(path, func(mh *mountHandle) ([]error, error) {
+		return ext4SetQuotas(mh.handle, limits)
+	})
 }
 
 func (m *EXT4Manager) GetQuota(path string, id uint32, qtype QuotaType) (*QuotaInfo, error) {
-	info, err := ext4GetQuota(path, id, int(qtype))
+	return withMount(path, func(mh *mountHandle) (*QuotaInfo, error) {
+		return ext4GetQuota(mh.handle, id, int(qtype))
+	})
+}
+
+func (m *EXT4Manager) GetQuotas(path string, qtype QuotaType, ids []uint32) ([]QuotaInfo, []error, error) {
+	mh, err := acquireMount(path)
 	if err != nil {
-		return nil, err
+		return nil, nil, err
 	}
-	return &QuotaInfo{
-		ID:             info.ID,
-		Type:           QuotaType(info.Type),
-		BlockHardLimit: info.BlockHardLimit,
-		BlockSoftLimit: info.BlockSoftLimit,
-		CurrentBlocks:  info.CurrentBlocks,
-		InodeHardLimit: info.InodeHardLimit,
-		InodeSoftLimit: info.InodeSoftLimit,
-		CurrentInodes:  info.CurrentInodes,
-		BlockTime:      info.BlockTime,
-		InodeTime:      info.InodeTime,
-	}, nil
+	defer mh.release()
+	return ext4GetQuotas(mh.handle, int(qtype), ids)
 }
 
 func (m *EXT4Manager) ListQuotas(path string, qtype QuotaType, maxID uint32) ([]QuotaInfo, error) {
-	infos, err := ext4ListQuotasDirect(path, int(qtype), maxID)
-	if err == nil {
-		result := make([]QuotaInfo, len(infos))
-		for i, info := range infos {
-			result[i] = QuotaInfo{
-				ID:             info.ID,
-				Type:           QuotaType(info.Type),
-				BlockHardLimit: info.BlockHardLimit,
-				BlockSoftLimit: info.BlockSoftLimit,
-				CurrentBlocks:  info.CurrentBlocks,
-				InodeHardLimit: info.InodeHardLimit,
-				InodeSoftLimit: info.InodeSoftLimit,
-				CurrentInodes:  info.CurrentInodes,
-				BlockTime:      info.BlockTime,
-				InodeTime:      info.InodeTime,
-			}
-		}
-		return result, nil
-	}
+	return withMount(path, func(mh *mountHandle) ([]QuotaInfo, error) {
+		return listEXT4Adaptive(mh, int(qtype), maxID)
+	})
+}
 
-	infos, err = ext4ListQuotasFast(path, int(qtype), maxID)
-	if err == nil {
-		result := make([]QuotaInfo, len(infos))
-		for i, info := range infos {
-			result[i] = QuotaInfo{
-				ID:             info.ID,
-				Type:           QuotaType(info.Type),
-				BlockHardLimit: info.BlockHardLimit,
-				BlockSoftLimit: info.BlockSoftLimit,
-				CurrentBlocks:  info.CurrentBlocks,
-				InodeHardLimit: info.InodeHardLimit,
-				InodeSoftLimit: info.InodeSoftLimit,
-				CurrentInodes:  info.CurrentInodes,
-				BlockTime:      info.BlockTime,
-				InodeTime:      info.InodeTime,
-			}
-		}
-		return result, nil
-	}
+// DiscoverQuotas 只查询能够推断出的候选 ID（系统用户/组/项目数据库与挂载点顶层目录），
+// 适用于不支持 Q_GETNEXTQUOTA 的旧内核；backfill > 0 时额外补扫 [0, backfill]。
+func (m *EXT4Manager) DiscoverQuotas(path string, qtype QuotaType, maxID, backfill uint32) ([]QuotaInfo, error) {
+	return ext4ListQuotasSeeded(path, int(qtype), maxID, backfill)
+}
 
-	infos, err = ext4ListQuotas(path, int(qtype), maxID)
-	if err != nil {
-		return nil, err
-	}
-	result := make([]QuotaInfo, len(infos))
-	for i, info := range infos {
-		result[i] = QuotaInfo{
-			ID:             info.ID,
-			Type:           QuotaType(info.Type),
-			BlockHardLimit: info.BlockHardLimit,
-			BlockSoftLimit: info.BlockSoftLimit,
-			CurrentBlocks:  info.CurrentBlocks,
-			InodeHardLimit: info.InodeHardLimit,
-			InodeSoftLimit: info.InodeSoftLimit,
-			CurrentInodes:  info.CurrentInodes,
-			BlockTime:      info.BlockTime,
-			InodeTime:      info.InodeTime,
-		}
-	}
-	return result, nil
+func (m *EXT4Manager) IterateQuotas(path string, qtype QuotaType, token uint64, batchSize int) (QuotaIterator, error) {
+	return iterateWith(path, func(mh *mountHandle) (QuotaIterator, error) {
+		return ext4IterateQuotas(mh.handle, int(qtype), token, batchSize, mh.release)
+	})
 }
 
 func (m *EXT4Manager) RemoveQuota(path string, id uint32, qtype QuotaType) error {
-	return ext4RemoveQuota(path, id, int(qtype))
+	return doMount(path, func(mh *mountHandle) error {
+		return ext4RemoveQuota(mh.handle, id, int(qtype))
+	})
 }
 
 func (m *EXT4Manager) TestQuota(path string, id uint32, qtype QuotaType) error {
-	return ext4TestQuota(path, id, int(qtype))
-}
-
-type ext4QuotaInfo struct {
-	ID             uint32
-	Type           int32
-	BlockHardLimit uint64
-	BlockSoftLimit uint64
-	CurrentBlocks  uint64
-	InodeHardLimit uint64
-	InodeSoftLimit uint64
-	CurrentInodes  uint64
-	BlockTime      uint64
-	InodeTime      uint64
+	return doMount(path, func(mh *mountHandle) error {
+		return ext4TestQuota(mh.handle, id, int(qtype))
+	})
 }
 
-func ext4SetQuota(path string, id uint32, qtype int, bhard, bsoft, ihard, isoft uint64) error {
-	cPath := C.CString(path)
-	defer C.free(unsafe.Pointer(cPath))
-
-	ret := C.ext4_set_quota(cPath, C.uint32_t(id), C.int(qtype),
+func ext4SetQuota(h *C.quota_handle_t, id uint32, qtype int, bhard, bsoft, ihard, isoft uint64) error {
+	ret := C.ext4_handle_set_quota(h, C.uint32_t(id), C.int(qtype),
 		C.ulong(bhard), C.ulong(bsoft), C.ulong(ihard), C.ulong(isoft))
 
 	if ret != 0 {
@@ -136,134 +96,156 @@ func ext4SetQuota(path string, id uint32, qtype int, bhard, bsoft, ihard, isoft
 	return nil
 }
 
-func ext4GetQuota(path string, id uint32, qtype int) (*ext4QuotaInfo, error) {
-	cPath := C.CString(path)
-	defer C.free(unsafe.Pointer(cPath))
+func ext4SetQuotas(h *C.quota_handle_t, limits []QuotaLimit) ([]error, error) {
+	if len(limits) == 0 {
+		return nil, nil
+	}
 
-	var info C.EXT4QuotaInfo
-	ret := C.ext4_get_quota(cPath, C.uint32_t(id), C.int(qtype), &info)
+	codes := make([]int32, len(limits))
+	ret := C.ext4_handle_set_quotas(h, limitPtr(limits), C.size_t(len(limits)),
+		(*C.int)(unsafe.Pointer(&codes[0])), C.int(batchWorkers(len(limits))))
 
 	if ret != 0 {
 		errMsg := C.GoString(C.ext4_error_string(C.int(ret)))
 		return nil, &QuotaError{Code: int(ret), Message: errMsg}
 	}
 
-	return &ext4QuotaInfo{
-		ID:             uint32(info.id),
-		Type:           int32(info.qtype),
-		BlockHardLimit: uint64(info.bhardlimit),
-		BlockSoftLimit: uint64(info.bsoftlimit),
-		CurrentBlocks:  uint64(info.curblocks),
-		InodeHardLimit: uint64(info.ihardlimit),
-		InodeSoftLimit: uint64(info.isoftlimit),
-		CurrentInodes:  uint64(info.curinodes),
-		BlockTime:      uint64(info.btime),
-		InodeTime:      uint64(info.itime),
-	}, nil
+	return batchErrors(codes, func(code int32) string {
+		return C.GoString(C.ext4_error_string(C.int(code)))
+	}), nil
 }
 
-func ext4ListQuotas(path string, qtype int, maxID uint32) ([]ext4QuotaInfo, error) {
-	cPath := C.CString(path)
-	defer C.free(unsafe.Pointer(cPath))
+func ext4GetQuota(h *C.quota_handle_t, id uint32, qtype int) (*QuotaInfo, error) {
+	var info QuotaInfo
+	ret := C.ext4_handle_get_quota(h, C.uint32_t(id), C.int(qtype), (*C.QuotaRecord)(unsafe.Pointer(&info)))
 
-	var list C.EXT4QuotaList
-	ret := C.ext4_list_quotas(cPath, C.int(qtype), &list, C.int(maxID))
+	if ret != 0 {
+		errMsg := C.GoString(C.ext4_error_string(C.int(ret)))
+		return nil, &QuotaError{Code: int(ret), Message: errMsg}
+	}
+
+	return &info, nil
+}
+
+func ext4GetQuotas(h *C.quota_handle_t, qtype int, ids []uint32) ([]QuotaInfo, []error, error) {
+	if len(ids) == 0 {
+		return nil, nil, nil
+	}
+
+	infos := make([]QuotaInfo, len(ids))
+	codes := make([]int32, len(ids))
+	ret := C.ext4_handle_get_quotas(h, C.int(qtype), (*C.uint32_t)(unsafe.Pointer(&ids[0])), C.size_t(len(ids)),
+		recordPtr(infos), (*C.int)(unsafe.Pointer(&codes[0])))
+
+	if ret != 0 {
+		errMsg := C.GoString(C.ext4_error_string(C.int(ret)))
+		return nil, nil, &QuotaError{Code: int(ret), Message: errMsg}
+	}
+
+	return infos, batchErrors(codes, func(code int32) string {
+		return C.GoString(C.ext4_error_string(C.int(code)))
+	}), nil
+}
 
+func ext4ListQuotas(h *C.quota_handle_t, qtype int, maxID uint32) ([]QuotaInfo, error) {
+	var cursor *C.EXT4QuotaCursor
+	ret := C.ext4_handle_list_begin(h, C.int(qtype), 0, C.int(maxID), &cursor)
 	if ret != 0 {
 		errMsg := C.GoString(C.ext4_error_string(C.int(ret)))
 		return nil, &QuotaError{Code: int(ret), Message: errMsg}
 	}
+	defer C.ext4_list_end(cursor)
+
+	return drainQuotas(func(buf []QuotaInfo) (int, bool, error) {
+		var count, more C.int
+		ret := C.ext4_list_next(cursor, recordPtr(buf), C.int(len(buf)), &count, &more)
+		if ret != 0 {
+			errMsg := C.GoString(C.ext4_error_string(C.int(ret)))
+			return int(count), false, &QuotaError{Code: int(ret), Message: errMsg}
+		}
+		return int(count), more != 0, nil
+	})
+}
 
-	defer C.ext4_free_quota_list(&list)
+func ext4ListQuotasFast(h *C.quota_handle_t, qtype int, maxID uint32) ([]QuotaInfo, error) {
+	return fillQuotas(func(buf []QuotaInfo) (int, bool, error) {
+		var count C.size_t
+		var more C.int
+		ret := C.ext4_handle_list_quotas_fast_into(h, C.int(qtype), C.int(maxID),
+			recordPtr(buf), C.size_t(len(buf)), &count, &more)
+		if ret != 0 {
+			return 0, false, &QuotaError{Code: int(ret), Message: "Fast method not available"}
+		}
+		return int(count), more != 0, nil
+	})
+}
 
-	infos := make([]ext4QuotaInfo, int(list.count))
-	for i := 0; i < int(list.count); i++ {
-		item := (*[1 << 28]C.EXT4QuotaInfo)(unsafe.Pointer(list.items))[i]
-		infos[i] = ext4QuotaInfo{
-			ID:             uint32(item.id),
-			Type:           int32(item.qtype),
-			BlockHardLimit: uint64(item.bhardlimit),
-			BlockSoftLimit: uint64(item.bsoftlimit),
-			CurrentBlocks:  uint64(item.curblocks),
-			InodeHardLimit: uint64(item.ihardlimit),
-			InodeSoftLimit: uint64(item.isoftlimit),
-			CurrentInodes:  uint64(item.curinodes),
-			BlockTime:      uint64(item.btime),
-			InodeTime:      uint64(item.itime),
+func ext4ListQuotasDirect(h *C.quota_handle_t, qtype int, maxID uint32) ([]QuotaInfo, error) {
+	return fillQuotas(func(buf []QuotaInfo) (int, bool, error) {
+		var count C.size_t
+		var more C.int
+		ret := C.ext4_handle_list_quotas_direct_into(h, C.int(qtype), C.int(maxID),
+			recordPtr(buf), C.size_t(len(buf)), &count, &more)
+		if ret != 0 {
+			return 0, false, &QuotaError{Code: int(ret), Message: "Direct method not available"}
 		}
-	}
-	return infos, nil
+		return int(count), more != 0, nil
+	})
 }
 
-func ext4ListQuotasFast(path string, qtype int, maxID uint32) ([]ext4QuotaInfo, error) {
+func ext4ListQuotasSeeded(path string, qtype int, maxID, backfill uint32) ([]QuotaInfo, error) {
 	cPath := C.CString(path)
 	defer C.free(unsafe.Pointer(cPath))
 
 	var list C.EXT4QuotaList
-	ret := C.ext4_list_quotas_fast(cPath, C.int(qtype), &list, C.int(maxID))
-
-	if ret == 0 {
-		defer C.ext4_free_quota_list(&list)
-
-		infos := make([]ext4QuotaInfo, int(list.count))
-		for i := 0; i < int(list.count); i++ {
-			item := (*[1 << 28]C.EXT4QuotaInfo)(unsafe.Pointer(list.items))[i]
-			infos[i] = ext4QuotaInfo{
-				ID:             uint32(item.id),
-				Type:           int32(item.qtype),
-				BlockHardLimit: uint64(item.bhardlimit),
-				BlockSoftLimit: uint64(item.bsoftlimit),
-				CurrentBlocks:  uint64(item.curblocks),
-				InodeHardLimit: uint64(item.ihardlimit),
-				InodeSoftLimit: uint64(item.isoftlimit),
-				CurrentInodes:  uint64(item.curinodes),
-				BlockTime:      uint64(item.btime),
-				InodeTime:      uint64(item.itime),
-			}
-		}
-		return infos, nil
+	ret := C.ext4_list_quotas_seeded(cPath, C.int(qtype), &list, C.int(maxID), C.uint32_t(backfill))
+
+	if ret != 0 {
+		errMsg := C.GoString(C.ext4_error_string(C.int(ret)))
+		return nil, &QuotaError{Code: int(ret), Message: errMsg}
 	}
 
-	return nil, &QuotaError{Code: int(ret), Message: "Fast method not available"}
+	defer C.ext4_free_quota_list(&list)
+
+	infos := make([]QuotaInfo, int(list.count))
+	copy(infos, unsafe.Slice((*QuotaInfo)(unsafe.Pointer(list.items)), int(list.count)))
+	return infos, nil
 }
 
-func ext4ListQuotasDirect(path string, qtype int, maxID uint32) ([]ext4QuotaInfo, error) {
-	cPath := C.CString(path)
-	defer C.free(unsafe.Pointer(cPath))
+func ext4IterateQuotas(h *C.quota_handle_t, qtype int, token uint64, batchSize int, done func()) (QuotaIterator, error) {
+	if batchSize <= 0 {
+		batchSize = DefaultIteratorBatchSize
+	}
 
-	var list C.EXT4QuotaList
-	ret := C.ext4_list_quotas_direct(cPath, C.int(qtype), &list, C.int(maxID))
-
-	if ret == 0 {
-		defer C.ext4_free_quota_list(&list)
-
-		infos := make([]ext4QuotaInfo, int(list.count))
-		for i := 0; i < int(list.count); i++ {
-			item := (*[1 << 28]C.EXT4QuotaInfo)(unsafe.Pointer(list.items))[i]
-			infos[i] = ext4QuotaInfo{
-				ID:             uint32(item.id),
-				Type:           int32(item.qtype),
-				BlockHardLimit: uint64(item.bhardlimit),
-				BlockSoftLimit: uint64(item.bsoftlimit),
-				CurrentBlocks:  uint64(item.curblocks),
-				InodeHardLimit: uint64(item.ihardlimit),
-				InodeSoftLimit: uint64(item.isoftlimit),
-				CurrentInodes:  uint64(item.curinodes),
-				BlockTime:      uint64(item.btime),
-				InodeTime:      uint64(item.itime),
-			}
+	var cursor *C.EXT4QuotaCursor
+	ret := C.ext4_handle_list_begin(h, C.int(qtype), C.uint64_t(token), 0, &cursor)
+	if ret != 0 {
+		errMsg := C.GoString(C.ext4_error_string(C.int(ret)))
+		return nil, &QuotaError{Code: int(ret), Message: errMsg}
+	}
+
+	fetch := func(buf []QuotaInfo) (int, error) {
+		var count, more C.int
+		ret := C.ext4_list_next(cursor, recordPtr(buf), C.int(len(buf)), &count, &more)
+		if ret != 0 {
+			errMsg := C.GoString(C.ext4_error_string(C.int(ret)))
+			return int(count), &QuotaError{Code: int(ret), Message: errMsg}
 		}
-		return infos, nil
+		return int(count), nil
+	}
+	tokenFn := func() uint64 {
+		return uint64(C.ext4_list_token(cursor))
+	}
+	end := func() {
+		C.ext4_list_end(cursor)
+		done()
 	}
 
-	return nil, &QuotaError{Code: int(ret), Message: "Direct method not available"}
+	return newBatchIterator(batchSize, fetch, tokenFn, end), nil
 }
 
-func ext4RemoveQuota(path string, id uint32, qtype int) error {
-	cPath := C.CString(path)
-	defer C.free(unsafe.Pointer(cPath))
-
-	ret := C.ext4_remove_quota(cPath, C.uint32_t(id), C.int(qtype))
+func ext4RemoveQuota(h *C.quota_handle_t, id uint32, qtype int) error {
+	ret := C.ext4_handle_remove_quota(h, C.uint32_t(id), C.int(qtype))
 
 	if ret != 0 {
 		errMsg := C.GoString(C.ext4_error_string(C.int(ret)))
@@ -273,11 +255,8 @@ func ext4RemoveQuota(path string, id uint32, qtype int) error {
 	return nil
 }
 
-func ext4TestQuota(path string, id uint32, qtype int) error {
-	cPath := C.CString(path)
-	defer C.free(unsafe.Pointer(cPath))
-
-	ret := C.ext4_test_quota(cPath, C.uint32_t(id), C.int(qtype))
+func ext4TestQuota(h *C.quota_handle_t, id uint32, qtype int) error {
+	ret := C.ext4_handle_test_quota(h, C.uint32_t(id), C.int(qtype))
 
 	if ret != 0 {
 		errMsg := C.GoString(C.ext4_error_string(C.int(ret)))
@@ -0,0 +1,185 @@
+package quota
+
+/*
+#include <stdlib.h>
+#include "pkg/common/quota_common.h"
+*/
+import "C"
+
+import (
+	"fmt"
+	"runtime"
+	"syscall"
+	"time"
+	"unsafe"
+)
+
+// DefaultGCBatchSize 是 GCOptions.BatchSize <= 0 时每批移除的配额数
+const DefaultGCBatchSize = 64
+
+// GCOptions 控制 CollectOrphanProjects
+type GCOptions struct {
+	// Roots 是存放项目目录的目录，必须与 path 在同一文件系统；为空时拒绝运行，
+	// 否则所有项目都会被当成孤儿
+	Roots     []string
+	DryRun    bool    // 只找出孤儿，不移除
+	BatchSize int     // 不限速时每批移除数，批内先用一次批量查询复核用量；限速时逐个复核
+	Rate      float64 // 每秒最多移除多少个配额，<= 0 不限速
+	Workers   int     // 扫描目录的线程数，<= 0 时取 CPU 数
+}
+
+// GCReport 是一次回收的结果
+type GCReport struct {
+	Records int              // 枚举到的项目配额记录数
+	Dirs    uint64           // 扫描的目录数
+	InUse   int              // 在目录上找到的不同项目 ID 数
+	Orphans []uint32         // 有限额、用量为 0、且没有目录带着的项目 ID
+	Removed []uint32         // 实际移除的 ID
+	Skipped []uint32         // 复核时已有用量而跳过的 ID
+	Failed  map[uint32]error // 移除失败的 ID
+	Elapsed time.Duration
+}
+
+// CollectOrphanProjects 回收容器异常退出后留下的项目配额。
+// 孤儿指有限额、块与 inode 用量都为 0、且 Roots 下没有任何目录带着该项目 ID 的项目。
+// 先枚举配额再扫描目录：扫描开始前已有限额的项目，其目录（先设 projid 后设限额）必然已经可见。
+// 移除按批进行，每批移除前用一次批量查询复核用量，期间开始写入的项目会被跳过；
+// Rate 限制移除速度，以便在线上节点运行，此时每个 ID 在等到它的时刻之后才复核，紧接着移除。
+func CollectOrphanProjects(path string, opts GCOptions) (*GCReport, error) {
+	if len(opts.Roots) == 0 {
+		return nil, fmt.Errorf("未指定项目目录所在的根目录")
+	}
+	if opts.BatchSize <= 0 {
+		opts.BatchSize = DefaultGCBatchSize
+	}
+	if opts.Workers <= 0 {
+		opts.Workers = runtime.NumCPU()
+	}
+
+	start := time.Now()
+	m, err := acquireBackend(path)
+	if err != nil {
+		return nil, err
+	}
+	defer m.release()
+
+	for _, root := range opts.Roots {
+		var st syscall.Stat_t
+		if err := syscall.Stat(root, &st); err != nil {
+			return nil, fmt.Errorf("无法访问根目录 %s: %w", root, err)
+		}
+		if uint64(st.Dev) != m.dev {
+			return nil, fmt.Errorf("根目录 %s 与 %s 不在同一文件系统", root, path)
+		}
+	}
+
+	report := &GCReport{Failed: make(map[uint32]error)}
+
+	// 用量为 0 的有限额记录才是候选
+	it, err := IterateQuotas(path, ProjQuota, 0, 0)
+	if err != nil {
+		return nil, err
+	}
+	var candidates []uint32
+	for it.Next() {
+		for _, info := range it.Batch() {
+			report.Records++
+			if info.ID != 0 && hasLimits(info) && info.CurrentBlocks == 0 && info.CurrentInodes == 0 {
+				candidates = append(candidates, info.ID)
+			}
+		}
+	}
+	err = it.Err()
+	it.Close()
+	if err != nil {
+		return nil, err
+	}
+
+	inUse := make(map[uint32]struct{})
+	if len(candidates) > 0 {
+		for _, root := range opts.Roots {
+			dirs, err := scanProjectDirs(root, opts.Workers, inUse)
+			report.Dirs += dirs
+			if err != nil {
+				return nil, err
+			}
+		}
+	}
+	report.InUse = len(inUse)
+	for _, id := range candidates {
+		if _, ok := inUse[id]; !ok {
+			report.Orphans = append(report.Orphans, id)
+		}
+	}
+
+	if opts.DryRun {
+		report.Elapsed = time.Since(start)
+		return report, nil
+	}
+
+	removeStart := time.Now()
+	removed := 0
+	batchSize := opts.BatchSize
+	if opts.Rate > 0 {
+		// 复核与移除之间不能隔着限速的等待，否则复核时还空着的项目可能已经开始写入
+		batchSize = 1
+	}
+	for off := 0; off < len(report.Orphans); off += batchSize {
+		if opts.Rate > 0 {
+			due := removeStart.Add(time.Duration(float64(removed) / opts.Rate * float64(time.Second)))
+			if wait := time.Until(due); wait > 0 {
+				time.Sleep(wait)
+			}
+		}
+		batch := report.Orphans[off:min(off+batchSize, len(report.Orphans))]
+		infos, errs, err := m.backend.getQuotas(m.handle, int(ProjQuota), batch)
+		if err != nil {
+			return report, err
+		}
+		for i, id := range batch {
+			if errs[i] != nil {
+				report.Failed[id] = errs[i]
+				continue
+			}
+			if infos[i].CurrentBlocks != 0 || infos[i].CurrentInodes != 0 || !hasLimits(infos[i]) {
+				report.Skipped = append(report.Skipped, id)
+				continue
+			}
+			removed++
+			if err := m.backend.removeQuota(m.handle, id, int(ProjQuota)); err != nil {
+				report.Failed[id] = err
+			} else {
+				report.Removed = append(report.Removed, id)
+			}
+		}
+	}
+
+	report.Elapsed = time.Since(start)
+	if len(report.Failed) > 0 {
+		return report, fmt.Errorf("%d 个孤儿项目配额移除失败", len(report.Failed))
+	}
+	return report, nil
+}
+
+func hasLimits(info QuotaInfo) bool {
+	return info.BlockHardLimit != 0 || info.BlockSoftLimit != 0 || info.InodeHardLimit != 0 || info.InodeSoftLimit != 0
+}
+
+// scanProjectDirs 多线程读 root 下所有目录的 fsxattr，把出现过的项目 ID 加入 ids
+func scanProjectDirs(root string, workers int, ids map[uint32]struct{}) (uint64, error) {
+	cRoot := C.CString(root)
+	defer C.free(unsafe.Pointer(cRoot))
+
+	var list C.QuotaProjectRootList
+	var dirs C.uint64_t
+	ret := C.quota_scan_project_dirs(cRoot, C.int(workers), &list, &dirs)
+	if ret != 0 {
+		return 0, fmt.Errorf("扫描项目目录 %s 失败: %s", root, syscall.Errno(ret).Error())
+	}
+	defer C.quota_free_project_roots(&list)
+
+	for _, r := range unsafe.Slice(list.items, int(list.count)) {
+		ids[uint32(r.project_id)] = struct{}{}
+	}
+	return uint64(dirs), nil
+}
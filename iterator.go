@@ -0,0 +1,122 @@
+package quota
+
+// IteratorTokenEnd 表示枚举已经结束的续传令牌；小于它的令牌是下一个待查询的 ID
+const IteratorTokenEnd uint64 = 1 << 32
+
+// DefaultIteratorBatchSize 是 batchSize <= 0 时每批返回的最大记录数
+const DefaultIteratorBatchSize = 1024
+
+// QuotaIterator 按固定大小的批次流式枚举配额，内存占用与总记录数无关。
+// Token 可在任意两批之间保存，之后传给 IterateQuotas 从断点继续。
+type QuotaIterator interface {
+	Next() bool
+	Batch() []QuotaInfo
+	Token() uint64
+	Err() error
+	Close() error
+}
+
+// drainQuotas 反复调用 next，让 C 端把记录直接写进结果切片的空闲容量，
+// 直到 next 报告没有更多记录；不经过中间 C 数组，也没有逐条转换。
+func drainQuotas(next func(buf []QuotaInfo) (int, bool, error)) ([]QuotaInfo, error) {
+	infos := make([]QuotaInfo, 0, DefaultIteratorBatchSize)
+	for {
+		if len(infos) == cap(infos) {
+			infos = append(infos, QuotaInfo{})[:len(infos)]
+		}
+		n, more, err := next(infos[len(infos):cap(infos)])
+		infos = infos[:len(infos)+n]
+		if err != nil {
+			return nil, err
+		}
+		if !more {
+			return infos, nil
+		}
+	}
+}
+
+// fillQuotas 用于一次性解码的路径：fill 返回找到的总数，
+// 缓冲区不够时按总数重新分配并重试一次。
+func fillQuotas(fill func(buf []QuotaInfo) (int, bool, error)) ([]QuotaInfo, error) {
+	infos := make([]QuotaInfo, DefaultIteratorBatchSize)
+	for {
+		total, more, err := fill(infos)
+		if err != nil {
+			return nil, err
+		}
+		if !more {
+			return infos[:total], nil
+		}
+		infos = make([]QuotaInfo, total)
+	}
+}
+
+type batchIterator struct {
+	fetch   func(buf []QuotaInfo) (int, error)
+	token   func() uint64
+	end     func()
+	buf     []QuotaInfo
+	batch   []QuotaInfo
+	err     error
+	pending error
+	closed  bool
+}
+
+func newBatchIterator(batchSize int, fetch func(buf []QuotaInfo) (int, error), token func() uint64, end func()) *batchIterator {
+	return &batchIterator{
+		fetch: fetch,
+		token: token,
+		end:   end,
+		buf:   make([]QuotaInfo, batchSize),
+	}
+}
+
+func (it *batchIterator) Next() bool {
+	it.batch = nil
+	if it.closed || it.err != nil {
+		return false
+	}
+	// 上一批在出错前已取到部分记录时，先交付记录，再报告错误
+	if it.pending != nil {
+		it.err = it.pending
+		it.pending = nil
+		return false
+	}
+
+	for it.token() < IteratorTokenEnd {
+		n, err := it.fetch(it.buf)
+		if n > 0 {
+			it.batch = it.buf[:n]
+			it.pending = err
+			return true
+		}
+		if err != nil {
+			it.err = err
+			return false
+		}
+	}
+	return false
+}
+
+func (it *batchIterator) Batch() []QuotaInfo {
+	return it.batch
+}
+
+func (it *batchIterator) Token() uint64 {
+	if it.closed {
+		return IteratorTokenEnd
+	}
+	return it.token()
+}
+
+func (it *batchIterator) Err() error {
+	return it.err
+}
+
+func (it *batchIterator) Close() error {
+	if !it.closed {
+		it.closed = true
+		it.end()
+	}
+	return nil
+}
@@ -4,8 +4,9 @@ import (
 	"fmt"
 )
 
+// NewQuotaManager 按 path 所在挂载点的文件系统类型返回管理器；类型取自挂载点注册表
 func NewQuotaManager(path string) (QuotaManager, error) {
-	fstype, err := DetectFileSystem(path)
+	fstype, err := lookupFileSystem(path)
 	if err != nil {
 		return nil, err
 	}
@@ -0,0 +1,40 @@
+package quota
+
+/*
+#cgo LDFLAGS: ${SRCDIR}/pkg/common/quota_common.o -lpthread
+#include <stdlib.h>
+#include "pkg/common/quota_common.h"
+*/
+import "C"
+
+// QuotaCapabilities 是某个挂载点上某种配额类型的能力记录，
+// 由 quotactl 实际探测得到，并在挂载表变化前一直复用
+type QuotaCapabilities struct {
+	GetNextQuota  bool   // Q_GETNEXTQUOTA 可用
+	XGetNextQuota bool   // Q_XGETNEXTQUOTA 可用
+	QuotactlFd    bool   // 通过挂载点 fd 调用 quotactl_fd
+	Accounting    bool   // 记账已开启
+	Enforcement   bool   // 限额已强制执行
+	Format        uint32 // Q_GETFMT 返回的格式号，XFS 等不支持时为 0
+	BlockGrace    uint32 // 块软限额宽限期（秒）
+	InodeGrace    uint32 // inode 软限额宽限期（秒）
+	IncoreDquots  uint64 // 内存中的 dquot 数，用于预估列表大小
+}
+
+// InvalidateMountCache 清空进程级挂载缓存与管理器注册表，下次调用时重新解析 /proc/self/mountinfo
+func InvalidateMountCache() {
+	_ = C.quota_mount_cache_invalidate()
+	purgeMounts()
+}
+
+// mountGeneration 返回挂载缓存的代数；/proc/self/mountinfo 每次变化后递增
+func mountGeneration() uint64 {
+	return uint64(C.quota_mount_generation())
+}
+
+// GetCapabilities 返回 path 所在挂载点上 qtype 类型的能力记录；配额未开启时返回错误
+func GetCapabilities(path string, qtype QuotaType) (*QuotaCapabilities, error) {
+	return withMount(path, func(m *mountHandle) (*QuotaCapabilities, error) {
+		return m.capabilities(qtype)
+	})
+}
@@ -0,0 +1,1244 @@
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <pthread.h>
+#include <sched.h>
+#include <sys/types.h>
+#include <sys/quota.h>
+#include <linux/quota.h>
+#include <linux/dqblk_xfs.h>
+#include <sys/syscall.h>
+#include <sys/stat.h>
+#include <sys/sysmacros.h>
+#include <limits.h>
+#include "quota_common.h"
+
+// getdents64 的读缓冲，每个遍历线程一块
+#define WALK_DIRENT_BUF (64 * 1024)
+
+#ifndef SYS_quotactl_fd
+#define SYS_quotactl_fd 443
+#endif
+
+// 句柄在打开后只读，可以被多个线程同时使用
+struct quota_handle {
+    QuotaMountEntry mount;
+    int fd;
+};
+
+typedef struct {
+    QuotaMountEntry mount;
+    int fd;
+} MountCacheEntry;
+
+// 进程级挂载缓存：按 st_dev 索引，记录挂载点、挂载点 fd 和（仅旧内核需要的）设备路径。
+// 只有 /proc/self/mountinfo 发生变化（poll 返回 POLLPRI）时才整体失效。
+static pthread_mutex_t mount_cache_lock = PTHREAD_MUTEX_INITIALIZER;
+static MountCacheEntry *mount_cache = NULL;
+static size_t mount_cache_count = 0;
+static size_t mount_cache_capacity = 0;
+static int mountinfo_fd = -1;
+static uint64_t mount_cache_gen = 0;
+
+static pthread_once_t quotactl_fd_once = PTHREAD_ONCE_INIT;
+static int quotactl_fd_supported = 0;
+
+// quotactl_fd(2) 自 Linux 5.14 起可用；用无效 fd 探测，只有 EBADF 才说明内核真的处理了这个调用。
+// seccomp 拦截未知系统调用时会返回 EPERM（或 ENOSYS），此时应继续走设备路径
+static void probe_quotactl_fd(void) {
+    if (syscall(SYS_quotactl_fd, -1, 0, 0, NULL) < 0 && errno == EBADF) {
+        quotactl_fd_supported = 1;
+    }
+}
+
+int quota_has_quotactl_fd(void) {
+    pthread_once(&quotactl_fd_once, probe_quotactl_fd);
+    return __atomic_load_n(&quotactl_fd_supported, __ATOMIC_RELAXED);
+}
+
+// 调用时返回 ENOSYS/EPERM：重新探测，确认 quotactl_fd 已被拦截（探测之后才生效的 seccomp 策略）时
+// 本进程之后改走设备路径；探测仍得到 EBADF 说明是真实的错误（如非特权设置限额）
+static int quotactl_fd_blocked(int err) {
+    if (err != ENOSYS && err != EPERM) {
+        return 0;
+    }
+    if (syscall(SYS_quotactl_fd, -1, 0, 0, NULL) < 0 && errno == EBADF) {
+        return 0;
+    }
+    __atomic_store_n(&quotactl_fd_supported, 0, __ATOMIC_RELAXED);
+    return 1;
+}
+
+static int find_device_by_major_minor(unsigned int major, unsigned int minor,
+                                      char *device, size_t device_size) {
+    char uevent_path[PATH_MAX];
+    snprintf(uevent_path, PATH_MAX, "/sys/dev/block/%u:%u/uevent", major, minor);
+
+    FILE *fp = fopen(uevent_path, "r");
+    if (!fp) {
+        return -1;
+    }
+
+    char line[PATH_MAX];
+    char devname[PATH_MAX] = {0};
+
+    while (fgets(line, sizeof(line), fp)) {
+        if (strncmp(line, "DEVNAME=", 8) == 0) {
+            strncpy(devname, line + 8, PATH_MAX - 1);
+            size_t len = strlen(devname);
+            if (len > 0 && devname[len - 1] == '\n') {
+                devname[len - 1] = '\0';
+            }
+            break;
+        }
+    }
+    fclose(fp);
+
+    if (devname[0] == '\0') {
+        return -1;
+    }
+
+    const char *dev_paths[] = {
+        "/dev/mapper/%s",
+        "/dev/%s",
+        "/dev/block/%s",
+        "/dev/disk/by-uuid/%s",
+        "/dev/disk/by-label/%s",
+        "/tmp/quota_%s",
+        NULL
+    };
+
+    for (int i = 0; dev_paths[i] != NULL; i++) {
+        char test_path[PATH_MAX];
+        snprintf(test_path, PATH_MAX, dev_paths[i], devname);
+
+        if (access(test_path, F_OK) == 0) {
+            snprintf(device, device_size, "%s", test_path);
+            return 0;
+        }
+    }
+
+    char fake_device_path[PATH_MAX];
+    snprintf(fake_device_path, PATH_MAX, "/tmp/quota_%u_%u", major, minor);
+
+    if (access(fake_device_path, F_OK) == 0) {
+        snprintf(device, device_size, "%s", fake_device_path);
+        return 0;
+    }
+
+    if (mknod(fake_device_path, S_IFBLK | 0600, makedev(major, minor)) == 0) {
+        snprintf(device, device_size, "%s", fake_device_path);
+        return 0;
+    }
+
+    return -1;
+}
+
+static char *read_mountinfo(size_t *length) {
+    int fd = open("/proc/self/mountinfo", O_RDONLY | O_CLOEXEC);
+    if (fd < 0) {
+        return NULL;
+    }
+
+    size_t capacity = 64 * 1024;
+    size_t len = 0;
+    char *buf = (char *)malloc(capacity);
+    if (!buf) {
+        close(fd);
+        return NULL;
+    }
+
+    for (;;) {
+        if (len + 1 >= capacity) {
+            capacity *= 2;
+            char *new_buf = (char *)realloc(buf, capacity);
+            if (!new_buf) {
+                free(buf);
+                close(fd);
+                return NULL;
+            }
+            buf = new_buf;
+        }
+
+        ssize_t n = read(fd, buf + len, capacity - len - 1);
+        if (n < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            free(buf);
+            close(fd);
+            return NULL;
+        }
+        if (n == 0) {
+            break;
+        }
+        len += (size_t)n;
+    }
+
+    close(fd);
+    buf[len] = '\0';
+    *length = len;
+    return buf;
+}
+
+// 取出下一个以空格分隔的字段并原地截断，到行尾时返回 NULL
+static char *next_field(char **cursor, char *line_end) {
+    char *p = *cursor;
+    while (p < line_end && *p == ' ') {
+        p++;
+    }
+    if (p >= line_end) {
+        *cursor = line_end;
+        return NULL;
+    }
+
+    char *start = p;
+    while (p < line_end && *p != ' ') {
+        p++;
+    }
+    *p = '\0';
+    *cursor = p < line_end ? p + 1 : line_end;
+    return start;
+}
+
+// mountinfo 中的空格、制表符、换行和反斜杠以 \ooo 八进制形式转义
+static void unescape_field(char *s) {
+    char *out = s;
+    while (*s) {
+        if (s[0] == '\\' &&
+            s[1] >= '0' && s[1] <= '3' &&
+            s[2] >= '0' && s[2] <= '7' &&
+            s[3] >= '0' && s[3] <= '7') {
+            *out++ = (char)(((s[1] - '0') << 6) | ((s[2] - '0') << 3) | (s[3] - '0'));
+            s += 4;
+        } else {
+            *out++ = *s++;
+        }
+    }
+    *out = '\0';
+}
+
+static int parse_dev(const char *field, dev_t *dev) {
+    char *end;
+    unsigned long major = strtoul(field, &end, 10);
+    if (*end != ':') {
+        return -1;
+    }
+    unsigned long minor = strtoul(end + 1, &end, 10);
+    if (*end != '\0') {
+        return -1;
+    }
+    *dev = makedev(major, minor);
+    return 0;
+}
+
+static size_t mount_prefix_len(const char *path, const char *mount_point) {
+    size_t len = strlen(mount_point);
+    if (len == 1 && mount_point[0] == '/') {
+        return 1;
+    }
+    if (strncmp(path, mount_point, len) != 0) {
+        return 0;
+    }
+    if (path[len] != '\0' && path[len] != '/') {
+        return 0;
+    }
+    return len;
+}
+
+// 一次读入 mountinfo，按 major:minor 直接与目标 st_dev 比较，不再对候选挂载点做 stat。
+// 同一设备有多个挂载（bind mount）时，优先选择挂载了文件系统根目录的那一项，
+// 其次选择作为 path 前缀的最长挂载点，这样按 st_dev 缓存的结果与查询路径无关。
+static int find_mount_for_dev(const char *path, dev_t dev, QuotaMountEntry *entry) {
+    size_t len;
+    char *buf = read_mountinfo(&len);
+    if (!buf) {
+        return -1;
+    }
+
+    int found = 0;
+    size_t best_score = 0;
+    char *line = buf;
+    char *buf_end = buf + len;
+
+    while (line < buf_end) {
+        char *line_end = memchr(line, '\n', buf_end - line);
+        if (!line_end) {
+            line_end = buf_end;
+        }
+        *line_end = '\0';
+
+        char *cursor = line;
+        char *fields[6];
+        int nfields = 0;
+        while (nfields < 6 && (fields[nfields] = next_field(&cursor, line_end)) != NULL) {
+            nfields++;
+        }
+
+        dev_t line_dev;
+        if (nfields == 6 && parse_dev(fields[2], &line_dev) == 0 && line_dev == dev) {
+            char *fstype = NULL;
+            char *source = NULL;
+            char *field;
+            while ((field = next_field(&cursor, line_end)) != NULL) {
+                if (strcmp(field, "-") == 0) {
+                    fstype = next_field(&cursor, line_end);
+                    source = next_field(&cursor, line_end);
+                    break;
+                }
+            }
+
+            char *root = fields[3];
+            char *mount_point = fields[4];
+            unescape_field(root);
+            unescape_field(mount_point);
+
+            size_t score = mount_prefix_len(path, mount_point);
+            if (strcmp(root, "/") == 0) {
+                score += PATH_MAX;
+            }
+
+            if (!found || score > best_score) {
+                found = 1;
+                best_score = score;
+                snprintf(entry->mount_point, sizeof(entry->mount_point), "%s", mount_point);
+                snprintf(entry->fstype, sizeof(entry->fstype), "%s", fstype ? fstype : "");
+                if (source) {
+                    unescape_field(source);
+                }
+                snprintf(entry->source, sizeof(entry->source), "%s", source ? source : "");
+            }
+        }
+
+        line = line_end + 1;
+    }
+
+    free(buf);
+
+    if (!found) {
+        return -1;
+    }
+
+    entry->dev = dev;
+    return 0;
+}
+
+// 仅在没有 quotactl_fd 的旧内核上需要块设备路径：优先使用 mountinfo 中的挂载源，
+// 其 st_rdev 与挂载设备不一致时再退回 /sys/dev/block 探测。
+static int resolve_device(QuotaMountEntry *entry) {
+    struct stat st;
+    if (entry->source[0] == '/' && stat(entry->source, &st) == 0 &&
+        S_ISBLK(st.st_mode) && st.st_rdev == entry->dev) {
+        snprintf(entry->device, sizeof(entry->device), "%s", entry->source);
+        return 0;
+    }
+
+    return find_device_by_major_minor(major(entry->dev), minor(entry->dev),
+                                      entry->device, sizeof(entry->device));
+}
+
+static int open_mount_fd(const QuotaMountEntry *entry, const char *path) {
+    struct stat st;
+    int fd = open(entry->mount_point, O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+    if (fd >= 0 && fstat(fd, &st) == 0 && st.st_dev == entry->dev) {
+        return fd;
+    }
+    if (fd >= 0) {
+        close(fd);
+    }
+
+    fd = open(path, O_RDONLY | O_NONBLOCK | O_CLOEXEC);
+    if (fd >= 0 && fstat(fd, &st) == 0 && st.st_dev == entry->dev) {
+        return fd;
+    }
+    if (fd >= 0) {
+        close(fd);
+    }
+    return -1;
+}
+
+// 调用方需持有 mount_cache_lock
+static void mount_cache_clear_locked(void) {
+    for (size_t i = 0; i < mount_cache_count; i++) {
+        if (mount_cache[i].fd >= 0) {
+            close(mount_cache[i].fd);
+        }
+    }
+    mount_cache_count = 0;
+    mount_cache_gen++;
+}
+
+// 调用方需持有 mount_cache_lock
+static void mount_cache_check_locked(void) {
+    if (mountinfo_fd < 0) {
+        mountinfo_fd = open("/proc/self/mountinfo", O_RDONLY | O_CLOEXEC);
+        mount_cache_clear_locked();
+        return;
+    }
+
+    struct pollfd pfd;
+    pfd.fd = mountinfo_fd;
+    pfd.events = POLLPRI;
+    pfd.revents = 0;
+
+    if (poll(&pfd, 1, 0) > 0 && (pfd.revents & (POLLPRI | POLLERR))) {
+        mount_cache_clear_locked();
+    }
+}
+
+// 命中时复制条目；fd 非空时在锁内 dup 一份挂载点 fd 交给调用方
+static int mount_cache_find_locked(dev_t dev, QuotaMountEntry *entry, int *fd) {
+    for (size_t i = 0; i < mount_cache_count; i++) {
+        if (mount_cache[i].mount.dev == dev) {
+            *entry = mount_cache[i].mount;
+            if (fd) {
+                *fd = mount_cache[i].fd >= 0 ? fcntl(mount_cache[i].fd, F_DUPFD_CLOEXEC, 0) : -1;
+            }
+            return 0;
+        }
+    }
+    return -1;
+}
+
+// 插入成功后 fd 归缓存所有，返回 0；否则返回 -1，fd 仍归调用方
+static int mount_cache_insert_locked(const QuotaMountEntry *entry, int fd) {
+    for (size_t i = 0; i < mount_cache_count; i++) {
+        if (mount_cache[i].mount.dev == entry->dev) {
+            return -1;
+        }
+    }
+
+    if (mount_cache_count >= mount_cache_capacity) {
+        size_t capacity = mount_cache_capacity ? mount_cache_capacity * 2 : 16;
+        MountCacheEntry *items = (MountCacheEntry *)realloc(mount_cache, capacity * sizeof(MountCacheEntry));
+        if (!items) {
+            return -1;
+        }
+        mount_cache = items;
+        mount_cache_capacity = capacity;
+    }
+
+    mount_cache[mount_cache_count].mount = *entry;
+    mount_cache[mount_cache_count].fd = fd;
+    mount_cache_count++;
+    return 0;
+}
+
+static int mount_lookup(const char *path, QuotaMountEntry *entry, int *fd) {
+    struct stat st;
+    if (stat(path, &st) != 0) {
+        return errno;
+    }
+
+    pthread_mutex_lock(&mount_cache_lock);
+    mount_cache_check_locked();
+    uint64_t gen = mount_cache_gen;
+    int ret = mount_cache_find_locked(st.st_dev, entry, fd);
+    pthread_mutex_unlock(&mount_cache_lock);
+
+    if (ret == 0) {
+        return 0;
+    }
+
+    memset(entry, 0, sizeof(*entry));
+    if (find_mount_for_dev(path, st.st_dev, entry) != 0) {
+        return ENODEV;
+    }
+
+    int mount_fd = open_mount_fd(entry, path);
+    if (mount_fd < 0 || !quota_has_quotactl_fd()) {
+        if (resolve_device(entry) != 0) {
+            if (mount_fd >= 0) {
+                close(mount_fd);
+            }
+            return ENODEV;
+        }
+    }
+
+    pthread_mutex_lock(&mount_cache_lock);
+    mount_cache_check_locked();
+    if (gen == mount_cache_gen && mount_cache_insert_locked(entry, mount_fd) == 0) {
+        if (fd) {
+            *fd = mount_fd >= 0 ? fcntl(mount_fd, F_DUPFD_CLOEXEC, 0) : -1;
+        }
+        mount_fd = -1;
+    }
+    pthread_mutex_unlock(&mount_cache_lock);
+
+    if (mount_fd >= 0) {
+        if (fd) {
+            *fd = mount_fd;
+        } else {
+            close(mount_fd);
+        }
+    }
+
+    return 0;
+}
+
+int quota_mount_lookup(const char *path, QuotaMountEntry *entry) {
+    if (!path || !entry) {
+        return EINVAL;
+    }
+
+    return mount_lookup(path, entry, NULL);
+}
+
+uint64_t quota_mount_cache_invalidate(void) {
+    pthread_mutex_lock(&mount_cache_lock);
+    mount_cache_clear_locked();
+    uint64_t gen = mount_cache_gen;
+    pthread_mutex_unlock(&mount_cache_lock);
+    return gen;
+}
+
+uint64_t quota_mount_generation(void) {
+    pthread_mutex_lock(&mount_cache_lock);
+    mount_cache_check_locked();
+    uint64_t gen = mount_cache_gen;
+    pthread_mutex_unlock(&mount_cache_lock);
+    return gen;
+}
+
+int quota_handle_open(const char *path, quota_handle_t **handle) {
+    if (!path || !handle) {
+        return EINVAL;
+    }
+
+    quota_handle_t *h = (quota_handle_t *)calloc(1, sizeof(quota_handle_t));
+    if (!h) {
+        return ENOMEM;
+    }
+
+    h->fd = -1;
+    int ret = mount_lookup(path, &h->mount, &h->fd);
+    if (ret == 0 && h->fd < 0 && h->mount.device[0] == '\0' && resolve_device(&h->mount) != 0) {
+        ret = ENODEV;
+    }
+    if (ret != 0) {
+        free(h);
+        return ret;
+    }
+
+    *handle = h;
+    return 0;
+}
+
+int quota_handle_dup(const quota_handle_t *handle, quota_handle_t **dup) {
+    if (!handle || !dup) {
+        return EINVAL;
+    }
+
+    quota_handle_t *h = (quota_handle_t *)calloc(1, sizeof(quota_handle_t));
+    if (!h) {
+        return ENOMEM;
+    }
+
+    pthread_mutex_lock(&mount_cache_lock);
+    h->mount = handle->mount;
+    pthread_mutex_unlock(&mount_cache_lock);
+    h->fd = -1;
+    if (handle->fd >= 0) {
+        h->fd = fcntl(handle->fd, F_DUPFD_CLOEXEC, 0);
+        if (h->fd < 0) {
+            int err = errno;
+            free(h);
+            return err;
+        }
+    }
+
+    *dup = h;
+    return 0;
+}
+
+void quota_handle_close(quota_handle_t *handle) {
+    if (!handle) {
+        return;
+    }
+    if (handle->fd >= 0) {
+        close(handle->fd);
+    }
+    free(handle);
+}
+
+const char* quota_handle_device(const quota_handle_t *handle) {
+    return handle->mount.device;
+}
+
+const char* quota_handle_mount_point(const quota_handle_t *handle) {
+    return handle->mount.mount_point;
+}
+
+const char* quota_handle_fstype(const quota_handle_t *handle) {
+    return handle->mount.fstype;
+}
+
+dev_t quota_handle_dev(const quota_handle_t *handle) {
+    return handle->mount.dev;
+}
+
+// 句柄在新内核上不解析设备路径；退回设备路径的 quotactl 和直接读块设备的调用方按需解析，
+// 结果在挂载锁下记到句柄和挂载缓存上，之后的调用与新建的句柄直接复用
+int quota_handle_block_device(const quota_handle_t *handle, char *device, size_t size) {
+    if (!handle || !device) {
+        return EINVAL;
+    }
+
+    QuotaMountEntry entry;
+    pthread_mutex_lock(&mount_cache_lock);
+    entry = handle->mount;
+    pthread_mutex_unlock(&mount_cache_lock);
+    if (entry.device[0] != '\0') {
+        snprintf(device, size, "%s", entry.device);
+        return 0;
+    }
+
+    if (resolve_device(&entry) != 0) {
+        return ENODEV;
+    }
+
+    pthread_mutex_lock(&mount_cache_lock);
+    quota_handle_t *h = (quota_handle_t *)handle;
+    if (h->mount.device[0] == '\0') {
+        memcpy(h->mount.device, entry.device, sizeof(h->mount.device));
+    }
+    for (size_t i = 0; i < mount_cache_count; i++) {
+        if (mount_cache[i].mount.dev == entry.dev && mount_cache[i].mount.device[0] == '\0') {
+            memcpy(mount_cache[i].mount.device, entry.device, sizeof(entry.device));
+        }
+    }
+    pthread_mutex_unlock(&mount_cache_lock);
+
+    snprintf(device, size, "%s", entry.device);
+    return 0;
+}
+
+int quota_handle_fd(const quota_handle_t *handle) {
+    return handle->fd;
+}
+
+int quota_handle_quotactl(const quota_handle_t *handle, int cmd, int type, uint32_t id, void *addr) {
+    if (!handle) {
+        return EINVAL;
+    }
+
+    int fd_err = 0;
+    if (handle->fd >= 0 && quota_has_quotactl_fd()) {
+        if (syscall(SYS_quotactl_fd, handle->fd, QCMD(cmd, type), id, addr) == 0) {
+            return 0;
+        }
+        fd_err = errno;
+        if (!quotactl_fd_blocked(fd_err)) {
+            return fd_err;
+        }
+    }
+
+    char device[PATH_MAX];
+    if (quota_handle_block_device(handle, device, sizeof(device)) != 0) {
+        return fd_err ? fd_err : ENODEV;
+    }
+
+    if (quotactl(QCMD(cmd, type), device, id, (caddr_t)addr) < 0) {
+        return errno;
+    }
+
+    return 0;
+}
+
+// 按 (st_dev, 类型) 缓存的能力记录，挂载缓存代数变化后视为过期
+typedef struct {
+    dev_t dev;
+    int type;
+    uint64_t generation;
+    QuotaCaps caps;
+} CapsCacheEntry;
+
+static pthread_mutex_t caps_cache_lock = PTHREAD_MUTEX_INITIALIZER;
+static CapsCacheEntry caps_cache[64];
+static size_t caps_cache_count = 0;
+
+// 列表初始容量的上限，避免内存 dquot 数异常时一次分配过多
+#define CAPS_MAX_PRESIZE (1u << 22)
+
+static int supported(int ret) {
+    return ret == 0 || ret == ENOENT;
+}
+
+// 返回 0 表示探测结论可靠、可以缓存
+static int probe_caps(const quota_handle_t *handle, int type, QuotaCaps *caps) {
+    memset(caps, 0, sizeof(*caps));
+    caps->quotactl_fd = handle->fd >= 0 && quota_has_quotactl_fd();
+
+    struct fs_quota_statv statv;
+    memset(&statv, 0, sizeof(statv));
+    statv.qs_version = FS_QSTATV_VERSION1;
+    int ret = quota_handle_quotactl(handle, Q_XGETQSTATV, type, 0, &statv);
+    if (ret == 0) {
+        static const uint16_t acct[] = {FS_QUOTA_UDQ_ACCT, FS_QUOTA_GDQ_ACCT, FS_QUOTA_PDQ_ACCT};
+        static const uint16_t enfd[] = {FS_QUOTA_UDQ_ENFD, FS_QUOTA_GDQ_ENFD, FS_QUOTA_PDQ_ENFD};
+        caps->accounting = (statv.qs_flags & acct[type]) != 0;
+        caps->enforcement = (statv.qs_flags & enfd[type]) != 0;
+        caps->incore_dquots = statv.qs_incoredqs;
+        caps->block_grace = (uint32_t)statv.qs_btimelimit;
+        caps->inode_grace = (uint32_t)statv.qs_itimelimit;
+    }
+
+    struct if_dqinfo info;
+    memset(&info, 0, sizeof(info));
+    int info_ret = quota_handle_quotactl(handle, Q_GETINFO, type, 0, &info);
+    if (info_ret == 0 && ret != 0) {
+        // 没有 Q_XGETQSTATV 的内核上，Q_GETINFO 成功本身说明该类型的配额已开启
+        caps->accounting = 1;
+        caps->enforcement = 1;
+        caps->block_grace = (uint32_t)info.dqi_bgrace;
+        caps->inode_grace = (uint32_t)info.dqi_igrace;
+    } else if (info_ret != 0 && ret != 0) {
+        return info_ret == EINVAL || info_ret == ENOSYS ? ret : info_ret;
+    }
+
+    if (!caps->accounting) {
+        return ESRCH;
+    }
+
+    uint32_t format = 0;
+    if (quota_handle_quotactl(handle, Q_GETFMT, type, 0, &format) == 0) {
+        caps->format = format;
+    }
+
+    struct if_nextdqblk next;
+    memset(&next, 0, sizeof(next));
+    caps->getnextquota = supported(quota_handle_quotactl(handle, Q_GETNEXTQUOTA, type, 0, &next));
+
+    struct fs_disk_quota xnext;
+    memset(&xnext, 0, sizeof(xnext));
+    caps->xgetnextquota = supported(quota_handle_quotactl(handle, Q_XGETNEXTQUOTA, type, 0, &xnext));
+
+    return 0;
+}
+
+int quota_handle_caps(const quota_handle_t *handle, int type, QuotaCaps *caps) {
+    if (!handle || !caps || type < 0 || type > 2) {
+        return EINVAL;
+    }
+
+    uint64_t generation = quota_mount_generation();
+    dev_t dev = handle->mount.dev;
+
+    pthread_mutex_lock(&caps_cache_lock);
+    for (size_t i = 0; i < caps_cache_count; i++) {
+        if (caps_cache[i].dev == dev && caps_cache[i].type == type &&
+            caps_cache[i].generation == generation) {
+            *caps = caps_cache[i].caps;
+            pthread_mutex_unlock(&caps_cache_lock);
+            return 0;
+        }
+    }
+    pthread_mutex_unlock(&caps_cache_lock);
+
+    int ret = probe_caps(handle, type, caps);
+    if (ret != 0) {
+        return ret;
+    }
+
+    // 替换同一挂载点的过期记录；表满时丢弃最旧的一条
+    pthread_mutex_lock(&caps_cache_lock);
+    size_t slot = caps_cache_count;
+    for (size_t i = 0; i < caps_cache_count; i++) {
+        if ((caps_cache[i].dev == dev && caps_cache[i].type == type) ||
+            caps_cache[i].generation != generation) {
+            slot = i;
+            break;
+        }
+    }
+    if (slot == sizeof(caps_cache) / sizeof(caps_cache[0])) {
+        memmove(caps_cache, caps_cache + 1, (slot - 1) * sizeof(CapsCacheEntry));
+        slot--;
+    } else if (slot == caps_cache_count) {
+        caps_cache_count++;
+    }
+    caps_cache[slot].dev = dev;
+    caps_cache[slot].type = type;
+    caps_cache[slot].generation = generation;
+    caps_cache[slot].caps = *caps;
+    pthread_mutex_unlock(&caps_cache_lock);
+
+    return 0;
+}
+
+size_t quota_caps_capacity(const QuotaCaps *caps, size_t min_capacity) {
+    size_t capacity = caps ? (size_t)caps->incore_dquots : 0;
+    if (capacity > CAPS_MAX_PRESIZE) {
+        capacity = CAPS_MAX_PRESIZE;
+    }
+    return capacity > min_capacity ? capacity : min_capacity;
+}
+
+static int compare_id_slots(const void *a, const void *b) {
+    const QuotaIdSlot *x = (const QuotaIdSlot *)a;
+    const QuotaIdSlot *y = (const QuotaIdSlot *)b;
+    if (x->id != y->id) {
+        return x->id < y->id ? -1 : 1;
+    }
+    return x->index < y->index ? -1 : (x->index > y->index);
+}
+
+int quota_sort_ids(const uint32_t *ids, size_t count, QuotaIdSlot **slots) {
+    QuotaIdSlot *s = (QuotaIdSlot *)malloc((count ? count : 1) * sizeof(QuotaIdSlot));
+    if (!s) {
+        return ENOMEM;
+    }
+
+    for (size_t i = 0; i < count; i++) {
+        s[i].id = ids[i];
+        s[i].index = i;
+    }
+    qsort(s, count, sizeof(QuotaIdSlot), compare_id_slots);
+
+    *slots = s;
+    return 0;
+}
+
+// 并行任务按块领取，块越小负载越均衡，但原子操作越多；块大小不超过该值
+#define PARALLEL_CHUNK 64
+
+typedef struct {
+    size_t count;
+    size_t chunk;
+    size_t next;
+    quota_work_fn fn;
+    void *arg;
+} ParallelJob;
+
+typedef struct {
+    ParallelJob *job;
+    int worker;
+} ParallelWorker;
+
+static void *parallel_worker(void *arg) {
+    ParallelWorker *self = (ParallelWorker *)arg;
+    ParallelJob *job = self->job;
+
+    for (;;) {
+        size_t begin = __atomic_fetch_add(&job->next, job->chunk, __ATOMIC_RELAXED);
+        if (begin >= job->count) {
+            break;
+        }
+        size_t end = begin + job->chunk < job->count ? begin + job->chunk : job->count;
+        for (size_t i = begin; i < end; i++) {
+            job->fn(i, self->worker, job->arg);
+        }
+    }
+
+    return NULL;
+}
+
+void quota_run_parallel(size_t count, int workers, quota_work_fn fn, void *arg) {
+    if (workers < 1) {
+        workers = 1;
+    }
+    if (workers > QUOTA_MAX_WORKERS) {
+        workers = QUOTA_MAX_WORKERS;
+    }
+
+    // 每个线程大约领取 4 块，任务少时块随之变小，保证所有线程都有活干
+    size_t chunk = count / ((size_t)workers * 4);
+    if (chunk < 1) {
+        chunk = 1;
+    } else if (chunk > PARALLEL_CHUNK) {
+        chunk = PARALLEL_CHUNK;
+    }
+    if ((size_t)workers > (count + chunk - 1) / chunk) {
+        workers = (int)((count + chunk - 1) / chunk);
+    }
+
+    ParallelJob job = {count, chunk, 0, fn, arg};
+
+    // 调用线程自己也参与工作；线程创建失败时由已有线程分担剩余部分
+    pthread_t threads[QUOTA_MAX_WORKERS];
+    ParallelWorker selves[QUOTA_MAX_WORKERS];
+    int started = 0;
+    for (int i = 1; i < workers; i++) {
+        selves[i].job = &job;
+        selves[i].worker = i;
+        if (pthread_create(&threads[started], NULL, parallel_worker, &selves[i]) != 0) {
+            break;
+        }
+        started++;
+    }
+
+    selves[0].job = &job;
+    selves[0].worker = 0;
+    parallel_worker(&selves[0]);
+
+    for (int i = 0; i < started; i++) {
+        pthread_join(threads[i], NULL);
+    }
+}
+
+static size_t ino_slot(uint64_t ino, size_t capacity) {
+    ino *= 0x9E3779B97F4A7C15ULL;
+    return (size_t)(ino >> 17) & (capacity - 1);
+}
+
+static int ino_set_grow(QuotaInoSet *set) {
+    size_t capacity = set->capacity ? set->capacity * 2 : 1024;
+    uint64_t *slots = (uint64_t *)calloc(capacity, sizeof(uint64_t));
+    if (!slots) {
+        return ENOMEM;
+    }
+    for (size_t i = 0; i < set->capacity; i++) {
+        uint64_t ino = set->slots[i];
+        if (ino) {
+            size_t j = ino_slot(ino, capacity);
+            while (slots[j]) {
+                j = (j + 1) & (capacity - 1);
+            }
+            slots[j] = ino;
+        }
+    }
+    free(set->slots);
+    set->slots = slots;
+    set->capacity = capacity;
+    return 0;
+}
+
+int quota_ino_set_contains(const QuotaInoSet *set, uint64_t ino) {
+    if (!set->count) {
+        return 0;
+    }
+    for (size_t i = ino_slot(ino, set->capacity); set->slots[i]; i = (i + 1) & (set->capacity - 1)) {
+        if (set->slots[i] == ino) {
+            return 1;
+        }
+    }
+    return 0;
+}
+
+int quota_ino_set_insert(QuotaInoSet *set, uint64_t ino) {
+    if ((set->count + 1) * 2 > set->capacity && ino_set_grow(set) != 0) {
+        return ENOMEM;
+    }
+    size_t i = ino_slot(ino, set->capacity);
+    while (set->slots[i]) {
+        if (set->slots[i] == ino) {
+            return 0;
+        }
+        i = (i + 1) & (set->capacity - 1);
+    }
+    set->slots[i] = ino;
+    set->count++;
+    return 0;
+}
+
+// 线性探测的删除：把后续同簇元素前移，保持探测链连续
+void quota_ino_set_remove(QuotaInoSet *set, uint64_t ino) {
+    if (!set->count) {
+        return;
+    }
+    size_t mask = set->capacity - 1;
+    size_t i = ino_slot(ino, set->capacity);
+    while (set->slots[i] && set->slots[i] != ino) {
+        i = (i + 1) & mask;
+    }
+    if (!set->slots[i]) {
+        return;
+    }
+
+    set->slots[i] = 0;
+    set->count--;
+    for (size_t j = (i + 1) & mask; set->slots[j]; j = (j + 1) & mask) {
+        size_t home = ino_slot(set->slots[j], set->capacity);
+        // home 不在 (i, j] 循环区间内时，j 处元素可以前移到 i
+        if ((j > i && (home <= i || home > j)) || (j < i && home <= i && home > j)) {
+            set->slots[i] = set->slots[j];
+            set->slots[j] = 0;
+            i = j;
+        }
+    }
+}
+
+
+int quota_deque_push(QuotaDeque *dq, QuotaWorkItem item) {
+    pthread_mutex_lock(&dq->lock);
+    if (dq->count >= dq->capacity) {
+        size_t capacity = dq->capacity ? dq->capacity * 2 : 64;
+        QuotaWorkItem *items = (QuotaWorkItem *)malloc(capacity * sizeof(QuotaWorkItem));
+        if (!items) {
+            pthread_mutex_unlock(&dq->lock);
+            return ENOMEM;
+        }
+        for (size_t i = 0; i < dq->count; i++) {
+            items[i] = dq->items[(dq->head + i) % dq->capacity];
+        }
+        free(dq->items);
+        dq->items = items;
+        dq->head = 0;
+        dq->capacity = capacity;
+    }
+    dq->items[(dq->head + dq->count) % dq->capacity] = item;
+    dq->count++;
+    pthread_mutex_unlock(&dq->lock);
+    return 0;
+}
+
+int quota_deque_pop(QuotaDeque *dq, QuotaWorkItem *item) {
+    pthread_mutex_lock(&dq->lock);
+    int ok = dq->count > 0;
+    if (ok) {
+        dq->count--;
+        *item = dq->items[(dq->head + dq->count) % dq->capacity];
+    }
+    pthread_mutex_unlock(&dq->lock);
+    return ok;
+}
+
+int quota_deque_steal(QuotaDeque *dq, QuotaWorkItem *item) {
+    pthread_mutex_lock(&dq->lock);
+    int ok = dq->count > 0;
+    if (ok) {
+        *item = dq->items[dq->head];
+        dq->head = (dq->head + 1) % dq->capacity;
+        dq->count--;
+    }
+    pthread_mutex_unlock(&dq->lock);
+    return ok;
+}
+
+struct linux_dirent64 {
+    uint64_t d_ino;
+    int64_t d_off;
+    unsigned short d_reclen;
+    unsigned char d_type;
+    char d_name[];
+};
+
+int quota_walk_init(QuotaWalk *walk, const QuotaWalkOps *ops, void *arg, dev_t dev, int workers, void *args,
+                    size_t arg_size) {
+    if (workers < 1) {
+        workers = 1;
+    }
+    if (workers > QUOTA_MAX_WORKERS) {
+        workers = QUOTA_MAX_WORKERS;
+    }
+
+    memset(walk, 0, sizeof(*walk));
+    walk->ops = ops;
+    walk->arg = arg;
+    walk->dev = dev;
+    walk->walkers = (QuotaWalker *)calloc((size_t)workers, sizeof(QuotaWalker));
+    if (!walk->walkers) {
+        return ENOMEM;
+    }
+    walk->workers = workers;
+    for (int i = 0; i < workers; i++) {
+        pthread_mutex_init(&walk->deques[i].lock, NULL);
+        walk->walkers[i].walk = walk;
+        walk->walkers[i].worker = i;
+        walk->walkers[i].arg = (char *)args + (size_t)i * arg_size;
+        walk->walkers[i].buf = (char *)malloc(WALK_DIRENT_BUF);
+        if (!walk->walkers[i].buf) {
+            quota_walk_destroy(walk);
+            return ENOMEM;
+        }
+    }
+    return 0;
+}
+
+void quota_walk_destroy(QuotaWalk *walk) {
+    for (int i = 0; i < walk->workers; i++) {
+        free(walk->walkers[i].buf);
+        free(walk->deques[i].items);
+        pthread_mutex_destroy(&walk->deques[i].lock);
+    }
+    free(walk->walkers);
+    walk->walkers = NULL;
+    walk->workers = 0;
+}
+
+int quota_walk_stopped(QuotaWalk *walk) {
+    return __atomic_load_n(&walk->error, __ATOMIC_RELAXED) != 0;
+}
+
+void quota_walk_fail(QuotaWalker *w, int err) {
+    int expected = 0;
+    __atomic_compare_exchange_n(&w->walk->error, &expected, err, 0, __ATOMIC_RELAXED, __ATOMIC_RELAXED);
+    if (w->walk->ops->failed) {
+        w->walk->ops->failed(w);
+    }
+}
+
+static void walk_skip(QuotaWalker *w) {
+    if (w->walk->ops->skipped) {
+        w->walk->ops->skipped(w);
+    }
+}
+
+static void walk_dir_release(QuotaWalk *walk, QuotaWalkDir *dir) {
+    while (dir && __atomic_sub_fetch(&dir->refs, 1, __ATOMIC_ACQ_REL) == 0) {
+        QuotaWalkDir *parent = dir->parent;
+        if (walk->ops->release) {
+            walk->ops->release(walk, dir);
+        }
+        close(dir->fd);
+        free(dir);
+        dir = parent;
+    }
+}
+
+QuotaWalkDir *quota_walk_root(QuotaWalk *walk, int fd) {
+    QuotaWalkDir *dir = (QuotaWalkDir *)calloc(1, walk->ops->dir_size);
+    if (dir) {
+        dir->fd = fd;
+        dir->refs = 1;
+    }
+    return dir;
+}
+
+int quota_walk_enqueue(QuotaWalker *w, QuotaWalkDir *dir, const char *name) {
+    QuotaWorkItem item;
+    item.parent = dir;
+    item.name = strdup(name);
+    if (!item.name) {
+        return ENOMEM;
+    }
+
+    __atomic_add_fetch(&dir->refs, 1, __ATOMIC_RELAXED);
+    __atomic_add_fetch(&w->walk->pending, 1, __ATOMIC_RELEASE);
+    int ret = quota_deque_push(&w->walk->deques[w->worker], item);
+    if (ret != 0) {
+        __atomic_sub_fetch(&w->walk->pending, 1, __ATOMIC_RELEASE);
+        walk_dir_release(w->walk, dir);
+        free(item.name);
+    }
+    return ret;
+}
+
+int quota_walk_readdir(QuotaWalker *w, QuotaWalkDir *dir, quota_walk_entry_fn fn) {
+    for (;;) {
+        long n = syscall(SYS_getdents64, dir->fd, w->buf, WALK_DIRENT_BUF);
+        if (n < 0) {
+            int err = errno;
+            quota_walk_fail(w, err);
+            return err;
+        }
+        if (n == 0) {
+            return 0;
+        }
+
+        for (long off = 0; off < n;) {
+            struct linux_dirent64 *d = (struct linux_dirent64 *)(w->buf + off);
+            off += d->d_reclen;
+
+            const char *name = d->d_name;
+            if (name[0] == '.' && (name[1] == '\0' || (name[1] == '.' && name[2] == '\0'))) {
+                continue;
+            }
+            if (quota_walk_stopped(w->walk) || fn(w, dir, name, d->d_type, d->d_ino) != 0) {
+                return 1;
+            }
+        }
+    }
+}
+
+// 打开排队的子目录并访问；遍历期间消失或被替换成符号链接的目录、其他文件系统上的目录都跳过
+static void walk_process(QuotaWalker *w, QuotaWorkItem *item) {
+    QuotaWalk *walk = w->walk;
+    const QuotaWalkOps *ops = walk->ops;
+    QuotaWalkDir *parent = (QuotaWalkDir *)item->parent;
+
+    if (!quota_walk_stopped(walk)) {
+        int fd = openat(parent->fd, item->name, O_RDONLY | O_DIRECTORY | O_NOFOLLOW | O_CLOEXEC);
+        struct statx stx;
+        QuotaWalkDir *dir = NULL;
+        int ret;
+        if (fd < 0) {
+            if (errno == ENOENT || errno == ELOOP || errno == ENOTDIR) {
+                walk_skip(w);
+            } else {
+                quota_walk_fail(w, errno);
+            }
+        } else if (statx(fd, "", AT_EMPTY_PATH, ops->statx_mask, &stx) != 0) {
+            quota_walk_fail(w, errno);
+            close(fd);
+        } else if (makedev(stx.stx_dev_major, stx.stx_dev_minor) != walk->dev) {
+            walk_skip(w);
+            close(fd);
+        } else if (!(dir = (QuotaWalkDir *)calloc(1, ops->dir_size))) {
+            quota_walk_fail(w, ENOMEM);
+            close(fd);
+        } else {
+            dir->fd = fd;
+            dir->parent = parent;
+            if (ops->enter && (ret = ops->enter(w, dir, item->name, &stx)) != 0) {
+                quota_walk_fail(w, ret);
+                close(fd);
+                free(dir);
+            } else {
+                dir->refs = 1;
+                __atomic_add_fetch(&parent->refs, 1, __ATOMIC_RELAXED);
+                ops->visit(w, dir, &stx);
+                walk_dir_release(walk, dir);
+            }
+        }
+    }
+
+    walk_dir_release(walk, parent);
+    free(item->name);
+    __atomic_sub_fetch(&walk->pending, 1, __ATOMIC_RELEASE);
+}
+
+static int walk_next(QuotaWalker *w, QuotaWorkItem *item) {
+    QuotaWalk *walk = w->walk;
+
+    for (;;) {
+        if (quota_deque_pop(&walk->deques[w->worker], item)) {
+            return 1;
+        }
+        for (int i = 1; i < walk->workers; i++) {
+            if (quota_deque_steal(&walk->deques[(w->worker + i) % walk->workers], item)) {
+                return 1;
+            }
+        }
+        if (__atomic_load_n(&walk->pending, __ATOMIC_ACQUIRE) == 0) {
+            return 0;
+        }
+        // 还有目录在别的线程手里展开，稍后可能产生新任务
+        sched_yield();
+    }
+}
+
+static void *walk_worker(void *arg) {
+    QuotaWalker *w = (QuotaWalker *)arg;
+    QuotaWorkItem item;
+    while (walk_next(w, &item)) {
+        walk_process(w, &item);
+    }
+    if (w->walk->ops->finish) {
+        w->walk->ops->finish(w);
+    }
+    return NULL;
+}
+
+int quota_walk_run(QuotaWalk *walk, QuotaWalkDir *root, const struct statx *stx) {
+    walk->ops->visit(&walk->walkers[0], root, stx);
+    walk_dir_release(walk, root);
+
+    pthread_t threads[QUOTA_MAX_WORKERS];
+    int started = 0;
+    for (int i = 1; i < walk->workers && __atomic_load_n(&walk->pending, __ATOMIC_ACQUIRE) > 0; i++) {
+        if (pthread_create(&threads[started], NULL, walk_worker, &walk->walkers[i]) != 0) {
+            break;
+        }
+        started++;
+    }
+    walk_worker(&walk->walkers[0]);
+    for (int i = 0; i < started; i++) {
+        pthread_join(threads[i], NULL);
+    }
+    return walk->error;
+}
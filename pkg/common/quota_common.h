@@ -0,0 +1,297 @@
+#ifndef QUOTA_COMMON_H
+#define QUOTA_COMMON_H
+
+#include <stdint.h>
+#include <limits.h>
+#include <pthread.h>
+#include <sys/types.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+typedef struct {
+    dev_t dev;
+    char mount_point[PATH_MAX];
+    char source[PATH_MAX];
+    char device[PATH_MAX];
+    char fstype[64];
+} QuotaMountEntry;
+
+// XFS 与 ext4 共用的配额记录，Go 端 QuotaInfo 与之逐字节对应。
+// 块限额与用量统一为 1 KiB 单位；固定 64 字节，正好占一条缓存行。
+typedef struct quota_record {
+    uint32_t id;
+    uint32_t qtype;
+    uint64_t bhardlimit;
+    uint64_t bsoftlimit;
+    uint64_t curblocks;
+    uint64_t ihardlimit;
+    uint64_t isoftlimit;
+    uint64_t curinodes;
+    uint32_t btime;
+    uint32_t itime;
+} QuotaRecord;
+
+_Static_assert(sizeof(QuotaRecord) == 64, "QuotaRecord must be 64 bytes");
+
+typedef struct {
+    QuotaRecord *items;
+    size_t count;
+    size_t capacity;
+} QuotaRecordList;
+
+// 某个挂载点上某种配额类型的能力记录：全部经实际 quotactl 探测得到，
+// 缓存到挂载表变化为止。配额记账未开启时探测结果不确定，不会被缓存。
+typedef struct {
+    int getnextquota;
+    int xgetnextquota;
+    int quotactl_fd;
+    int accounting;
+    int enforcement;
+    uint32_t format;
+    uint32_t block_grace;
+    uint32_t inode_grace;
+    uint64_t incore_dquots;
+} QuotaCaps;
+
+// 批量设置配额的一条输入，Go 端 QuotaLimit 与之逐字节对应；块限额单位为 1 KiB
+typedef struct quota_limit {
+    uint32_t id;
+    uint32_t qtype;
+    uint64_t bhardlimit;
+    uint64_t bsoftlimit;
+    uint64_t ihardlimit;
+    uint64_t isoftlimit;
+} QuotaLimit;
+
+// 列表游标的续传令牌：下一个待查询的 ID；超出 32 位表示枚举已结束
+#define QUOTA_CURSOR_END ((uint64_t)UINT32_MAX + 1)
+
+typedef struct quota_handle quota_handle_t;
+
+int quota_mount_lookup(const char *path, QuotaMountEntry *entry);
+
+uint64_t quota_mount_cache_invalidate(void);
+
+uint64_t quota_mount_generation(void);
+
+int quota_handle_open(const char *path, quota_handle_t **handle);
+
+// 复制句柄（挂载信息 + 独立的挂载点 fd），供并行的工作线程各自持有
+int quota_handle_dup(const quota_handle_t *handle, quota_handle_t **dup);
+
+void quota_handle_close(quota_handle_t *handle);
+
+const char* quota_handle_device(const quota_handle_t *handle);
+
+const char* quota_handle_mount_point(const quota_handle_t *handle);
+
+const char* quota_handle_fstype(const quota_handle_t *handle);
+
+dev_t quota_handle_dev(const quota_handle_t *handle);
+
+int quota_handle_block_device(const quota_handle_t *handle, char *device, size_t size);
+
+int quota_handle_fd(const quota_handle_t *handle);
+
+int quota_has_quotactl_fd(void);
+
+int quota_handle_quotactl(const quota_handle_t *handle, int cmd, int type, uint32_t id, void *addr);
+
+int quota_handle_caps(const quota_handle_t *handle, int type, QuotaCaps *caps);
+
+// 按能力记录中的内存 dquot 数给列表选初始容量，至少 min_capacity
+size_t quota_caps_capacity(const QuotaCaps *caps, size_t min_capacity);
+
+typedef struct {
+    uint32_t id;
+    size_t index;
+} QuotaIdSlot;
+
+// 按 ID 排序并记录每个 ID 在输入中的下标，结果由调用方 free
+int quota_sort_ids(const uint32_t *ids, size_t count, QuotaIdSlot **slots);
+
+// 批量查询时相邻待查 ID 的间距不超过该值才用 GETNEXTQUOTA 连续推进，否则逐个点查
+#define QUOTA_DENSE_GAP 16
+
+#define QUOTA_MAX_WORKERS 64
+
+typedef void (*quota_work_fn)(size_t index, int worker, void *arg);
+
+// 对 [0, count) 的每个下标调用 fn，最多使用 workers 个线程（含调用线程）；
+// worker 为执行该下标的线程序号，取值 [0, workers)
+void quota_run_parallel(size_t count, int workers, quota_work_fn fn, void *arg);
+
+// inode 号的开放寻址哈希集合，0 表示空槽（有效 inode 号不为 0）；不加锁
+typedef struct {
+    uint64_t *slots;
+    size_t capacity;
+    size_t count;
+} QuotaInoSet;
+
+int quota_ino_set_contains(const QuotaInoSet *set, uint64_t ino);
+
+// 已存在时也返回 0；只有扩容失败时返回 ENOMEM
+int quota_ino_set_insert(QuotaInoSet *set, uint64_t ino);
+
+void quota_ino_set_remove(QuotaInoSet *set, uint64_t ino);
+
+// 目录遍历中待处理的子目录：parent 为所在目录的 QuotaWalkDir，name 相对其 fd
+typedef struct {
+    void *parent;
+    char *name;
+} QuotaWorkItem;
+
+// 每个线程一个双端队列：自己从尾部压入/弹出（深度优先，局部性好），空闲线程从头部窃取
+typedef struct {
+    pthread_mutex_t lock;
+    QuotaWorkItem *items;
+    size_t head;
+    size_t count;
+    size_t capacity;
+} QuotaDeque;
+
+int quota_deque_push(QuotaDeque *dq, QuotaWorkItem item);
+
+int quota_deque_pop(QuotaDeque *dq, QuotaWorkItem *item);
+
+int quota_deque_steal(QuotaDeque *dq, QuotaWorkItem *item);
+
+// 遍历中已打开的目录，调用方的目录记录以它为第一个成员。
+// 排队中的子目录各持有父目录一个引用，所以同时打开的 fd 数只与正在展开的目录数有关；
+// 引用归零即整棵子树处理完毕
+typedef struct QuotaWalkDir {
+    int fd;
+    int refs;
+    struct QuotaWalkDir *parent;
+} QuotaWalkDir;
+
+typedef struct QuotaWalk QuotaWalk;
+
+struct statx;
+
+// 一个遍历线程；arg 指向调用方该线程的私有状态
+typedef struct {
+    QuotaWalk *walk;
+    int worker;
+    char *buf;
+    void *arg;
+} QuotaWalker;
+
+// 遍历的各个回调，除 visit 外都可以为 NULL
+typedef struct {
+    size_t dir_size;     // 调用方目录记录的大小
+    unsigned statx_mask; // 打开子目录后 statx 取的字段
+    // 子目录已打开、确认在同一文件系统上：初始化调用方的字段；出错时自行清理并返回 errno
+    int (*enter)(QuotaWalker *w, QuotaWalkDir *dir, const char *name, const struct statx *stx);
+    // 处理目录本身，通常再用 quota_walk_readdir 读出目录项、子目录用 quota_walk_enqueue 入队
+    void (*visit)(QuotaWalker *w, QuotaWalkDir *dir, const struct statx *stx);
+    // 目录的整棵子树处理完毕，关闭 fd、释放记录之前调用
+    void (*release)(QuotaWalk *walk, QuotaWalkDir *dir);
+    void (*skipped)(QuotaWalker *w); // 遍历中消失的目录、其他文件系统上的目录
+    void (*failed)(QuotaWalker *w);  // quota_walk_fail 记下一个错误
+    void (*finish)(QuotaWalker *w);  // 线程退出前
+} QuotaWalkOps;
+
+struct QuotaWalk {
+    const QuotaWalkOps *ops;
+    void *arg;
+    dev_t dev;
+    int workers;
+    QuotaWalker *walkers;
+    QuotaDeque deques[QUOTA_MAX_WORKERS];
+    // 已入队但尚未处理完的目录数，归零即遍历结束
+    long pending;
+    int error;
+};
+
+// 准备 workers 个线程的遍历，第 i 个线程的 arg 为 args + i * arg_size；
+// 不跨越 dev 以外的文件系统。成功后须调用 quota_walk_destroy
+int quota_walk_init(QuotaWalk *walk, const QuotaWalkOps *ops, void *arg, dev_t dev, int workers, void *args,
+                    size_t arg_size);
+
+// 为起点目录分配记录（接管 fd），调用方填好自己的字段后交给 quota_walk_run
+QuotaWalkDir *quota_walk_root(QuotaWalk *walk, int fd);
+
+// 调用线程先访问起点，子目录分散到各线程后再启动其余线程；返回第一个错误的 errno
+int quota_walk_run(QuotaWalk *walk, QuotaWalkDir *root, const struct statx *stx);
+
+void quota_walk_destroy(QuotaWalk *walk);
+
+int quota_walk_stopped(QuotaWalk *walk);
+
+// 记下第一个错误并停止遍历
+void quota_walk_fail(QuotaWalker *w, int err);
+
+// 把 dir 下的 name 排入当前线程的队列
+int quota_walk_enqueue(QuotaWalker *w, QuotaWalkDir *dir, const char *name);
+
+// 对 dir 的每个目录项（不含 . 与 ..）调用 fn，type 为 d_type，fn 返回非 0 时停止；
+// 读完返回 0，读取出错、fn 要求停止或遍历已停止时返回非 0
+typedef int (*quota_walk_entry_fn)(QuotaWalker *w, QuotaWalkDir *dir, const char *name, unsigned char type,
+                                   uint64_t ino);
+
+int quota_walk_readdir(QuotaWalker *w, QuotaWalkDir *dir, quota_walk_entry_fn fn);
+
+// 递归设置项目 ID 的进度计数；walker 运行期间由各线程原子累加，调用方可随时原子读取
+typedef struct {
+    uint64_t dirs;      // 已处理的目录（含无需改写的）
+    uint64_t files;     // 已处理的普通文件（含无需改写的）
+    uint64_t unchanged; // 其中 projid 与 PROJINHERIT 已经正确、没有写入的项
+    uint64_t resumed;   // 按检查点跳过的已完成子树
+    uint64_t skipped;   // 跳过的符号链接、设备/管道/套接字、其他文件系统上的目录、遍历中消失的项
+    uint64_t errors;    // 设置失败的项；遇到第一个错误后停止遍历
+} QuotaTagStats;
+
+// 用 openat/getdents64 以目录 fd 为基准遍历 path，对每个目录和普通文件设置 project_id，
+// 目录同时带上 PROJINHERIT；已经正确的项只读不写。不跟随符号链接，不跨越挂载点。
+// workers 个线程（含调用线程）通过工作窃取分担子目录。
+// checkpoint 非空时把已完成子树的根目录 inode 定期写入该文件，下次以同样参数运行时跳过这些子树；
+// 全部完成后删除该文件。返回第一个错误的 errno。
+int quota_tag_project(const char *path, uint32_t project_id, int workers, const char *checkpoint,
+                      QuotaTagStats *stats);
+
+// 配额未开启记账时用 statx 遍历统计用量的进度计数；运行期间由各线程原子累加
+typedef struct {
+    uint64_t dirs;      // 已统计的目录
+    uint64_t files;     // 已统计的非目录项（含按缓存复用的）
+    uint64_t cached;    // 自上次扫描以来没有变化、直接复用缓存而没有重新读取的目录
+    uint64_t hardlinks; // 硬链接去重时没有重复计入的项
+    uint64_t skipped;   // 其他文件系统上的项、遍历中消失的项
+    uint64_t errors;    // 统计失败的项；遇到第一个错误后停止遍历
+} QuotaUsageStats;
+
+// 遍历 path，按 type 对应的属主（uid/gid/projid）汇总 inode 数与占用空间，结果按 ID 升序写入 list：
+// curinodes 为 inode 数，curblocks 为占用空间（1 KiB），限额字段为 0；list->items 由调用方 free。
+// 有多个硬链接的文件只计一次；不跟随符号链接，不跨越挂载点。
+// cache 非空时把每个目录的 mtime/ctime 和直接统计写入该文件，下次扫描时目录没有变化就直接复用。
+int quota_scan_usage(const char *path, int type, int workers, const char *cache, QuotaRecordList *list,
+                     QuotaUsageStats *stats);
+
+// 项目的一个根目录：带 PROJINHERIT、且项目 ID 不是从父目录继承下来的目录
+typedef struct {
+    uint32_t project_id;
+    char *path;
+} QuotaProjectRoot;
+
+typedef struct {
+    QuotaProjectRoot *items;
+    size_t count;
+} QuotaProjectRootList;
+
+// 多线程只遍历 path 下的目录（不跟随符号链接，不跨越挂载点），找出所有非 0 项目的根目录，
+// 路径以 path 为前缀。dirs 非空时写入扫描的目录数。list 用 quota_free_project_roots 释放。
+int quota_scan_project_roots(const char *path, int workers, QuotaProjectRootList *list, uint64_t *dirs);
+
+// 同 quota_scan_project_roots，但不要求 PROJINHERIT：报告项目 ID 非 0 且与父目录不同的每个目录。
+// 带某个项目 ID 的目录存在时，该 ID 至少出现一次。
+int quota_scan_project_dirs(const char *path, int workers, QuotaProjectRootList *list, uint64_t *dirs);
+
+void quota_free_project_roots(QuotaProjectRootList *list);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
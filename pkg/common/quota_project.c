@@ -0,0 +1,467 @@
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <dirent.h>
+#include <pthread.h>
+#include <time.h>
+#include <sys/ioctl.h>
+#include <sys/stat.h>
+#include <sys/sysmacros.h>
+#include <linux/fs.h>
+#include "quota_common.h"
+
+// 线程本地计数累积到这个数后才合并到共享统计，避免多线程争抢同一缓存行
+#define TAG_FLUSH_EVERY 256
+
+// 检查点至少间隔这么久才重写一次
+#define TAG_CHECKPOINT_INTERVAL_NS (2LL * 1000 * 1000 * 1000)
+
+#define TAG_CHECKPOINT_MAGIC "QTCK"
+#define TAG_CHECKPOINT_VERSION 1
+
+// 已打开的目录
+typedef struct {
+    QuotaWalkDir base;
+    uint64_t ino;
+    // 已完成的直接子目录 inode，本目录完成时从检查点集合中移除，由本目录的 inode 代替
+    uint64_t *done;
+    size_t done_count;
+    size_t done_capacity;
+} TagDir;
+
+// 检查点文件头，后跟 count 个 uint64_t inode 号
+typedef struct {
+    char magic[4];
+    uint32_t version;
+    uint32_t project_id;
+    uint32_t reserved;
+    uint64_t dev;
+    uint64_t root_ino;
+    uint64_t count;
+} TagCheckpointHeader;
+
+// 检查点记录的是“已完成子树的根”的最小集合：子目录完成时加入，
+// 父目录完成时用父目录替换掉它的全部子目录，因此集合大小只与当前遍历前沿有关。
+typedef struct {
+    int enabled;
+    const char *path;
+    char *tmp_path;
+    pthread_mutex_t lock;
+    QuotaInoSet set;
+    TagCheckpointHeader header;
+    long long last_save;
+} TagCheckpoint;
+
+typedef struct {
+    uint32_t project_id;
+    TagCheckpoint ckpt;
+    QuotaTagStats *stats;
+} TagWalk;
+
+typedef struct {
+    QuotaTagStats local;
+    unsigned unflushed;
+} TagWorker;
+
+static long long monotonic_ns(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (long long)ts.tv_sec * 1000000000LL + ts.tv_nsec;
+}
+
+// 写临时文件、fsync 后 rename，崩溃时总有一份完整的检查点
+static int ckpt_save_locked(TagCheckpoint *ckpt) {
+    int fd = open(ckpt->tmp_path, O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0600);
+    if (fd < 0) {
+        return errno;
+    }
+
+    TagCheckpointHeader header = ckpt->header;
+    header.count = ckpt->set.count;
+
+    FILE *fp = fdopen(fd, "w");
+    if (!fp) {
+        int err = errno;
+        close(fd);
+        unlink(ckpt->tmp_path);
+        return err;
+    }
+
+    int ok = fwrite(&header, sizeof(header), 1, fp) == 1;
+    for (size_t i = 0; ok && i < ckpt->set.capacity; i++) {
+        if (ckpt->set.slots[i]) {
+            ok = fwrite(&ckpt->set.slots[i], sizeof(uint64_t), 1, fp) == 1;
+        }
+    }
+    ok = ok && fflush(fp) == 0 && fsync(fd) == 0;
+    int err = ok ? 0 : (errno ? errno : EIO);
+    if (fclose(fp) != 0 && ok) {
+        ok = 0;
+        err = errno;
+    }
+
+    if (ok && rename(ckpt->tmp_path, ckpt->path) != 0) {
+        ok = 0;
+        err = errno;
+    }
+    if (!ok) {
+        unlink(ckpt->tmp_path);
+        return err;
+    }
+
+    ckpt->last_save = monotonic_ns();
+    return 0;
+}
+
+// 读取与本次运行匹配（同一设备、根目录与项目 ID）的检查点；不存在或不匹配时从头开始
+static void ckpt_load(TagCheckpoint *ckpt) {
+    FILE *fp = fopen(ckpt->path, "re");
+    if (!fp) {
+        return;
+    }
+
+    TagCheckpointHeader header;
+    if (fread(&header, sizeof(header), 1, fp) == 1 &&
+        memcmp(header.magic, ckpt->header.magic, sizeof(header.magic)) == 0 &&
+        header.version == ckpt->header.version &&
+        header.project_id == ckpt->header.project_id &&
+        header.dev == ckpt->header.dev &&
+        header.root_ino == ckpt->header.root_ino) {
+        uint64_t ino;
+        for (uint64_t i = 0; i < header.count && fread(&ino, sizeof(ino), 1, fp) == 1; i++) {
+            if (ino && quota_ino_set_insert(&ckpt->set, ino) != 0) {
+                break;
+            }
+        }
+    }
+    fclose(fp);
+}
+
+// 目录的整棵子树已完成：用它替换掉它的子目录记录，并挂到父目录的完成列表上
+static void ckpt_complete(TagWalk *walk, TagDir *dir) {
+    TagCheckpoint *ckpt = &walk->ckpt;
+
+    pthread_mutex_lock(&ckpt->lock);
+    for (size_t i = 0; i < dir->done_count; i++) {
+        quota_ino_set_remove(&ckpt->set, dir->done[i]);
+    }
+
+    TagDir *parent = (TagDir *)dir->base.parent;
+    if (parent && quota_ino_set_insert(&ckpt->set, dir->ino) == 0) {
+        if (parent->done_count >= parent->done_capacity) {
+            size_t capacity = parent->done_capacity ? parent->done_capacity * 2 : 16;
+            uint64_t *done = (uint64_t *)realloc(parent->done, capacity * sizeof(uint64_t));
+            if (done) {
+                parent->done = done;
+                parent->done_capacity = capacity;
+            }
+        }
+        // 挂不上时该记录只是在父目录完成后变得多余，不影响正确性
+        if (parent->done_count < parent->done_capacity) {
+            parent->done[parent->done_count++] = dir->ino;
+        }
+    }
+
+    if (parent && monotonic_ns() - ckpt->last_save >= TAG_CHECKPOINT_INTERVAL_NS) {
+        ckpt_save_locked(ckpt);
+    }
+    pthread_mutex_unlock(&ckpt->lock);
+}
+
+// 子目录在上次运行中已经完成：记到当前目录的完成列表上，返回 1 表示跳过
+static int ckpt_resume(TagWalk *walk, TagDir *dir, uint64_t ino) {
+    TagCheckpoint *ckpt = &walk->ckpt;
+
+    pthread_mutex_lock(&ckpt->lock);
+    int found = quota_ino_set_contains(&ckpt->set, ino);
+    if (found) {
+        if (dir->done_count >= dir->done_capacity) {
+            size_t capacity = dir->done_capacity ? dir->done_capacity * 2 : 16;
+            uint64_t *done = (uint64_t *)realloc(dir->done, capacity * sizeof(uint64_t));
+            if (done) {
+                dir->done = done;
+                dir->done_capacity = capacity;
+            }
+        }
+        if (dir->done_count < dir->done_capacity) {
+            dir->done[dir->done_count++] = ino;
+        }
+    }
+    pthread_mutex_unlock(&ckpt->lock);
+    return found;
+}
+
+// 整棵子树已处理完；出错停止后不再记入检查点，因为子树可能被中途放弃
+static void tag_dir_release(QuotaWalk *walk, QuotaWalkDir *base) {
+    TagWalk *tag = (TagWalk *)walk->arg;
+    TagDir *dir = (TagDir *)base;
+    if (tag->ckpt.enabled && !quota_walk_stopped(walk)) {
+        ckpt_complete(tag, dir);
+    }
+    free(dir->done);
+}
+
+static TagWorker *tag_self(QuotaWalker *w) {
+    return (TagWorker *)w->arg;
+}
+
+static void tag_flush(QuotaWalker *w) {
+    TagWorker *self = tag_self(w);
+    QuotaTagStats *stats = ((TagWalk *)w->walk->arg)->stats;
+    __atomic_fetch_add(&stats->dirs, self->local.dirs, __ATOMIC_RELAXED);
+    __atomic_fetch_add(&stats->files, self->local.files, __ATOMIC_RELAXED);
+    __atomic_fetch_add(&stats->unchanged, self->local.unchanged, __ATOMIC_RELAXED);
+    __atomic_fetch_add(&stats->resumed, self->local.resumed, __ATOMIC_RELAXED);
+    __atomic_fetch_add(&stats->skipped, self->local.skipped, __ATOMIC_RELAXED);
+    __atomic_fetch_add(&stats->errors, self->local.errors, __ATOMIC_RELAXED);
+    memset(&self->local, 0, sizeof(self->local));
+    self->unflushed = 0;
+}
+
+static void tag_count(QuotaWalker *w, uint64_t *counter) {
+    (*counter)++;
+    if (++tag_self(w)->unflushed >= TAG_FLUSH_EVERY) {
+        tag_flush(w);
+    }
+}
+
+static void tag_skipped(QuotaWalker *w) {
+    tag_count(w, &tag_self(w)->local.skipped);
+}
+
+static void tag_failed(QuotaWalker *w) {
+    tag_count(w, &tag_self(w)->local.errors);
+}
+
+// 先读后比：projid 与 PROJINHERIT 已经正确时不写，避免弄脏 inode 和产生日志；*changed 表示是否写入
+static int tag_fd(int fd, uint32_t project_id, int is_dir, int *changed) {
+    struct fsxattr attr;
+    memset(&attr, 0, sizeof(attr));
+
+    *changed = 0;
+    if (ioctl(fd, FS_IOC_FSGETXATTR, &attr) < 0) {
+        return errno;
+    }
+
+    if (attr.fsx_projid == project_id && (!is_dir || (attr.fsx_xflags & FS_XFLAG_PROJINHERIT))) {
+        return 0;
+    }
+
+    *changed = 1;
+    attr.fsx_projid = project_id;
+    if (is_dir) {
+        attr.fsx_xflags |= FS_XFLAG_PROJINHERIT;
+    }
+
+    if (ioctl(fd, FS_IOC_FSSETXATTR, &attr) < 0) {
+        return errno;
+    }
+    return 0;
+}
+
+static void tag_file(QuotaWalker *w, int dirfd, const char *name) {
+    TagWorker *self = tag_self(w);
+    int fd = openat(dirfd, name, O_RDONLY | O_NOFOLLOW | O_NONBLOCK | O_NOCTTY | O_CLOEXEC);
+    if (fd < 0) {
+        if (errno == ENOENT || errno == ELOOP) {
+            // 遍历期间被删除或被替换成符号链接
+            tag_count(w, &self->local.skipped);
+        } else {
+            quota_walk_fail(w, errno);
+        }
+        return;
+    }
+
+    int changed;
+    int ret = tag_fd(fd, ((TagWalk *)w->walk->arg)->project_id, 0, &changed);
+    close(fd);
+    if (ret != 0) {
+        quota_walk_fail(w, ret);
+        return;
+    }
+    if (!changed) {
+        tag_count(w, &self->local.unchanged);
+    }
+    tag_count(w, &self->local.files);
+}
+
+// 普通文件就地处理，子目录入队
+static int tag_entry(QuotaWalker *w, QuotaWalkDir *base, const char *name, unsigned char type, uint64_t ino) {
+    TagWalk *tag = (TagWalk *)w->walk->arg;
+    TagWorker *self = tag_self(w);
+
+    if (type == DT_UNKNOWN) {
+        struct stat st;
+        if (fstatat(base->fd, name, &st, AT_SYMLINK_NOFOLLOW) != 0) {
+            tag_count(w, &self->local.skipped);
+            return 0;
+        }
+        type = S_ISDIR(st.st_mode) ? DT_DIR : S_ISREG(st.st_mode) ? DT_REG : DT_LNK;
+    }
+
+    if (type == DT_DIR) {
+        if (tag->ckpt.enabled && ckpt_resume(tag, (TagDir *)base, ino)) {
+            tag_count(w, &self->local.resumed);
+            return 0;
+        }
+        int ret = quota_walk_enqueue(w, base, name);
+        if (ret != 0) {
+            quota_walk_fail(w, ret);
+            return ret;
+        }
+    } else if (type == DT_REG) {
+        tag_file(w, base->fd, name);
+    } else {
+        tag_count(w, &self->local.skipped);
+    }
+    return 0;
+}
+
+static int tag_enter(QuotaWalker *w, QuotaWalkDir *base, const char *name, const struct statx *stx) {
+    (void)w;
+    (void)name;
+    ((TagDir *)base)->ino = stx->stx_ino;
+    return 0;
+}
+
+// 设置目录本身，再读出目录项
+static void tag_visit(QuotaWalker *w, QuotaWalkDir *dir, const struct statx *stx) {
+    (void)stx;
+    int changed;
+    int ret = tag_fd(dir->fd, ((TagWalk *)w->walk->arg)->project_id, 1, &changed);
+    if (ret != 0) {
+        quota_walk_fail(w, ret);
+        return;
+    }
+    if (!changed) {
+        tag_count(w, &tag_self(w)->local.unchanged);
+    }
+    tag_count(w, &tag_self(w)->local.dirs);
+    quota_walk_readdir(w, dir, tag_entry);
+}
+
+static const QuotaWalkOps tag_ops = {
+    .dir_size = sizeof(TagDir),
+    .statx_mask = STATX_TYPE | STATX_INO,
+    .enter = tag_enter,
+    .visit = tag_visit,
+    .release = tag_dir_release,
+    .skipped = tag_skipped,
+    .failed = tag_failed,
+    .finish = tag_flush,
+};
+
+int quota_tag_project(const char *path, uint32_t project_id, int workers, const char *checkpoint,
+                      QuotaTagStats *stats) {
+    if (!path || !stats) {
+        return EINVAL;
+    }
+    if (workers < 1) {
+        workers = 1;
+    }
+    if (workers > QUOTA_MAX_WORKERS) {
+        workers = QUOTA_MAX_WORKERS;
+    }
+
+    int fd = open(path, O_RDONLY | O_NONBLOCK | O_NOCTTY | O_CLOEXEC);
+    if (fd < 0) {
+        return errno;
+    }
+
+    struct statx stx;
+    if (statx(fd, "", AT_EMPTY_PATH, tag_ops.statx_mask, &stx) != 0) {
+        int err = errno;
+        close(fd);
+        return err;
+    }
+
+    // path 本身不是目录时只设置它自己
+    if (!S_ISDIR(stx.stx_mode)) {
+        int changed;
+        int ret = tag_fd(fd, project_id, 0, &changed);
+        close(fd);
+        if (ret != 0) {
+            __atomic_fetch_add(&stats->errors, 1, __ATOMIC_RELAXED);
+            return ret;
+        }
+        if (!changed) {
+            __atomic_fetch_add(&stats->unchanged, 1, __ATOMIC_RELAXED);
+        }
+        __atomic_fetch_add(&stats->files, 1, __ATOMIC_RELAXED);
+        return 0;
+    }
+
+    TagWalk *tag = (TagWalk *)calloc(1, sizeof(TagWalk));
+    QuotaWalk *walk = (QuotaWalk *)calloc(1, sizeof(QuotaWalk));
+    TagWorker *selves = (TagWorker *)calloc((size_t)workers, sizeof(TagWorker));
+    if (!tag || !walk || !selves ||
+        quota_walk_init(walk, &tag_ops, tag, makedev(stx.stx_dev_major, stx.stx_dev_minor), workers, selves,
+                        sizeof(TagWorker)) != 0) {
+        free(tag);
+        free(walk);
+        free(selves);
+        close(fd);
+        return ENOMEM;
+    }
+
+    tag->project_id = project_id;
+    tag->stats = stats;
+
+    int ret = 0;
+    TagCheckpoint *ckpt = &tag->ckpt;
+    pthread_mutex_init(&ckpt->lock, NULL);
+    if (checkpoint && checkpoint[0]) {
+        ckpt->enabled = 1;
+        ckpt->path = checkpoint;
+        memcpy(ckpt->header.magic, TAG_CHECKPOINT_MAGIC, sizeof(ckpt->header.magic));
+        ckpt->header.version = TAG_CHECKPOINT_VERSION;
+        ckpt->header.project_id = project_id;
+        ckpt->header.dev = (uint64_t)walk->dev;
+        ckpt->header.root_ino = stx.stx_ino;
+        ckpt_load(ckpt);
+
+        // 先写一次，检查点不可写时在动手之前就报错
+        ckpt->tmp_path = (char *)malloc(strlen(checkpoint) + sizeof(".tmp"));
+        if (!ckpt->tmp_path) {
+            ret = ENOMEM;
+        } else {
+            sprintf(ckpt->tmp_path, "%s.tmp", checkpoint);
+            ret = ckpt_save_locked(ckpt);
+        }
+    }
+
+    TagDir *root = NULL;
+    if (ret == 0 && !(root = (TagDir *)quota_walk_root(walk, fd))) {
+        ret = ENOMEM;
+    }
+    if (ret == 0) {
+        root->ino = stx.stx_ino;
+        fd = -1;
+        ret = quota_walk_run(walk, &root->base, &stx);
+
+        // 完成后检查点没有用了；中途失败时写下最后的进度供下次续跑
+        if (ckpt->enabled) {
+            if (ret == 0) {
+                unlink(checkpoint);
+            } else {
+                ckpt_save_locked(ckpt);
+            }
+        }
+    }
+
+    quota_walk_destroy(walk);
+    if (fd >= 0) {
+        close(fd);
+    }
+    pthread_mutex_destroy(&ckpt->lock);
+    free(ckpt->set.slots);
+    free(ckpt->tmp_path);
+    free(selves);
+    free(walk);
+    free(tag);
+    return ret;
+}
@@ -0,0 +1,271 @@
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <dirent.h>
+#include <sys/ioctl.h>
+#include <sys/stat.h>
+#include <sys/sysmacros.h>
+#include <linux/fs.h>
+#include "quota_common.h"
+
+// 已打开的目录及其完整路径
+typedef struct {
+    QuotaWalkDir base;
+    uint32_t projid;
+    int inherit;
+    char *path;
+} RootsDir;
+
+typedef struct {
+    int any; // 不要求 PROJINHERIT，报告项目 ID 与父目录不同的所有目录
+    // 扫描起点真正的父目录的属性
+    uint32_t parent_projid;
+    int parent_inherit;
+    uint64_t dirs;
+} RootsWalk;
+
+typedef struct {
+    uint64_t dirs;
+    QuotaProjectRoot *roots;
+    size_t count;
+    size_t capacity;
+} RootsWorker;
+
+static int read_attr(int fd, uint32_t *projid, int *inherit) {
+    struct fsxattr attr;
+    memset(&attr, 0, sizeof(attr));
+    if (ioctl(fd, FS_IOC_FSGETXATTR, &attr) < 0) {
+        return errno;
+    }
+    *projid = attr.fsx_projid;
+    *inherit = (attr.fsx_xflags & FS_XFLAG_PROJINHERIT) != 0;
+    return 0;
+}
+
+// 带 PROJINHERIT 的非 0 项目目录，且父目录不是以同一项目继承下来的，就是该项目的一个根
+static void roots_check(QuotaWalker *w, const RootsDir *dir, uint32_t parent_projid, int parent_inherit) {
+    RootsWorker *self = (RootsWorker *)w->arg;
+    if (((RootsWalk *)w->walk->arg)->any) {
+        if (dir->projid == 0 || parent_projid == dir->projid) {
+            return;
+        }
+    } else if (!dir->inherit || dir->projid == 0 || (parent_inherit && parent_projid == dir->projid)) {
+        return;
+    }
+
+    if (self->count >= self->capacity) {
+        size_t capacity = self->capacity ? self->capacity * 2 : 64;
+        QuotaProjectRoot *roots = (QuotaProjectRoot *)realloc(self->roots, capacity * sizeof(QuotaProjectRoot));
+        if (!roots) {
+            quota_walk_fail(w, ENOMEM);
+            return;
+        }
+        self->roots = roots;
+        self->capacity = capacity;
+    }
+
+    char *path = strdup(dir->path);
+    if (!path) {
+        quota_walk_fail(w, ENOMEM);
+        return;
+    }
+    self->roots[self->count].project_id = dir->projid;
+    self->roots[self->count].path = path;
+    self->count++;
+}
+
+// 只关心目录：子目录入队，其他项直接跳过，不做任何系统调用
+static int roots_entry(QuotaWalker *w, QuotaWalkDir *dir, const char *name, unsigned char type, uint64_t ino) {
+    (void)ino;
+    if (type == DT_UNKNOWN) {
+        struct stat st;
+        if (fstatat(dir->fd, name, &st, AT_SYMLINK_NOFOLLOW) != 0 || !S_ISDIR(st.st_mode)) {
+            return 0;
+        }
+    } else if (type != DT_DIR) {
+        return 0;
+    }
+
+    int ret = quota_walk_enqueue(w, dir, name);
+    if (ret != 0) {
+        quota_walk_fail(w, ret);
+    }
+    return ret;
+}
+
+static int roots_enter(QuotaWalker *w, QuotaWalkDir *base, const char *name, const struct statx *stx) {
+    (void)w;
+    (void)stx;
+    RootsDir *dir = (RootsDir *)base;
+    const char *parent = ((RootsDir *)base->parent)->path;
+    if (asprintf(&dir->path, "%s/%s", strcmp(parent, "/") == 0 ? "" : parent, name) < 0) {
+        dir->path = NULL;
+        return ENOMEM;
+    }
+    int ret = read_attr(base->fd, &dir->projid, &dir->inherit);
+    if (ret != 0) {
+        free(dir->path);
+    }
+    return ret;
+}
+
+static void roots_visit(QuotaWalker *w, QuotaWalkDir *base, const struct statx *stx) {
+    (void)stx;
+    RootsWalk *roots = (RootsWalk *)w->walk->arg;
+    const RootsDir *dir = (const RootsDir *)base;
+    const RootsDir *parent = (const RootsDir *)base->parent;
+    ((RootsWorker *)w->arg)->dirs++;
+
+    if (parent) {
+        roots_check(w, dir, parent->projid, parent->inherit);
+    } else {
+        roots_check(w, dir, roots->parent_projid, roots->parent_inherit);
+    }
+    quota_walk_readdir(w, base, roots_entry);
+}
+
+static void roots_release(QuotaWalk *walk, QuotaWalkDir *dir) {
+    (void)walk;
+    free(((RootsDir *)dir)->path);
+}
+
+static void roots_finish(QuotaWalker *w) {
+    __atomic_fetch_add(&((RootsWalk *)w->walk->arg)->dirs, ((RootsWorker *)w->arg)->dirs, __ATOMIC_RELAXED);
+}
+
+static const QuotaWalkOps roots_ops = {
+    .dir_size = sizeof(RootsDir),
+    .statx_mask = STATX_TYPE,
+    .enter = roots_enter,
+    .visit = roots_visit,
+    .release = roots_release,
+    .finish = roots_finish,
+};
+
+void quota_free_project_roots(QuotaProjectRootList *list) {
+    if (list && list->items) {
+        for (size_t i = 0; i < list->count; i++) {
+            free(list->items[i].path);
+        }
+        free(list->items);
+        list->items = NULL;
+        list->count = 0;
+    }
+}
+
+static int scan_projects(const char *path, int workers, int any, QuotaProjectRootList *list, uint64_t *dirs) {
+    if (!path || !list) {
+        return EINVAL;
+    }
+    if (workers < 1) {
+        workers = 1;
+    }
+    if (workers > QUOTA_MAX_WORKERS) {
+        workers = QUOTA_MAX_WORKERS;
+    }
+
+    int fd = open(path, O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+    if (fd < 0) {
+        return errno;
+    }
+
+    struct statx stx;
+    RootsWalk *roots = (RootsWalk *)calloc(1, sizeof(RootsWalk));
+    QuotaWalk *walk = (QuotaWalk *)calloc(1, sizeof(QuotaWalk));
+    RootsWorker *selves = (RootsWorker *)calloc((size_t)workers, sizeof(RootsWorker));
+    RootsDir *root = NULL;
+    int ret = statx(fd, "", AT_EMPTY_PATH, roots_ops.statx_mask, &stx) != 0 ? errno : 0;
+    if (ret == 0 && (!roots || !walk || !selves ||
+                     quota_walk_init(walk, &roots_ops, roots, makedev(stx.stx_dev_major, stx.stx_dev_minor),
+                                     workers, selves, sizeof(RootsWorker)) != 0)) {
+        free(walk);
+        walk = NULL;
+        ret = ENOMEM;
+    }
+    if (ret == 0 && (!(root = (RootsDir *)quota_walk_root(walk, fd)) || !(root->path = strdup(path)))) {
+        ret = ENOMEM;
+    }
+    if (ret == 0) {
+        ret = read_attr(fd, &root->projid, &root->inherit);
+    }
+    if (ret != 0) {
+        if (root) {
+            free(root->path);
+        }
+        free(root);
+        if (walk) {
+            quota_walk_destroy(walk);
+        }
+        free(selves);
+        free(walk);
+        free(roots);
+        close(fd);
+        return ret;
+    }
+
+    // 扫描起点本身也可能是根：和它真正的父目录比较，读不到父目录时按不继承处理
+    int pfd = openat(fd, "..", O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+    if (pfd >= 0) {
+        if (read_attr(pfd, &roots->parent_projid, &roots->parent_inherit) != 0) {
+            roots->parent_inherit = 0;
+        }
+        close(pfd);
+    }
+    if (any) {
+        // 找项目 ID 时起点本身带的 ID 总要报告
+        roots->parent_projid = 0;
+    }
+    roots->any = any;
+    ret = quota_walk_run(walk, &root->base, &stx);
+
+    // 合并各线程找到的根
+    size_t total = 0;
+    for (int i = 0; i < workers; i++) {
+        total += selves[i].count;
+    }
+    QuotaProjectRoot *items = NULL;
+    if (ret == 0) {
+        items = (QuotaProjectRoot *)malloc((total ? total : 1) * sizeof(QuotaProjectRoot));
+        if (!items) {
+            ret = ENOMEM;
+        }
+    }
+
+    size_t n = 0;
+    for (int i = 0; i < workers; i++) {
+        for (size_t j = 0; j < selves[i].count; j++) {
+            if (items) {
+                items[n++] = selves[i].roots[j];
+            } else {
+                free(selves[i].roots[j].path);
+            }
+        }
+        free(selves[i].roots);
+    }
+
+    if (ret == 0) {
+        list->items = items;
+        list->count = n;
+        if (dirs) {
+            *dirs = roots->dirs;
+        }
+    }
+
+    quota_walk_destroy(walk);
+    free(selves);
+    free(walk);
+    free(roots);
+    return ret;
+}
+
+int quota_scan_project_roots(const char *path, int workers, QuotaProjectRootList *list, uint64_t *dirs) {
+    return scan_projects(path, workers, 0, list, dirs);
+}
+
+int quota_scan_project_dirs(const char *path, int workers, QuotaProjectRootList *list, uint64_t *dirs) {
+    return scan_projects(path, workers, 1, list, dirs);
+}
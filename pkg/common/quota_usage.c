@@ -0,0 +1,848 @@
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <dirent.h>
+#include <pthread.h>
+#include <sys/ioctl.h>
+#include <sys/stat.h>
+#include <sys/sysmacros.h>
+#include <linux/fs.h>
+#include <linux/quota.h>
+#include "quota_common.h"
+
+// 线程本地计数累积到这个数后才合并到共享统计
+#define USAGE_FLUSH_EVERY 256
+
+#define USAGE_CACHE_MAGIC "QUSC"
+#define USAGE_CACHE_VERSION 1
+
+#define USAGE_STATX_MASK (STATX_TYPE | STATX_MODE | STATX_NLINK | STATX_UID | STATX_GID | \
+                          STATX_INO | STATX_BLOCKS | STATX_MTIME | STATX_CTIME)
+
+// 缓存文件头，后跟 count 条目录记录
+typedef struct {
+    char magic[4];
+    uint32_t version;
+    uint32_t type;
+    uint32_t reserved;
+    uint64_t dev;
+    uint64_t root_ino;
+    uint64_t count;
+} UsageCacheHeader;
+
+// 一条目录记录：目录本身的 mtime/ctime，以及它直接包含的非目录项的统计。
+// 后跟 owners 个 UsageCacheOwner、links 个 UsageCacheLink 和 names_size 字节的子目录名，
+// 整条记录按 8 字节对齐。目录 mtime/ctime 不变时目录项没有增删改名，直接复用这些统计，
+// 不再 getdents 和逐个 statx；子目录仍然逐个打开检查。
+typedef struct {
+    uint64_t ino;
+    int64_t mtime_sec;
+    int64_t ctime_sec;
+    uint32_t mtime_nsec;
+    uint32_t ctime_nsec;
+    uint32_t owners;
+    uint32_t links;
+    uint32_t subdirs;
+    uint32_t names_size;
+} UsageCacheDir;
+
+typedef struct {
+    uint32_t id;
+    uint32_t reserved;
+    uint64_t inodes;
+    uint64_t bytes;
+} UsageCacheOwner;
+
+// 有多个硬链接的文件不计入 owners，单独记下 inode，汇总时全局去重
+typedef struct {
+    uint64_t ino;
+    uint32_t id;
+    uint32_t reserved;
+    uint64_t bytes;
+} UsageCacheLink;
+
+_Static_assert(sizeof(UsageCacheHeader) == 40, "UsageCacheHeader layout");
+_Static_assert(sizeof(UsageCacheDir) == 48, "UsageCacheDir layout");
+
+// 上一次扫描留下的缓存：整块读入，按目录 inode 建开放寻址索引
+typedef struct {
+    char *blob;
+    size_t size;
+    uint64_t *inos;
+    size_t *offsets;
+    size_t capacity;
+} UsageCache;
+
+// 按 ID 汇总的用量，每个线程一张，最后合并
+typedef struct {
+    uint32_t id;
+    uint32_t used;
+    uint64_t inodes;
+    uint64_t bytes;
+} UsageSlot;
+
+typedef struct {
+    UsageSlot *slots;
+    size_t capacity;
+    size_t count;
+} UsageMap;
+
+// 已打开的目录
+typedef struct {
+    QuotaWalkDir base;
+    uint32_t projid;
+} UsageDir;
+
+// 展开一个目录时就地累积的目录记录
+typedef struct {
+    UsageCacheOwner *owners;
+    size_t owner_count;
+    size_t owner_capacity;
+    UsageCacheLink *links;
+    size_t link_count;
+    size_t link_capacity;
+    char *names;
+    size_t names_size;
+    size_t names_capacity;
+    uint32_t subdirs;
+} UsageRecord;
+
+typedef struct {
+    int type;
+    dev_t dev;
+    int caching;
+    UsageCache cache;
+    pthread_mutex_t links_lock;
+    QuotaInoSet links;
+    QuotaUsageStats *stats;
+} UsageWalk;
+
+typedef struct {
+    QuotaWalker *walker;
+    UsageWalk *walk;
+    QuotaUsageStats local;
+    unsigned unflushed;
+    UsageMap map;
+    UsageRecord record;
+    // 本次扫描的新缓存记录
+    char *out;
+    size_t out_size;
+    size_t out_capacity;
+    uint64_t out_count;
+} UsageWorker;
+
+static size_t align8(size_t n) {
+    return (n + 7) & ~(size_t)7;
+}
+
+static size_t usage_slot(uint32_t id, size_t capacity) {
+    return (size_t)((id * 2654435761u) & (capacity - 1));
+}
+
+static int usage_map_add(UsageMap *map, uint32_t id, uint64_t inodes, uint64_t bytes) {
+    if ((map->count + 1) * 2 > map->capacity) {
+        size_t capacity = map->capacity ? map->capacity * 2 : 64;
+        UsageSlot *slots = (UsageSlot *)calloc(capacity, sizeof(UsageSlot));
+        if (!slots) {
+            return ENOMEM;
+        }
+        for (size_t i = 0; i < map->capacity; i++) {
+            if (map->slots[i].used) {
+                size_t j = usage_slot(map->slots[i].id, capacity);
+                while (slots[j].used) {
+                    j = (j + 1) & (capacity - 1);
+                }
+                slots[j] = map->slots[i];
+            }
+        }
+        free(map->slots);
+        map->slots = slots;
+        map->capacity = capacity;
+    }
+
+    size_t i = usage_slot(id, map->capacity);
+    while (map->slots[i].used && map->slots[i].id != id) {
+        i = (i + 1) & (map->capacity - 1);
+    }
+    if (!map->slots[i].used) {
+        map->slots[i].used = 1;
+        map->slots[i].id = id;
+        map->count++;
+    }
+    map->slots[i].inodes += inodes;
+    map->slots[i].bytes += bytes;
+    return 0;
+}
+
+static size_t cache_slot(uint64_t ino, size_t capacity) {
+    ino *= 0x9E3779B97F4A7C15ULL;
+    return (size_t)(ino >> 17) & (capacity - 1);
+}
+
+static const UsageCacheDir *cache_find(const UsageCache *cache, uint64_t ino) {
+    if (!cache->capacity) {
+        return NULL;
+    }
+    for (size_t i = cache_slot(ino, cache->capacity); cache->inos[i]; i = (i + 1) & (cache->capacity - 1)) {
+        if (cache->inos[i] == ino) {
+            return (const UsageCacheDir *)(cache->blob + cache->offsets[i]);
+        }
+    }
+    return NULL;
+}
+
+static size_t cache_names_offset(const UsageCacheDir *dir) {
+    return sizeof(UsageCacheDir) + (size_t)dir->owners * sizeof(UsageCacheOwner) +
+           (size_t)dir->links * sizeof(UsageCacheLink);
+}
+
+static size_t cache_record_size(const UsageCacheDir *dir) {
+    return align8(cache_names_offset(dir) + dir->names_size);
+}
+
+static void cache_free(UsageCache *cache) {
+    free(cache->blob);
+    free(cache->inos);
+    free(cache->offsets);
+    memset(cache, 0, sizeof(*cache));
+}
+
+// 读入缓存并建索引；文件不存在、属于别的根目录/设备/配额类型或已损坏时当作没有缓存
+static void cache_load(UsageCache *cache, const char *path, const UsageCacheHeader *expect) {
+    int fd = open(path, O_RDONLY | O_CLOEXEC);
+    if (fd < 0) {
+        return;
+    }
+
+    struct stat st;
+    UsageCacheHeader header;
+    if (fstat(fd, &st) != 0 || (size_t)st.st_size < sizeof(header) ||
+        read(fd, &header, sizeof(header)) != (ssize_t)sizeof(header) ||
+        memcmp(header.magic, expect->magic, sizeof(header.magic)) != 0 ||
+        header.version != expect->version || header.type != expect->type ||
+        header.dev != expect->dev || header.root_ino != expect->root_ino) {
+        close(fd);
+        return;
+    }
+
+    size_t size = (size_t)st.st_size - sizeof(header);
+    if (header.count > size / sizeof(UsageCacheDir)) {
+        close(fd);
+        return;
+    }
+    size_t capacity = 16;
+    while (capacity < header.count * 2) {
+        capacity *= 2;
+    }
+    cache->blob = (char *)malloc(size ? size : 1);
+    cache->inos = (uint64_t *)calloc(capacity, sizeof(uint64_t));
+    cache->offsets = (size_t *)calloc(capacity, sizeof(size_t));
+    if (!cache->blob || !cache->inos || !cache->offsets) {
+        close(fd);
+        cache_free(cache);
+        return;
+    }
+
+    size_t got = 0;
+    while (got < size) {
+        ssize_t n = read(fd, cache->blob + got, size - got);
+        if (n <= 0) {
+            break;
+        }
+        got += (size_t)n;
+    }
+    close(fd);
+    cache->size = size;
+    cache->capacity = capacity;
+
+    size_t off = 0;
+    for (uint64_t i = 0; i < header.count; i++) {
+        if (got < sizeof(UsageCacheDir) || off > got - sizeof(UsageCacheDir)) {
+            cache_free(cache);
+            return;
+        }
+        const UsageCacheDir *dir = (const UsageCacheDir *)(cache->blob + off);
+        size_t names_off = cache_names_offset(dir);
+        size_t len = cache_record_size(dir);
+        if (dir->ino == 0 || len > got - off ||
+            (dir->names_size > 0 && ((const char *)dir)[names_off + dir->names_size - 1] != '\0')) {
+            cache_free(cache);
+            return;
+        }
+
+        size_t j = cache_slot(dir->ino, capacity);
+        while (cache->inos[j] && cache->inos[j] != dir->ino) {
+            j = (j + 1) & (capacity - 1);
+        }
+        cache->inos[j] = dir->ino;
+        cache->offsets[j] = off;
+        off += len;
+    }
+}
+
+static void usage_flush(UsageWorker *w) {
+    QuotaUsageStats *stats = w->walk->stats;
+    __atomic_fetch_add(&stats->dirs, w->local.dirs, __ATOMIC_RELAXED);
+    __atomic_fetch_add(&stats->files, w->local.files, __ATOMIC_RELAXED);
+    __atomic_fetch_add(&stats->cached, w->local.cached, __ATOMIC_RELAXED);
+    __atomic_fetch_add(&stats->hardlinks, w->local.hardlinks, __ATOMIC_RELAXED);
+    __atomic_fetch_add(&stats->skipped, w->local.skipped, __ATOMIC_RELAXED);
+    __atomic_fetch_add(&stats->errors, w->local.errors, __ATOMIC_RELAXED);
+    memset(&w->local, 0, sizeof(w->local));
+    w->unflushed = 0;
+}
+
+static void usage_count(UsageWorker *w, uint64_t *counter) {
+    (*counter)++;
+    if (++w->unflushed >= USAGE_FLUSH_EVERY) {
+        usage_flush(w);
+    }
+}
+
+static void usage_fail(UsageWorker *w, int err) {
+    quota_walk_fail(w->walker, err);
+}
+
+static void usage_failed(QuotaWalker *walker) {
+    UsageWorker *w = (UsageWorker *)walker->arg;
+    usage_count(w, &w->local.errors);
+}
+
+static void usage_skipped(QuotaWalker *walker) {
+    UsageWorker *w = (UsageWorker *)walker->arg;
+    usage_count(w, &w->local.skipped);
+}
+
+static void usage_finish(QuotaWalker *walker) {
+    usage_flush((UsageWorker *)walker->arg);
+}
+
+static int get_projid(int fd, uint32_t *projid) {
+    struct fsxattr attr;
+    memset(&attr, 0, sizeof(attr));
+    if (ioctl(fd, FS_IOC_FSGETXATTR, &attr) < 0) {
+        return errno;
+    }
+    *projid = attr.fsx_projid;
+    return 0;
+}
+
+static uint32_t usage_owner(const UsageWalk *walk, const struct statx *stx, uint32_t projid) {
+    return walk->type == USRQUOTA ? stx->stx_uid : walk->type == GRPQUOTA ? stx->stx_gid : projid;
+}
+
+static int record_owner(UsageRecord *rec, uint32_t id, uint64_t bytes) {
+    // 一个目录里的属主通常只有一两个，线性查找即可
+    for (size_t i = rec->owner_count; i > 0; i--) {
+        UsageCacheOwner *owner = &rec->owners[i - 1];
+        if (owner->id == id) {
+            owner->inodes++;
+            owner->bytes += bytes;
+            return 0;
+        }
+    }
+    if (rec->owner_count >= rec->owner_capacity) {
+        size_t capacity = rec->owner_capacity ? rec->owner_capacity * 2 : 8;
+        UsageCacheOwner *owners = (UsageCacheOwner *)realloc(rec->owners, capacity * sizeof(UsageCacheOwner));
+        if (!owners) {
+            return ENOMEM;
+        }
+        rec->owners = owners;
+        rec->owner_capacity = capacity;
+    }
+    UsageCacheOwner owner = {id, 0, 1, bytes};
+    rec->owners[rec->owner_count++] = owner;
+    return 0;
+}
+
+static int record_link(UsageRecord *rec, uint64_t ino, uint32_t id, uint64_t bytes) {
+    if (rec->link_count >= rec->link_capacity) {
+        size_t capacity = rec->link_capacity ? rec->link_capacity * 2 : 8;
+        UsageCacheLink *links = (UsageCacheLink *)realloc(rec->links, capacity * sizeof(UsageCacheLink));
+        if (!links) {
+            return ENOMEM;
+        }
+        rec->links = links;
+        rec->link_capacity = capacity;
+    }
+    UsageCacheLink link = {ino, id, 0, bytes};
+    rec->links[rec->link_count++] = link;
+    return 0;
+}
+
+static int record_subdir(UsageRecord *rec, const char *name) {
+    size_t len = strlen(name) + 1;
+    if (rec->names_size + len > rec->names_capacity) {
+        size_t capacity = rec->names_capacity ? rec->names_capacity : 256;
+        while (capacity < rec->names_size + len) {
+            capacity *= 2;
+        }
+        char *names = (char *)realloc(rec->names, capacity);
+        if (!names) {
+            return ENOMEM;
+        }
+        rec->names = names;
+        rec->names_capacity = capacity;
+    }
+    memcpy(rec->names + rec->names_size, name, len);
+    rec->names_size += len;
+    rec->subdirs++;
+    return 0;
+}
+
+static void usage_map_owner(UsageWorker *w, uint32_t id, uint64_t inodes, uint64_t bytes) {
+    if (usage_map_add(&w->map, id, inodes, bytes) != 0) {
+        usage_fail(w, ENOMEM);
+    }
+}
+
+// 合并一个目录的直接统计；硬链接文件只在第一次遇到它的 inode 时计入
+static void usage_apply(UsageWorker *w, const UsageCacheOwner *owners, size_t owner_count,
+                        const UsageCacheLink *links, size_t link_count) {
+    UsageWalk *walk = w->walk;
+
+    for (size_t i = 0; i < owner_count; i++) {
+        usage_map_owner(w, owners[i].id, owners[i].inodes, owners[i].bytes);
+    }
+
+    for (size_t i = 0; i < link_count; i++) {
+        pthread_mutex_lock(&walk->links_lock);
+        int seen = quota_ino_set_contains(&walk->links, links[i].ino);
+        int ret = seen ? 0 : quota_ino_set_insert(&walk->links, links[i].ino);
+        pthread_mutex_unlock(&walk->links_lock);
+
+        if (ret != 0) {
+            usage_fail(w, ret);
+        } else if (seen) {
+            usage_count(w, &w->local.hardlinks);
+        } else {
+            usage_map_owner(w, links[i].id, 1, links[i].bytes);
+        }
+    }
+}
+
+static int usage_out_reserve(UsageWorker *w, size_t len) {
+    if (w->out_size + len > w->out_capacity) {
+        size_t capacity = w->out_capacity ? w->out_capacity : 64 * 1024;
+        while (capacity < w->out_size + len) {
+            capacity *= 2;
+        }
+        char *out = (char *)realloc(w->out, capacity);
+        if (!out) {
+            return ENOMEM;
+        }
+        w->out = out;
+        w->out_capacity = capacity;
+    }
+    return 0;
+}
+
+// 把刚展开的目录记入新缓存
+static void usage_emit(UsageWorker *w, const struct statx *stx) {
+    const UsageRecord *rec = &w->record;
+
+    UsageCacheDir dir;
+    memset(&dir, 0, sizeof(dir));
+    dir.ino = stx->stx_ino;
+    dir.mtime_sec = stx->stx_mtime.tv_sec;
+    dir.mtime_nsec = stx->stx_mtime.tv_nsec;
+    dir.ctime_sec = stx->stx_ctime.tv_sec;
+    dir.ctime_nsec = stx->stx_ctime.tv_nsec;
+    dir.owners = (uint32_t)rec->owner_count;
+    dir.links = (uint32_t)rec->link_count;
+    dir.subdirs = rec->subdirs;
+    dir.names_size = (uint32_t)rec->names_size;
+
+    size_t len = cache_record_size(&dir);
+    if (usage_out_reserve(w, len) != 0) {
+        usage_fail(w, ENOMEM);
+        return;
+    }
+
+    char *p = w->out + w->out_size;
+    memset(p, 0, len);
+    memcpy(p, &dir, sizeof(dir));
+    p += sizeof(dir);
+    if (rec->owner_count) {
+        memcpy(p, rec->owners, rec->owner_count * sizeof(UsageCacheOwner));
+        p += rec->owner_count * sizeof(UsageCacheOwner);
+    }
+    if (rec->link_count) {
+        memcpy(p, rec->links, rec->link_count * sizeof(UsageCacheLink));
+        p += rec->link_count * sizeof(UsageCacheLink);
+    }
+    if (rec->names_size) {
+        memcpy(p, rec->names, rec->names_size);
+    }
+    w->out_size += len;
+    w->out_count++;
+}
+
+static void usage_emit_cached(UsageWorker *w, const UsageCacheDir *dir) {
+    size_t len = cache_record_size(dir);
+    if (usage_out_reserve(w, len) != 0) {
+        usage_fail(w, ENOMEM);
+        return;
+    }
+    memcpy(w->out + w->out_size, dir, len);
+    w->out_size += len;
+    w->out_count++;
+}
+
+// 统计一个非目录项：计入当前目录记录，子目录返回 1 交给调用方入队
+static int usage_entry(UsageWorker *w, UsageDir *dir, const char *name) {
+    UsageWalk *walk = w->walk;
+
+    struct statx stx;
+    if (statx(dir->base.fd, name, AT_SYMLINK_NOFOLLOW | AT_NO_AUTOMOUNT, USAGE_STATX_MASK, &stx) != 0) {
+        if (errno == ENOENT) {
+            usage_count(w, &w->local.skipped);
+        } else {
+            usage_fail(w, errno);
+        }
+        return 0;
+    }
+    if (S_ISDIR(stx.stx_mode)) {
+        return 1;
+    }
+    if (makedev(stx.stx_dev_major, stx.stx_dev_minor) != walk->dev) {
+        // 绑定挂载进来的单个文件
+        usage_count(w, &w->local.skipped);
+        return 0;
+    }
+
+    // 符号链接、设备等无法打开取 projid，按创建时的继承规则记到所在目录的项目上
+    uint32_t projid = dir->projid;
+    if (walk->type == PRJQUOTA && S_ISREG(stx.stx_mode)) {
+        int fd = openat(dir->base.fd, name, O_RDONLY | O_NOFOLLOW | O_NONBLOCK | O_NOCTTY | O_CLOEXEC);
+        if (fd < 0) {
+            if (errno == ENOENT || errno == ELOOP) {
+                usage_count(w, &w->local.skipped);
+            } else {
+                usage_fail(w, errno);
+            }
+            return 0;
+        }
+        int ret = get_projid(fd, &projid);
+        close(fd);
+        if (ret != 0) {
+            usage_fail(w, ret);
+            return 0;
+        }
+    }
+
+    uint32_t id = usage_owner(walk, &stx, projid);
+    uint64_t bytes = stx.stx_blocks * 512;
+    int ret = stx.stx_nlink > 1 ? record_link(&w->record, stx.stx_ino, id, bytes)
+                                : record_owner(&w->record, id, bytes);
+    if (ret != 0) {
+        usage_fail(w, ret);
+    } else {
+        usage_count(w, &w->local.files);
+    }
+    return 0;
+}
+
+static int usage_dirent(QuotaWalker *walker, QuotaWalkDir *base, const char *name, unsigned char type,
+                        uint64_t ino) {
+    UsageWorker *w = (UsageWorker *)walker->arg;
+    UsageDir *dir = (UsageDir *)base;
+    (void)ino;
+
+    if (type == DT_DIR || (type == DT_UNKNOWN && usage_entry(w, dir, name))) {
+        int ret = w->walk->caching ? record_subdir(&w->record, name) : 0;
+        if (ret == 0) {
+            ret = quota_walk_enqueue(walker, base, name);
+        }
+        if (ret != 0) {
+            usage_fail(w, ret);
+            return ret;
+        }
+    } else if (type != DT_UNKNOWN) {
+        usage_entry(w, dir, name);
+    }
+    return 0;
+}
+
+// 读出目录项：非目录项逐个 statx 记入目录记录，子目录入队
+static void usage_expand(UsageWorker *w, UsageDir *dir, const struct statx *stx) {
+    UsageRecord *rec = &w->record;
+    rec->owner_count = 0;
+    rec->link_count = 0;
+    rec->names_size = 0;
+    rec->subdirs = 0;
+
+    if (quota_walk_readdir(w->walker, &dir->base, usage_dirent) != 0) {
+        return;
+    }
+
+    usage_apply(w, rec->owners, rec->owner_count, rec->links, rec->link_count);
+    if (w->walk->caching) {
+        usage_emit(w, stx);
+    }
+}
+
+// 目录自上次扫描以来没有变化：复用缓存的直接统计，子目录按缓存的名字入队
+static void usage_reuse(UsageWorker *w, UsageDir *dir, const UsageCacheDir *cached) {
+    const char *p = (const char *)cached + sizeof(UsageCacheDir);
+    const UsageCacheOwner *owners = (const UsageCacheOwner *)p;
+    p += cached->owners * sizeof(UsageCacheOwner);
+    const UsageCacheLink *links = (const UsageCacheLink *)p;
+    p += cached->links * sizeof(UsageCacheLink);
+
+    usage_apply(w, owners, cached->owners, links, cached->links);
+    for (uint64_t i = 0; i < cached->owners; i++) {
+        w->local.files += owners[i].inodes;
+    }
+    w->local.files += cached->links;
+
+    const char *end = p + cached->names_size;
+    for (const char *name = p; name < end && !quota_walk_stopped(w->walker->walk); name += strlen(name) + 1) {
+        int ret = quota_walk_enqueue(w->walker, &dir->base, name);
+        if (ret != 0) {
+            usage_fail(w, ret);
+            return;
+        }
+    }
+
+    usage_emit_cached(w, cached);
+    usage_count(w, &w->local.cached);
+}
+
+// 计入目录本身，再按缓存复用或重新展开
+static void usage_visit(QuotaWalker *walker, QuotaWalkDir *base, const struct statx *stx) {
+    UsageWorker *w = (UsageWorker *)walker->arg;
+    UsageWalk *walk = w->walk;
+    UsageDir *dir = (UsageDir *)base;
+
+    if (walk->type == PRJQUOTA) {
+        int ret = get_projid(base->fd, &dir->projid);
+        if (ret != 0) {
+            usage_fail(w, ret);
+            return;
+        }
+    }
+    usage_map_owner(w, usage_owner(walk, stx, dir->projid), 1, stx->stx_blocks * 512);
+    usage_count(w, &w->local.dirs);
+
+    const UsageCacheDir *cached = cache_find(&walk->cache, stx->stx_ino);
+    if (cached && cached->mtime_sec == stx->stx_mtime.tv_sec && cached->mtime_nsec == stx->stx_mtime.tv_nsec &&
+        cached->ctime_sec == stx->stx_ctime.tv_sec && cached->ctime_nsec == stx->stx_ctime.tv_nsec) {
+        usage_reuse(w, dir, cached);
+    } else {
+        usage_expand(w, dir, stx);
+    }
+}
+
+// 目录先沿用父目录的项目 ID，访问时再读自己的
+static int usage_enter(QuotaWalker *walker, QuotaWalkDir *dir, const char *name, const struct statx *stx) {
+    (void)walker;
+    (void)name;
+    (void)stx;
+    ((UsageDir *)dir)->projid = ((UsageDir *)dir->parent)->projid;
+    return 0;
+}
+
+static const QuotaWalkOps usage_ops = {
+    .dir_size = sizeof(UsageDir),
+    .statx_mask = USAGE_STATX_MASK,
+    .enter = usage_enter,
+    .visit = usage_visit,
+    .skipped = usage_skipped,
+    .failed = usage_failed,
+    .finish = usage_finish,
+};
+
+// 写临时文件再改名，中途失败不会留下半个缓存
+static int cache_save(const char *path, UsageCacheHeader *header, UsageWorker *selves, int workers) {
+    header->count = 0;
+    for (int i = 0; i < workers; i++) {
+        header->count += selves[i].out_count;
+    }
+
+    char *tmp_path = (char *)malloc(strlen(path) + sizeof(".tmp"));
+    if (!tmp_path) {
+        return ENOMEM;
+    }
+    sprintf(tmp_path, "%s.tmp", path);
+
+    FILE *fp = fopen(tmp_path, "we");
+    if (!fp) {
+        int err = errno;
+        free(tmp_path);
+        return err;
+    }
+
+    int ok = fwrite(header, sizeof(*header), 1, fp) == 1;
+    for (int i = 0; ok && i < workers; i++) {
+        ok = selves[i].out_size == 0 || fwrite(selves[i].out, selves[i].out_size, 1, fp) == 1;
+    }
+    ok = ok && fflush(fp) == 0 && fsync(fileno(fp)) == 0;
+
+    int err = ok ? 0 : (errno ? errno : EIO);
+    if (fclose(fp) != 0 && err == 0) {
+        err = errno;
+    }
+    if (err == 0 && rename(tmp_path, path) != 0) {
+        err = errno;
+    }
+    if (err != 0) {
+        unlink(tmp_path);
+    }
+    free(tmp_path);
+    return err;
+}
+
+static int compare_records(const void *a, const void *b) {
+    uint32_t x = ((const QuotaRecord *)a)->id;
+    uint32_t y = ((const QuotaRecord *)b)->id;
+    return x < y ? -1 : (x > y);
+}
+
+static int usage_collect(UsageWorker *selves, int workers, int type, QuotaRecordList *list) {
+    UsageMap *total = &selves[0].map;
+    for (int w = 1; w < workers; w++) {
+        UsageMap *map = &selves[w].map;
+        for (size_t i = 0; i < map->capacity; i++) {
+            if (map->slots[i].used &&
+                usage_map_add(total, map->slots[i].id, map->slots[i].inodes, map->slots[i].bytes) != 0) {
+                return ENOMEM;
+            }
+        }
+    }
+
+    size_t capacity = total->count ? total->count : 1;
+    QuotaRecord *items = (QuotaRecord *)calloc(capacity, sizeof(QuotaRecord));
+    if (!items) {
+        return ENOMEM;
+    }
+
+    size_t n = 0;
+    for (size_t i = 0; i < total->capacity; i++) {
+        if (total->slots[i].used) {
+            items[n].id = total->slots[i].id;
+            items[n].qtype = (uint32_t)type;
+            items[n].curinodes = total->slots[i].inodes;
+            items[n].curblocks = (total->slots[i].bytes + 1023) / 1024;
+            n++;
+        }
+    }
+    qsort(items, n, sizeof(QuotaRecord), compare_records);
+
+    list->items = items;
+    list->count = n;
+    list->capacity = capacity;
+    return 0;
+}
+
+int quota_scan_usage(const char *path, int type, int workers, const char *cache, QuotaRecordList *list,
+                     QuotaUsageStats *stats) {
+    if (!path || !list || !stats || type < USRQUOTA || type > PRJQUOTA) {
+        return EINVAL;
+    }
+    if (workers < 1) {
+        workers = 1;
+    }
+    if (workers > QUOTA_MAX_WORKERS) {
+        workers = QUOTA_MAX_WORKERS;
+    }
+
+    int fd = open(path, O_RDONLY | O_NONBLOCK | O_NOCTTY | O_CLOEXEC);
+    if (fd < 0) {
+        return errno;
+    }
+
+    struct statx stx;
+    if (statx(fd, "", AT_EMPTY_PATH, USAGE_STATX_MASK, &stx) != 0) {
+        int err = errno;
+        close(fd);
+        return err;
+    }
+
+    UsageWalk *walk = (UsageWalk *)calloc(1, sizeof(UsageWalk));
+    QuotaWalk *tree = (QuotaWalk *)calloc(1, sizeof(QuotaWalk));
+    UsageWorker *selves = (UsageWorker *)calloc((size_t)workers, sizeof(UsageWorker));
+    dev_t dev = makedev(stx.stx_dev_major, stx.stx_dev_minor);
+    if (!walk || !tree || !selves ||
+        quota_walk_init(tree, &usage_ops, walk, dev, workers, selves, sizeof(UsageWorker)) != 0) {
+        free(walk);
+        free(tree);
+        free(selves);
+        close(fd);
+        return ENOMEM;
+    }
+
+    walk->type = type;
+    walk->dev = dev;
+    walk->stats = stats;
+    pthread_mutex_init(&walk->links_lock, NULL);
+    for (int i = 0; i < workers; i++) {
+        selves[i].walker = &tree->walkers[i];
+        selves[i].walk = walk;
+    }
+
+    UsageCacheHeader header;
+    memset(&header, 0, sizeof(header));
+    memcpy(header.magic, USAGE_CACHE_MAGIC, sizeof(header.magic));
+    header.version = USAGE_CACHE_VERSION;
+    header.type = (uint32_t)type;
+    header.dev = (uint64_t)dev;
+    header.root_ino = stx.stx_ino;
+    if (cache && cache[0]) {
+        walk->caching = 1;
+        cache_load(&walk->cache, cache, &header);
+    }
+
+    int ret = 0;
+    QuotaWalkDir *root = NULL;
+    if (!S_ISDIR(stx.stx_mode)) {
+        // path 本身不是目录时只统计它自己
+        uint32_t projid = 0;
+        if (type == PRJQUOTA) {
+            ret = get_projid(fd, &projid);
+        }
+        if (ret == 0) {
+            usage_map_owner(&selves[0], usage_owner(walk, &stx, projid), 1, stx.stx_blocks * 512);
+            usage_count(&selves[0], &selves[0].local.files);
+            usage_flush(&selves[0]);
+            ret = tree->error;
+        }
+    } else if (!(root = quota_walk_root(tree, fd))) {
+        ret = ENOMEM;
+    } else {
+        fd = -1;
+        ret = quota_walk_run(tree, root, &stx);
+
+        // 只有完整扫描后才更新缓存，失败时保留上一次的
+        if (ret == 0 && walk->caching) {
+            ret = cache_save(cache, &header, selves, workers);
+        }
+    }
+
+    if (ret == 0) {
+        ret = usage_collect(selves, workers, type, list);
+    }
+
+    for (int i = 0; i < workers; i++) {
+        free(selves[i].map.slots);
+        free(selves[i].record.owners);
+        free(selves[i].record.links);
+        free(selves[i].record.names);
+        free(selves[i].out);
+    }
+    quota_walk_destroy(tree);
+    if (fd >= 0) {
+        close(fd);
+    }
+    pthread_mutex_destroy(&walk->links_lock);
+    free(walk->links.slots);
+    cache_free(&walk->cache);
+    free(selves);
+    free(tree);
+    free(walk);
+    return ret;
+}
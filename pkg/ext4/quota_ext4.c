@@ -11,212 +11,8 @@
 #include <linux/quota.h>
 #include <sys/quota.h>
 #include <limits.h>
-#include <sys/utsname.h>
 #include "quota_ext4.h"
 
-static char device_path[PATH_MAX] = {0};
-static int kernel_version_checked = 0;
-static int kernel_supports_getnextquota = 0;
-
-static int check_kernel_version(void) {
-    if (kernel_version_checked) {
-        return kernel_supports_getnextquota;
-    }
-
-    struct utsname uts;
-    if (uname(&uts) != 0) {
-        kernel_version_checked = 1;
-        kernel_supports_getnextquota = 0;
-        return 0;
-    }
-
-    int major, minor, patch;
-    if (sscanf(uts.release, "%d.%d.%d", &major, &minor, &patch) != 3) {
-        kernel_version_checked = 1;
-        kernel_supports_getnextquota = 0;
-        return 0;
-    }
-
-    kernel_version_checked = 1;
-    if (major > 4 || (major == 4 && minor >= 6)) {
-        kernel_supports_getnextquota = 1;
-    } else {
-        kernel_supports_getnextquota = 0;
-    }
-
-    return kernel_supports_getnextquota;
-}
-
-static int find_device_by_major_minor(unsigned int major, unsigned int minor) {
-    char uevent_path[PATH_MAX];
-    snprintf(uevent_path, PATH_MAX, "/sys/dev/block/%u:%u/uevent", major, minor);
-    
-    FILE *fp = fopen(uevent_path, "r");
-    if (!fp) {
-        return -1;
-    }
-    
-    char line[PATH_MAX];
-    char devname[PATH_MAX] = {0};
-    
-    while (fgets(line, sizeof(line), fp)) {
-        if (strncmp(line, "DEVNAME=", 8) == 0) {
-            strncpy(devname, line + 8, PATH_MAX - 1);
-            size_t len = strlen(devname);
-            if (len > 0 && devname[len - 1] == '\n') {
-                devname[len - 1] = '\0';
-            }
-            break;
-        }
-    }
-    fclose(fp);
-    
-    if (devname[0] == '\0') {
-        return -1;
-    }
-    
-    const char *dev_paths[] = {
-        "/dev/mapper/%s",
-        "/dev/%s",
-        "/dev/block/%s",
-        "/dev/disk/by-uuid/%s",
-        "/dev/disk/by-label/%s",
-        "/tmp/quota_%s",
-        NULL
-    };
-    
-    for (int i = 0; dev_paths[i] != NULL; i++) {
-        char test_path[PATH_MAX];
-        snprintf(test_path, PATH_MAX, dev_paths[i], devname);
-        
-        if (access(test_path, F_OK) == 0) {
-            strncpy(device_path, test_path, PATH_MAX - 1);
-            device_path[PATH_MAX - 1] = '\0';
-            return 0;
-        }
-    }
-    
-    char fake_device_path[PATH_MAX];
-    snprintf(fake_device_path, PATH_MAX, "/tmp/quota_%u_%u", major, minor);
-    
-    if (access(fake_device_path, F_OK) == 0) {
-        strncpy(device_path, fake_device_path, PATH_MAX - 1);
-        device_path[PATH_MAX - 1] = '\0';
-        return 0;
-    }
-    
-    if (mknod(fake_device_path, S_IFBLK | 0600, makedev(major, minor)) == 0) {
-        strncpy(device_path, fake_device_path, PATH_MAX - 1);
-        device_path[PATH_MAX - 1] = '\0';
-        return 0;
-    }
-    
-    return -1;
-}
-
-static int is_valid_mount_point(const char *mount_point, const char *path) {
-    struct stat st_mount, st_path;
-    
-    if (stat(mount_point, &st_mount) != 0) {
-        return 0;
-    }
-    
-    if (stat(path, &st_path) != 0) {
-        return 0;
-    }
-    
-    if (st_mount.st_dev != st_path.st_dev) {
-        return 0;
-    }
-    
-    return 1;
-}
-
-static int find_device_for_path(const char *path) {
-    FILE *fp = fopen("/proc/self/mountinfo", "r");
-    if (!fp) {
-        return -1;
-    }
-    
-    char line[PATH_MAX * 4];
-    size_t path_len = strlen(path);
-    char *best_match = NULL;
-    unsigned int best_major = 0;
-    unsigned int best_minor = 0;
-    size_t best_match_len = 0;
-    char best_fstype[64] = {0};
-    int is_root_path = (path_len == 1 && path[0] == '/');
-    
-    while (fgets(line, sizeof(line), fp)) {
-        char mount_point[PATH_MAX];
-        char root[PATH_MAX];
-        unsigned int major, minor;
-        
-        int parsed = sscanf(line, "%*d %*d %u:%u %s %s", &major, &minor, root, mount_point);
-        if (parsed != 4) {
-            continue;
-        }
-        
-        size_t mnt_len = strlen(mount_point);
-        
-        if (is_root_path) {
-            if (strcmp(mount_point, "/") != 0) {
-                continue;
-            }
-            
-            char *fstype_ptr = strstr(line, " - ");
-            if (!fstype_ptr) {
-                continue;
-            }
-            
-            fstype_ptr += 3;
-            char fstype[64];
-            sscanf(fstype_ptr, "%63s", fstype);
-            
-            if (strcmp(fstype, "ext4") == 0 || strcmp(fstype, "xfs") == 0) {
-                if (is_valid_mount_point(mount_point, path)) {
-                    best_match = mount_point;
-                    best_major = major;
-                    best_minor = minor;
-                    best_match_len = mnt_len;
-                    strncpy(best_fstype, fstype, sizeof(best_fstype) - 1);
-                    best_fstype[sizeof(best_fstype) - 1] = '\0';
-                    break;
-                }
-            }
-        } else {
-            if (mnt_len > path_len) {
-                continue;
-            }
-            
-            if (strncmp(path, mount_point, mnt_len) == 0) {
-                if (mnt_len > best_match_len) {
-                    if (is_valid_mount_point(mount_point, path)) {
-                        best_match = mount_point;
-                        best_major = major;
-                        best_minor = minor;
-                        best_match_len = mnt_len;
-                        
-                        char *fstype_ptr = strstr(line, " - ");
-                        if (fstype_ptr) {
-                            fstype_ptr += 3;
-                            sscanf(fstype_ptr, "%63s", best_fstype);
-                        }
-                    }
-                }
-            }
-        }
-    }
-    
-    fclose(fp);
-    
-    if (best_match) {
-        return find_device_by_major_minor(best_major, best_minor);
-    }
-    
-    return -1;
-}
-
 const char* ext4_error_string(int error_code) {
     switch (error_code) {
         case 0:
@@ -248,15 +44,30 @@ const char* ext4_error_string(int error_code) {
     }
 }
 
-int ext4_set_quota(const char *path, uint32_t id, int type,
-                    uint64_t bhard, uint64_t bsoft,
-                    uint64_t ihard, uint64_t isoft) {
-    if (!path) {
-        return EINVAL;
-    }
+static int has_quota_set(const struct if_dqblk *dq) {
+    return (dq->dqb_bhardlimit > 0 || dq->dqb_bsoftlimit > 0 ||
+            dq->dqb_ihardlimit > 0 || dq->dqb_isoftlimit > 0 ||
+            dq->dqb_curspace > 0 || dq->dqb_curinodes > 0);
+}
 
-    if (find_device_for_path(path) != 0) {
-        return ENODEV;
+static void fill_quota_info(EXT4QuotaInfo *info, const struct if_dqblk *dq, uint32_t id, int type) {
+    info->id = id;
+    info->qtype = type;
+    info->bhardlimit = dq->dqb_bhardlimit;
+    info->bsoftlimit = dq->dqb_bsoftlimit;
+    info->curblocks = dq->dqb_curspace / 1024;
+    info->ihardlimit = dq->dqb_ihardlimit;
+    info->isoftlimit = dq->dqb_isoftlimit;
+    info->curinodes = dq->dqb_curinodes;
+    info->btime = dq->dqb_btime;
+    info->itime = dq->dqb_itime;
+}
+
+int ext4_handle_set_quota(quota_handle_t *handle, uint32_t id, int type,
+                          uint64_t bhard, uint64_t bsoft,
+                          uint64_t ihard, uint64_t isoft) {
+    if (!handle) {
+        return EINVAL;
     }
 
     struct if_dqblk dq;
@@ -268,224 +79,519 @@ int ext4_set_quota(const char *path, uint32_t id, int type,
     dq.dqb_isoftlimit = isoft;
     dq.dqb_valid = QIF_BLIMITS | QIF_ILIMITS;
 
-    int ret = quotactl(QCMD(Q_SETQUOTA, type), device_path, id, (caddr_t)&dq);
+    int ret = quota_handle_quotactl(handle, Q_SETQUOTA, type, id, &dq);
 
-    if (ret < 0) {
-        return errno;
+    if (ret != 0) {
+        return ret;
     }
 
     return 0;
 }
 
-int ext4_get_quota(const char *path, uint32_t id, int type, EXT4QuotaInfo *info) {
-    if (!path || !info) {
+int ext4_set_quota(const char *path, uint32_t id, int type,
+                    uint64_t bhard, uint64_t bsoft,
+                    uint64_t ihard, uint64_t isoft) {
+    if (!path) {
         return EINVAL;
     }
 
-    if (find_device_for_path(path) != 0) {
+    quota_handle_t *handle;
+    if (quota_handle_open(path, &handle) != 0) {
         return ENODEV;
     }
 
+    int ret = ext4_handle_set_quota(handle, id, type, bhard, bsoft, ihard, isoft);
+    quota_handle_close(handle);
+    return ret;
+}
+
+typedef struct {
+    quota_handle_t *handle;
+    const QuotaLimit *limits;
+    int *errors;
+} SetQuotasJob;
+
+static void set_quotas_one(size_t index, int worker, void *arg) {
+    (void)worker;
+    SetQuotasJob *job = (SetQuotasJob *)arg;
+    const QuotaLimit *l = &job->limits[index];
+    job->errors[index] = ext4_handle_set_quota(job->handle, l->id, (int)l->qtype,
+                                               l->bhardlimit, l->bsoftlimit,
+                                               l->ihardlimit, l->isoftlimit);
+}
+
+int ext4_handle_set_quotas(quota_handle_t *handle, const QuotaLimit *limits, size_t count,
+                           int *errors, int workers) {
+    if (!handle || (count > 0 && (!limits || !errors))) {
+        return EINVAL;
+    }
+
+    SetQuotasJob job = {handle, limits, errors};
+    quota_run_parallel(count, workers, set_quotas_one, &job);
+    return 0;
+}
+
+int ext4_set_quotas(const char *path, const QuotaLimit *limits, size_t count,
+                    int *errors, int workers) {
+    if (!path) {
+        return EINVAL;
+    }
+
+    quota_handle_t *handle;
+    if (quota_handle_open(path, &handle) != 0) {
+        return ENODEV;
+    }
+
+    int ret = ext4_handle_set_quotas(handle, limits, count, errors, workers);
+    quota_handle_close(handle);
+    return ret;
+}
+
+int ext4_handle_get_quota(quota_handle_t *handle, uint32_t id, int type, EXT4QuotaInfo *info) {
+    if (!handle || !info) {
+        return EINVAL;
+    }
+
     struct if_dqblk dq;
     memset(&dq, 0, sizeof(dq));
 
-    int ret = quotactl(QCMD(Q_GETQUOTA, type), device_path, id, (caddr_t)&dq);
+    int ret = quota_handle_quotactl(handle, Q_GETQUOTA, type, id, &dq);
 
-    if (ret < 0) {
-        return errno;
+    if (ret != 0) {
+        return ret;
     }
 
-    info->id = id;
-    info->qtype = type;
-    info->bhardlimit = dq.dqb_bhardlimit;
-    info->bsoftlimit = dq.dqb_bsoftlimit;
-    info->curblocks = dq.dqb_curspace / 1024;
-    info->ihardlimit = dq.dqb_ihardlimit;
-    info->isoftlimit = dq.dqb_isoftlimit;
-    info->curinodes = dq.dqb_curinodes;
-    info->btime = dq.dqb_btime;
-    info->itime = dq.dqb_itime;
+    fill_quota_info(info, &dq, id, type);
 
     return 0;
 }
 
-static int has_quota_set(const struct if_dqblk *dq) {
-    return (dq->dqb_bhardlimit > 0 || dq->dqb_bsoftlimit > 0 ||
-            dq->dqb_ihardlimit > 0 || dq->dqb_isoftlimit > 0 ||
-            dq->dqb_curspace > 0 || dq->dqb_curinodes > 0);
+int ext4_get_quota(const char *path, uint32_t id, int type, EXT4QuotaInfo *info) {
+    if (!path || !info) {
+        return EINVAL;
+    }
+
+    quota_handle_t *handle;
+    if (quota_handle_open(path, &handle) != 0) {
+        return ENODEV;
+    }
+
+    int ret = ext4_handle_get_quota(handle, id, type, info);
+    quota_handle_close(handle);
+    return ret;
+}
+static void fill_missing(EXT4QuotaInfo *info, uint32_t id, int type) {
+    memset(info, 0, sizeof(*info));
+    info->id = id;
+    info->qtype = type;
 }
 
-int ext4_list_quotas(const char *path, int type, EXT4QuotaList *list, int max_id) {
-    if (!path || !list) {
+int ext4_handle_get_quotas(quota_handle_t *handle, int type, const uint32_t *ids, size_t count,
+                           EXT4QuotaInfo *out, int *errors) {
+    if (!handle || (count > 0 && (!ids || !out || !errors))) {
+        return EINVAL;
+    }
+
+    QuotaIdSlot *slots;
+    int ret = quota_sort_ids(ids, count, &slots);
+    if (ret != 0) {
+        return ret;
+    }
+
+    QuotaCaps caps;
+    int use_next = quota_handle_caps(handle, type, &caps) == 0 && caps.getnextquota;
+    size_t i = 0;
+    while (i < count) {
+        uint32_t id = slots[i].id;
+        struct if_nextdqblk dq;
+        memset(&dq, 0, sizeof(dq));
+
+        int dense = use_next && i + 1 < count && slots[i + 1].id - id <= QUOTA_DENSE_GAP;
+        if (!dense) {
+            ret = quota_handle_quotactl(handle, Q_GETQUOTA, type, id, &dq);
+            for (; i < count && slots[i].id == id; i++) {
+                size_t k = slots[i].index;
+                if (ret == 0) {
+                    fill_quota_info(&out[k], (struct if_dqblk *)&dq, id, type);
+                    errors[k] = 0;
+                } else {
+                    fill_missing(&out[k], id, type);
+                    errors[k] = ret == ENOENT ? 0 : ret;
+                }
+            }
+            continue;
+        }
+
+        // 一次 Q_GETNEXTQUOTA 同时回答了 [id, 返回的 ID] 区间内所有待查 ID
+        ret = quota_handle_quotactl(handle, Q_GETNEXTQUOTA, type, id, &dq);
+        if (ret == EINVAL || ret == ENOSYS || (ret == 0 && dq.dqb_id < id)) {
+            use_next = 0;
+            continue;
+        }
+        if (ret != 0 && ret != ENOENT) {
+            for (; i < count && slots[i].id == id; i++) {
+                fill_missing(&out[slots[i].index], id, type);
+                errors[slots[i].index] = ret;
+            }
+            continue;
+        }
+
+        uint64_t found = ret == ENOENT ? QUOTA_CURSOR_END : dq.dqb_id;
+        for (; i < count && slots[i].id < found; i++) {
+            fill_missing(&out[slots[i].index], slots[i].id, type);
+            errors[slots[i].index] = 0;
+        }
+        for (; i < count && slots[i].id == found; i++) {
+            fill_quota_info(&out[slots[i].index], (struct if_dqblk *)&dq, dq.dqb_id, type);
+            errors[slots[i].index] = 0;
+        }
+    }
+
+    free(slots);
+    return 0;
+}
+
+int ext4_get_quotas(const char *path, int type, const uint32_t *ids, size_t count,
+                    EXT4QuotaInfo *out, int *errors) {
+    if (!path) {
         return EINVAL;
     }
 
-    if (find_device_for_path(path) != 0) {
+    quota_handle_t *handle;
+    if (quota_handle_open(path, &handle) != 0) {
         return ENODEV;
     }
 
-    EXT4QuotaInfo *items = NULL;
-    size_t count = 0;
-    size_t capacity = 1024;
+    int ret = ext4_handle_get_quotas(handle, type, ids, count, out, errors);
+    quota_handle_close(handle);
+    return ret;
+}
 
-    items = (EXT4QuotaInfo *)malloc(capacity * sizeof(EXT4QuotaInfo));
-    if (!items) {
-        return ENOMEM;
+
+// 不支持 Q_GETNEXTQUOTA 时逐个探测的默认上限
+#define EXT4_SCAN_DEFAULT_LIMIT 65536
+
+// 逐个探测时把 ID 空间切成窗口，窗口内再按段分给工作线程，每个线程持有自己的句柄。
+// 各段结果按段序拼接，输出仍按 ID 升序，窗口结果缓存在游标里逐批交付。
+#define EXT4_SCAN_RANGE 1024
+#define EXT4_SCAN_WINDOW_RANGES 16
+#define EXT4_SCAN_WINDOW (EXT4_SCAN_RANGE * EXT4_SCAN_WINDOW_RANGES)
+#define EXT4_SCAN_MAX_WORKERS 16
+
+struct ext4_quota_cursor {
+    quota_handle_t *handle;
+    int owns_handle;
+    int type;
+    int use_nextquota;
+    uint32_t max_id;
+    uint64_t next_id;
+    int workers;
+    quota_handle_t *worker_handles[EXT4_SCAN_MAX_WORKERS];
+    EXT4QuotaInfo *pending;
+    size_t pending_count;
+    size_t pending_pos;
+};
+
+typedef struct {
+    EXT4QuotaCursor *cursor;
+    uint64_t base;
+    uint64_t last;
+    size_t counts[EXT4_SCAN_WINDOW_RANGES];
+    int errors[EXT4_SCAN_WINDOW_RANGES];
+} ScanWindow;
+
+static int next_batch_nextquota(EXT4QuotaCursor *c, EXT4QuotaInfo *batch, int batch_size, int *count) {
+    int found = 0;
+
+    while (found < batch_size && c->next_id < QUOTA_CURSOR_END) {
+        struct if_nextdqblk dq;
+        memset(&dq, 0, sizeof(dq));
+
+        int ret = quota_handle_quotactl(c->handle, Q_GETNEXTQUOTA, c->type, (uint32_t)c->next_id, &dq);
+        if (ret == ENOENT || (ret == 0 && c->max_id > 0 && dq.dqb_id > c->max_id)) {
+            c->next_id = QUOTA_CURSOR_END;
+            break;
+        }
+        if (ret != 0) {
+            *count = found;
+            return ret;
+        }
+
+        c->next_id = (uint64_t)dq.dqb_id + 1;
+
+        if (!has_quota_set((struct if_dqblk *)&dq)) {
+            continue;
+        }
+
+        fill_quota_info(&batch[found++], (struct if_dqblk *)&dq, dq.dqb_id, c->type);
     }
 
-    int use_nextquota = 0;
-    if (check_kernel_version()) {
-        struct if_nextdqblk test_dq;
-        memset(&test_dq, 0, sizeof(test_dq));
-        int test_ret = quotactl(QCMD(Q_GETNEXTQUOTA, type), device_path, 0, (caddr_t)&test_dq);
-        if (test_ret >= 0) {
-            use_nextquota = 1;
+    *count = found;
+    return 0;
+}
+
+static void scan_range(size_t index, int worker, void *arg) {
+    ScanWindow *w = (ScanWindow *)arg;
+    EXT4QuotaCursor *c = w->cursor;
+    quota_handle_t *handle = c->worker_handles[worker] ? c->worker_handles[worker] : c->handle;
+    EXT4QuotaInfo *out = c->pending + index * EXT4_SCAN_RANGE;
+    uint64_t first = w->base + index * EXT4_SCAN_RANGE;
+    size_t n = 0;
+
+    w->errors[index] = 0;
+    for (uint64_t id = first; id < first + EXT4_SCAN_RANGE && id <= w->last; id++) {
+        struct if_dqblk dq;
+        memset(&dq, 0, sizeof(dq));
+
+        int ret = quota_handle_quotactl(handle, Q_GETQUOTA, c->type, (uint32_t)id, &dq);
+        if (ret == ENOENT) {
+            continue;
+        }
+        if (ret != 0) {
+            w->errors[index] = ret;
+            break;
+        }
+
+        if (has_quota_set(&dq)) {
+            fill_quota_info(&out[n++], &dq, (uint32_t)id, c->type);
         }
     }
+    w->counts[index] = n;
+}
 
-    if (use_nextquota) {
-        uint32_t next_id = 0;
-        while (next_id <= (uint32_t)max_id && count < 100000) {
-            struct if_nextdqblk dq;
-            memset(&dq, 0, sizeof(dq));
+static int scan_window(EXT4QuotaCursor *c, uint32_t limit) {
+    ScanWindow w;
+    memset(&w, 0, sizeof(w));
+    w.cursor = c;
+    w.base = c->next_id;
+    w.last = w.base + EXT4_SCAN_WINDOW - 1 < limit ? w.base + EXT4_SCAN_WINDOW - 1 : limit;
 
-            int ret = quotactl(QCMD(Q_GETNEXTQUOTA, type), device_path, next_id, (caddr_t)&dq);
+    size_t ranges = (size_t)((w.last - w.base) / EXT4_SCAN_RANGE + 1);
+    quota_run_parallel(ranges, c->workers, scan_range, &w);
 
-            if (ret < 0) {
-                break;
-            }
+    size_t total = 0;
+    for (size_t r = 0; r < ranges; r++) {
+        if (w.errors[r] != 0) {
+            return w.errors[r];
+        }
+        memmove(c->pending + total, c->pending + r * EXT4_SCAN_RANGE, w.counts[r] * sizeof(EXT4QuotaInfo));
+        total += w.counts[r];
+    }
 
-            if (!has_quota_set((struct if_dqblk *)&dq)) {
-                next_id = dq.dqb_id + 1;
-                continue;
-            }
+    c->pending_count = total;
+    c->pending_pos = 0;
+    c->next_id = w.last + 1;
+    return 0;
+}
 
-            EXT4QuotaInfo info;
-            info.id = dq.dqb_id;
-            info.qtype = type;
-            info.bhardlimit = dq.dqb_bhardlimit;
-            info.bsoftlimit = dq.dqb_bsoftlimit;
-            info.curblocks = dq.dqb_curspace / 1024;
-            info.ihardlimit = dq.dqb_ihardlimit;
-            info.isoftlimit = dq.dqb_isoftlimit;
-            info.curinodes = dq.dqb_curinodes;
-            info.btime = dq.dqb_btime;
-            info.itime = dq.dqb_itime;
-
-            if (count >= capacity) {
-                capacity *= 2;
-                EXT4QuotaInfo *new_items = (EXT4QuotaInfo *)realloc(items, capacity * sizeof(EXT4QuotaInfo));
-                if (!new_items) {
-                    free(items);
-                    return ENOMEM;
-                }
-                items = new_items;
+static int next_batch_scan(EXT4QuotaCursor *c, EXT4QuotaInfo *batch, int batch_size, int *count) {
+    uint32_t limit = c->max_id > 0 ? c->max_id : EXT4_SCAN_DEFAULT_LIMIT;
+    int found = 0;
+
+    while (found < batch_size) {
+        if (c->pending_pos < c->pending_count) {
+            size_t n = c->pending_count - c->pending_pos;
+            if (n > (size_t)(batch_size - found)) {
+                n = (size_t)(batch_size - found);
             }
-            items[count++] = info;
-            next_id = dq.dqb_id + 1;
+            memcpy(batch + found, c->pending + c->pending_pos, n * sizeof(EXT4QuotaInfo));
+            c->pending_pos += n;
+            found += (int)n;
+            continue;
         }
-    } else {
-        uint32_t scan_limit = (max_id > 0) ? (uint32_t)max_id : 65536;
-        uint32_t step = 1;
-        
-        if (scan_limit > 10000000) {
-            step = 100000;
-        } else if (scan_limit > 1000000) {
-            step = 10000;
-        } else if (scan_limit > 100000) {
-            step = 1000;
-        } else if (scan_limit > 10000) {
-            step = 100;
-        } else if (scan_limit > 1000) {
-            step = 10;
+
+        if (c->next_id >= QUOTA_CURSOR_END) {
+            break;
+        }
+        if (c->next_id > limit) {
+            c->next_id = QUOTA_CURSOR_END;
+            break;
         }
-        
-        int consecutive_errors = 0;
-        const int max_consecutive_errors = 1000;
-        
-        for (uint32_t id = 0; id <= scan_limit; id += step) {
-            struct if_dqblk dq;
-            memset(&dq, 0, sizeof(dq));
-
-            int ret = quotactl(QCMD(Q_GETQUOTA, type), device_path, id, (caddr_t)&dq);
-
-            if (ret < 0) {
-                consecutive_errors++;
-                if (consecutive_errors >= max_consecutive_errors) {
-                    break;
-                }
-                continue;
-            }
 
-            consecutive_errors = 0;
+        int ret = scan_window(c, limit);
+        if (ret != 0) {
+            *count = found;
+            return ret;
+        }
+    }
 
-            if (!has_quota_set(&dq)) {
-                continue;
-            }
+    *count = found;
+    return 0;
+}
 
-            EXT4QuotaInfo info;
-            info.id = id;
-            info.qtype = type;
-            info.bhardlimit = dq.dqb_bhardlimit;
-            info.bsoftlimit = dq.dqb_bsoftlimit;
-            info.curblocks = dq.dqb_curspace / 1024;
-            info.ihardlimit = dq.dqb_ihardlimit;
-            info.isoftlimit = dq.dqb_isoftlimit;
-            info.curinodes = dq.dqb_curinodes;
-            info.btime = dq.dqb_btime;
-            info.itime = dq.dqb_itime;
-
-            if (count >= capacity) {
-                capacity *= 2;
-                EXT4QuotaInfo *new_items = (EXT4QuotaInfo *)realloc(items, capacity * sizeof(EXT4QuotaInfo));
-                if (!new_items) {
-                    free(items);
-                    return ENOMEM;
-                }
-                items = new_items;
+static int scan_workers(void) {
+    long cpus = sysconf(_SC_NPROCESSORS_ONLN);
+    if (cpus < 1) {
+        return 1;
+    }
+    return cpus < EXT4_SCAN_MAX_WORKERS ? (int)cpus : EXT4_SCAN_MAX_WORKERS;
+}
+
+int ext4_handle_list_begin(quota_handle_t *handle, int type, uint64_t token, int max_id, EXT4QuotaCursor **cursor) {
+    if (!handle || !cursor) {
+        return EINVAL;
+    }
+
+    EXT4QuotaCursor *c = (EXT4QuotaCursor *)calloc(1, sizeof(EXT4QuotaCursor));
+    if (!c) {
+        return ENOMEM;
+    }
+
+    c->handle = handle;
+    c->type = type;
+    c->max_id = max_id > 0 ? (uint32_t)max_id : 0;
+    c->next_id = token;
+
+    // 能力探测失败（例如配额未开启）时按逐个探测处理，错误会在 ext4_list_next 中返回
+    QuotaCaps caps;
+    if (quota_handle_caps(handle, type, &caps) == 0) {
+        c->use_nextquota = caps.getnextquota;
+    }
+
+    if (!c->use_nextquota) {
+        c->pending = (EXT4QuotaInfo *)malloc(EXT4_SCAN_WINDOW * sizeof(EXT4QuotaInfo));
+        if (!c->pending) {
+            free(c);
+            return ENOMEM;
+        }
+
+        // 工作线程 0 使用调用方的句柄，复制失败的线程也退回共用它
+        c->workers = scan_workers();
+        for (int i = 1; i < c->workers; i++) {
+            if (quota_handle_dup(handle, &c->worker_handles[i]) != 0) {
+                c->worker_handles[i] = NULL;
             }
-            items[count++] = info;
-            
-            if (step > 1) {
-                for (uint32_t check_id = id + 1; check_id < id + step && check_id <= scan_limit; check_id++) {
-                    struct if_dqblk check_dq;
-                    memset(&check_dq, 0, sizeof(check_dq));
-                    int check_ret = quotactl(QCMD(Q_GETQUOTA, type), device_path, check_id, (caddr_t)&check_dq);
-                    if (check_ret >= 0 && has_quota_set(&check_dq)) {
-                        EXT4QuotaInfo check_info;
-                        check_info.id = check_id;
-                        check_info.qtype = type;
-                        check_info.bhardlimit = check_dq.dqb_bhardlimit;
-                        check_info.bsoftlimit = check_dq.dqb_bsoftlimit;
-                        check_info.curblocks = check_dq.dqb_curspace / 1024;
-                        check_info.ihardlimit = check_dq.dqb_ihardlimit;
-                        check_info.isoftlimit = check_dq.dqb_isoftlimit;
-                        check_info.curinodes = check_dq.dqb_curinodes;
-                        check_info.btime = check_dq.dqb_btime;
-                        check_info.itime = check_dq.dqb_itime;
-
-                        if (count >= capacity) {
-                            capacity *= 2;
-                            EXT4QuotaInfo *new_items = (EXT4QuotaInfo *)realloc(items, capacity * sizeof(EXT4QuotaInfo));
-                            if (!new_items) {
-                                free(items);
-                                return ENOMEM;
-                            }
-                            items = new_items;
-                        }
-                        items[count++] = check_info;
-                    }
-                }
+        }
+    }
+
+    *cursor = c;
+    return 0;
+}
+
+int ext4_list_begin(const char *path, int type, uint64_t token, int max_id, EXT4QuotaCursor **cursor) {
+    if (!path || !cursor) {
+        return EINVAL;
+    }
+
+    quota_handle_t *handle;
+    if (quota_handle_open(path, &handle) != 0) {
+        return ENODEV;
+    }
+
+    int ret = ext4_handle_list_begin(handle, type, token, max_id, cursor);
+    if (ret != 0) {
+        quota_handle_close(handle);
+        return ret;
+    }
+
+    (*cursor)->owns_handle = 1;
+    return 0;
+}
+
+int ext4_list_next(EXT4QuotaCursor *cursor, EXT4QuotaInfo *batch, int batch_size, int *count, int *more) {
+    if (!cursor || !batch || batch_size <= 0 || !count || !more) {
+        return EINVAL;
+    }
+
+    int ret;
+    if (cursor->use_nextquota) {
+        ret = next_batch_nextquota(cursor, batch, batch_size, count);
+    } else {
+        ret = next_batch_scan(cursor, batch, batch_size, count);
+    }
+    *more = ext4_list_token(cursor) < QUOTA_CURSOR_END;
+    return ret;
+}
+
+uint64_t ext4_list_token(const EXT4QuotaCursor *cursor) {
+    // 窗口里还有未交付的记录时，从第一条未交付记录的 ID 续传
+    if (cursor->pending_pos < cursor->pending_count) {
+        return cursor->pending[cursor->pending_pos].id;
+    }
+    return cursor->next_id;
+}
+
+void ext4_list_end(EXT4QuotaCursor *cursor) {
+    if (!cursor) {
+        return;
+    }
+    for (int i = 1; i < cursor->workers; i++) {
+        quota_handle_close(cursor->worker_handles[i]);
+    }
+    free(cursor->pending);
+    if (cursor->owns_handle) {
+        quota_handle_close(cursor->handle);
+    }
+    free(cursor);
+}
+
+int ext4_handle_list_quotas(quota_handle_t *handle, int type, EXT4QuotaList *list, int max_id) {
+    if (!handle || !list) {
+        return EINVAL;
+    }
+
+    EXT4QuotaCursor *cursor;
+    int ret = ext4_handle_list_begin(handle, type, 0, max_id, &cursor);
+    if (ret != 0) {
+        return ret;
+    }
+
+    QuotaCaps caps;
+    size_t count = 0;
+    size_t capacity = quota_caps_capacity(quota_handle_caps(handle, type, &caps) == 0 ? &caps : NULL, 64);
+    EXT4QuotaInfo *items = (EXT4QuotaInfo *)malloc(capacity * sizeof(EXT4QuotaInfo));
+    if (!items) {
+        ext4_list_end(cursor);
+        return ENOMEM;
+    }
+
+    while (ext4_list_token(cursor) < QUOTA_CURSOR_END) {
+        if (count >= capacity) {
+            capacity *= 2;
+            EXT4QuotaInfo *new_items = (EXT4QuotaInfo *)realloc(items, capacity * sizeof(EXT4QuotaInfo));
+            if (!new_items) {
+                free(items);
+                ext4_list_end(cursor);
+                return ENOMEM;
             }
+            items = new_items;
+        }
+
+        int found = 0;
+        int more = 0;
+        ret = ext4_list_next(cursor, items + count, (int)(capacity - count), &found, &more);
+        count += found;
+        if (ret != 0) {
+            free(items);
+            ext4_list_end(cursor);
+            return ret;
         }
     }
 
+    ext4_list_end(cursor);
+
     list->items = items;
     list->count = count;
+    list->capacity = capacity;
 
     return 0;
 }
 
+int ext4_list_quotas(const char *path, int type, EXT4QuotaList *list, int max_id) {
+    if (!path || !list) {
+        return EINVAL;
+    }
+
+    quota_handle_t *handle;
+    if (quota_handle_open(path, &handle) != 0) {
+        return ENODEV;
+    }
+
+    int ret = ext4_handle_list_quotas(handle, type, list, max_id);
+    quota_handle_close(handle);
+    return ret;
+}
+
 void ext4_free_quota_list(EXT4QuotaList *list) {
     if (list && list->items) {
         free(list->items);
@@ -494,45 +600,52 @@ void ext4_free_quota_list(EXT4QuotaList *list) {
     }
 }
 
-int ext4_remove_quota(const char *path, uint32_t id, int type) {
-    if (!path) {
+int ext4_handle_remove_quota(quota_handle_t *handle, uint32_t id, int type) {
+    if (!handle) {
         return EINVAL;
     }
 
-    if (find_device_for_path(path) != 0) {
-        return ENODEV;
-    }
-
     struct if_dqblk dq;
     memset(&dq, 0, sizeof(dq));
 
     dq.dqb_valid = QIF_BLIMITS | QIF_ILIMITS;
 
-    int ret = quotactl(QCMD(Q_SETQUOTA, type), device_path, id, (caddr_t)&dq);
+    int ret = quota_handle_quotactl(handle, Q_SETQUOTA, type, id, &dq);
 
-    if (ret < 0) {
-        return errno;
+    if (ret != 0) {
+        return ret;
     }
 
     return 0;
 }
 
-int ext4_test_quota(const char *path, uint32_t id, int type) {
+int ext4_remove_quota(const char *path, uint32_t id, int type) {
     if (!path) {
         return EINVAL;
     }
 
-    if (find_device_for_path(path) != 0) {
+    quota_handle_t *handle;
+    if (quota_handle_open(path, &handle) != 0) {
         return ENODEV;
     }
 
+    int ret = ext4_handle_remove_quota(handle, id, type);
+    quota_handle_close(handle);
+    return ret;
+}
+
+int ext4_handle_test_quota(quota_handle_t *handle, uint32_t id, int type) {
+    if (!handle) {
+        return EINVAL;
+    }
+
     struct if_dqblk dq;
     memset(&dq, 0, sizeof(dq));
 
-    int ret = quotactl(QCMD(Q_GETQUOTA, type), device_path, id, (caddr_t)&dq);
+    int ret = quota_handle_quotactl(handle, Q_GETQUOTA, type, id, &dq);
 
-    if (ret < 0) {
-        return errno;
+    if (ret != 0) {
+        return ret;
     }
 
     if (dq.dqb_bhardlimit == 0 && dq.dqb_bsoftlimit == 0 &&
@@ -542,3 +655,18 @@ int ext4_test_quota(const char *path, uint32_t id, int type) {
 
     return 0;
 }
+
+int ext4_test_quota(const char *path, uint32_t id, int type) {
+    if (!path) {
+        return EINVAL;
+    }
+
+    quota_handle_t *handle;
+    if (quota_handle_open(path, &handle) != 0) {
+        return ENODEV;
+    }
+
+    int ret = ext4_handle_test_quota(handle, id, type);
+    quota_handle_close(handle);
+    return ret;
+}
@@ -4,50 +4,102 @@
 #include <stdint.h>
 #include <linux/quota.h>
 #include <sys/quota.h>
+#include "../common/quota_common.h"
 
 #ifdef __cplusplus
 extern "C" {
 #endif
 
-typedef struct {
-    uint32_t id;
-    int qtype;
-    uint64_t bhardlimit;
-    uint64_t bsoftlimit;
-    uint64_t curblocks;
-    uint64_t ihardlimit;
-    uint64_t isoftlimit;
-    uint64_t curinodes;
-    uint64_t btime;
-    uint64_t itime;
-} EXT4QuotaInfo;
-
-typedef struct {
-    EXT4QuotaInfo *items;
-    size_t count;
-    size_t capacity;
-} EXT4QuotaList;
+typedef QuotaRecord EXT4QuotaInfo;
+
+typedef QuotaRecordList EXT4QuotaList;
+
+typedef struct ext4_quota_cursor EXT4QuotaCursor;
 
 int ext4_set_quota(const char *path, uint32_t id, int type,
                     uint64_t bhard, uint64_t bsoft,
                     uint64_t ihard, uint64_t isoft);
 
+int ext4_handle_set_quota(quota_handle_t *handle, uint32_t id, int type,
+                          uint64_t bhard, uint64_t bsoft,
+                          uint64_t ihard, uint64_t isoft);
+
+// 解析一次设备后依次应用 limits；errors[i] 为第 i 条的结果（0 或 errno）
+int ext4_set_quotas(const char *path, const QuotaLimit *limits, size_t count,
+                    int *errors, int workers);
+
+int ext4_handle_set_quotas(quota_handle_t *handle, const QuotaLimit *limits, size_t count,
+                           int *errors, int workers);
+
 int ext4_get_quota(const char *path, uint32_t id, int type, EXT4QuotaInfo *info);
 
+int ext4_handle_get_quota(quota_handle_t *handle, uint32_t id, int type, EXT4QuotaInfo *info);
+
+// 查询一组 ID：结果按输入顺序写入 out，errors[i] 为第 i 个 ID 的结果。
+// 没有配额记录的 ID 得到一条全零记录，不视为错误。
+int ext4_get_quotas(const char *path, int type, const uint32_t *ids, size_t count,
+                    EXT4QuotaInfo *out, int *errors);
+
+int ext4_handle_get_quotas(quota_handle_t *handle, int type, const uint32_t *ids, size_t count,
+                           EXT4QuotaInfo *out, int *errors);
+
 int ext4_list_quotas(const char *path, int type, EXT4QuotaList *list, int max_id);
 
+int ext4_handle_list_quotas(quota_handle_t *handle, int type, EXT4QuotaList *list, int max_id);
+
+int ext4_list_begin(const char *path, int type, uint64_t token, int max_id, EXT4QuotaCursor **cursor);
+
+int ext4_handle_list_begin(quota_handle_t *handle, int type, uint64_t token, int max_id, EXT4QuotaCursor **cursor);
+
+// 把最多 batch_size 条记录写入调用方缓冲区；*more 为 0 表示枚举已结束
+int ext4_list_next(EXT4QuotaCursor *cursor, EXT4QuotaInfo *batch, int batch_size, int *count, int *more);
+
+uint64_t ext4_list_token(const EXT4QuotaCursor *cursor);
+
+void ext4_list_end(EXT4QuotaCursor *cursor);
+
 int ext4_list_quotas_direct(const char *path, int type, EXT4QuotaList *list, int max_id);
 
 int ext4_list_quotas_direct_debug(const char *path, int type, EXT4QuotaList *list, int max_id, char *error_msg, size_t error_msg_size);
 
+int ext4_parse_quota_tree(const void *data, size_t size, int type, EXT4QuotaList *list, int max_id);
+
+// *_into 系列写入调用方提供的缓冲区：*count 为找到的记录总数，
+// 超过 capacity 时只写入前 capacity 条并置 *more，调用方按 *count 扩容后重试
+int ext4_parse_quota_tree_into(const void *data, size_t size, int type, int max_id,
+                               EXT4QuotaInfo *items, size_t capacity, size_t *count, int *more);
+
+int ext4_list_quotas_direct_into(const char *path, int type, int max_id,
+                                 EXT4QuotaInfo *items, size_t capacity, size_t *count, int *more);
+
+int ext4_handle_list_quotas_direct_into(quota_handle_t *handle, int type, int max_id,
+                                        EXT4QuotaInfo *items, size_t capacity, size_t *count, int *more);
+
 int ext4_list_quotas_fast(const char *path, int type, EXT4QuotaList *list, int max_id);
 
+int ext4_list_quotas_fast_into(const char *path, int type, int max_id,
+                               EXT4QuotaInfo *items, size_t capacity, size_t *count, int *more);
+
+int ext4_handle_list_quotas_fast_into(quota_handle_t *handle, int type, int max_id,
+                                      EXT4QuotaInfo *items, size_t capacity, size_t *count, int *more);
+
+// 候选 ID 发现：汇总 /etc/passwd、/etc/group、/etc/projid、/etc/projects 与挂载点顶层目录中的 ID，
+// 可选补扫 [0, backfill]；结果升序去重，由调用方 free
+int ext4_seed_ids(const char *path, int type, uint32_t backfill, uint32_t **ids, size_t *count);
+
+// 只查询候选 ID，适用于不支持 Q_GETNEXTQUOTA 的旧内核
+int ext4_list_quotas_seeded(const char *path, int type, EXT4QuotaList *list, int max_id, uint32_t backfill);
+
 void ext4_free_quota_list(EXT4QuotaList *list);
 
 int ext4_remove_quota(const char *path, uint32_t id, int type);
 
+int ext4_handle_remove_quota(quota_handle_t *handle, uint32_t id, int type);
+
 int ext4_test_quota(const char *path, uint32_t id, int type);
 
+int ext4_handle_test_quota(quota_handle_t *handle, uint32_t id, int type);
+
 const char* ext4_error_string(int error_code);
 
 #ifdef __cplusplus
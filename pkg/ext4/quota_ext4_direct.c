@@ -4,212 +4,395 @@
 #include <errno.h>
 #include <unistd.h>
 #include <fcntl.h>
-#include <mntent.h>
+#include <endian.h>
+#include <sys/mman.h>
 #include <sys/stat.h>
 #include <sys/types.h>
 #include <linux/quota.h>
 #include <limits.h>
 #include "quota_ext4.h"
 
-#define QUOTA_VERSION "2.1"
-#define V2_DQBLK_SIZE 148
+// vfsv0/vfsv1 配额文件格式（内核 fs/quota/quotaio_v2.h 与 quota_tree.h）：
+// 文件头之后是 1 KiB 块组成的 4 层基数树，根在第 1 块，叶子指向存放 dquot 条目的数据块。
+#define QT_BLKSIZE 1024
+#define QT_TREEOFF 1
+#define QT_TREEDEPTH 4
+#define QT_REFS_PER_BLOCK (QT_BLKSIZE / sizeof(uint32_t))
 
-static char quota_file_path[PATH_MAX] = {0};
+struct v2_disk_dqheader {
+    uint32_t dqh_magic;
+    uint32_t dqh_version;
+};
 
-static int find_quota_file(const char *path, int type) {
-    FILE *fp = setmntent("/proc/mounts", "r");
-    if (!fp) {
-        return -1;
-    }
+struct qt_disk_dqdbheader {
+    uint32_t dqdh_next_free;
+    uint32_t dqdh_prev_free;
+    uint16_t dqdh_entries;
+    uint16_t dqdh_pad1;
+    uint32_t dqdh_pad2;
+};
 
-    const char *quota_file = NULL;
+struct v2r0_disk_dqblk {
+    uint32_t dqb_id;
+    uint32_t dqb_ihardlimit;
+    uint32_t dqb_isoftlimit;
+    uint32_t dqb_curinodes;
+    uint32_t dqb_bhardlimit;
+    uint32_t dqb_bsoftlimit;
+    uint64_t dqb_curspace;
+    uint64_t dqb_btime;
+    uint64_t dqb_itime;
+} __attribute__((packed));
+
+struct v2r1_disk_dqblk {
+    uint32_t dqb_id;
+    uint32_t dqb_pad;
+    uint64_t dqb_ihardlimit;
+    uint64_t dqb_isoftlimit;
+    uint64_t dqb_curinodes;
+    uint64_t dqb_bhardlimit;
+    uint64_t dqb_bsoftlimit;
+    uint64_t dqb_curspace;
+    uint64_t dqb_btime;
+    uint64_t dqb_itime;
+} __attribute__((packed));
+
+static const uint32_t v2_quota_magics[] = {0xd9c01f11, 0xd9c01927, 0xd9c03f14};
+
+typedef struct {
+    const unsigned char *data;
+    size_t blocks;
+    int type;
+    int revision;
+    uint32_t max_id;
+    unsigned char *visited;
+    EXT4QuotaInfo *items;
+    size_t capacity;
+    size_t count;
+} QuotaTreeWalk;
+
+static const char *quota_file_name(int type) {
     if (type == USRQUOTA) {
-        quota_file = "aquota.user";
+        return "aquota.user";
     } else if (type == GRPQUOTA) {
-        quota_file = "aquota.group";
+        return "aquota.group";
     } else if (type == PRJQUOTA) {
-        quota_file = "aquota.project";
+        return "aquota.project";
     }
+    return NULL;
+}
 
+static int find_quota_file(const char *path, int type, char *quota_file_path, size_t size) {
+    const char *quota_file = quota_file_name(type);
     if (!quota_file) {
-        endmntent(fp);
         return -1;
     }
 
-    struct mntent *ent;
-    while ((ent = getmntent(fp)) != NULL) {
-        if (strcmp(ent->mnt_dir, path) == 0) {
-            endmntent(fp);
-            snprintf(quota_file_path, PATH_MAX, "%s/%s", path, quota_file);
+    QuotaMountEntry entry;
+    if (quota_mount_lookup(path, &entry) == 0) {
+        path = entry.mount_point;
+    }
+
+    snprintf(quota_file_path, size, "%s/%s", path, quota_file);
+    return 0;
+}
+
+static int is_entry_unused(const unsigned char *entry, size_t size) {
+    for (size_t i = 0; i < size; i++) {
+        if (entry[i] != 0) {
             return 0;
         }
     }
+    return 1;
+}
 
-    endmntent(fp);
+static int decode_data_block(QuotaTreeWalk *walk, uint32_t blk) {
+    const unsigned char *block = walk->data + (size_t)blk * QT_BLKSIZE;
+    size_t entry_size = walk->revision == 0 ? sizeof(struct v2r0_disk_dqblk) : sizeof(struct v2r1_disk_dqblk);
+    size_t entries = (QT_BLKSIZE - sizeof(struct qt_disk_dqdbheader)) / entry_size;
+    const unsigned char *p = block + sizeof(struct qt_disk_dqdbheader);
 
-    snprintf(quota_file_path, PATH_MAX, "%s/%s", path, quota_file);
-    return 0;
-}
+    for (size_t i = 0; i < entries; i++, p += entry_size) {
+        if (is_entry_unused(p, entry_size)) {
+            continue;
+        }
 
-struct v2_disk_dqinfo {
-    __u32 dqi_bgrace;
-    __u32 dqi_igrace;
-    __u32 dqi_flags;
-    __u32 dqi_blocks;
-    __u32 dqi_free_blk;
-    __u32 dqi_free_entry;
-};
+        EXT4QuotaInfo info;
+        info.qtype = walk->type;
+        if (walk->revision == 0) {
+            const struct v2r0_disk_dqblk *d = (const struct v2r0_disk_dqblk *)p;
+            info.id = le32toh(d->dqb_id);
+            info.ihardlimit = le32toh(d->dqb_ihardlimit);
+            info.isoftlimit = le32toh(d->dqb_isoftlimit);
+            info.curinodes = le32toh(d->dqb_curinodes);
+            info.bhardlimit = le32toh(d->dqb_bhardlimit);
+            info.bsoftlimit = le32toh(d->dqb_bsoftlimit);
+            info.curblocks = le64toh(d->dqb_curspace) / 1024;
+            info.btime = le64toh(d->dqb_btime);
+            info.itime = le64toh(d->dqb_itime);
+        } else {
+            const struct v2r1_disk_dqblk *d = (const struct v2r1_disk_dqblk *)p;
+            info.id = le32toh(d->dqb_id);
+            info.ihardlimit = le64toh(d->dqb_ihardlimit);
+            info.isoftlimit = le64toh(d->dqb_isoftlimit);
+            info.curinodes = le64toh(d->dqb_curinodes);
+            info.bhardlimit = le64toh(d->dqb_bhardlimit);
+            info.bsoftlimit = le64toh(d->dqb_bsoftlimit);
+            info.curblocks = le64toh(d->dqb_curspace) / 1024;
+            info.btime = le64toh(d->dqb_btime);
+            info.itime = le64toh(d->dqb_itime);
+        }
 
-struct v2_disk_dqblk {
-    __u32 dqb_id;
-    __u32 dqb_ihardlimit;
-    __u32 dqb_isoftlimit;
-    __u32 dqb_curinodes;
-    __u32 dqb_bhardlimit;
-    __u32 dqb_bsoftlimit;
-    __u64 dqb_curspace;
-    __u64 dqb_btime;
-    __u64 dqb_itime;
-};
+        if (walk->max_id > 0 && info.id > walk->max_id) {
+            continue;
+        }
 
-static int read_quota_file(const char *path, int type, EXT4QuotaList *list) {
-    if (find_quota_file(path, type) != 0) {
-        return ENOENT;
-    }
+        if (info.bhardlimit == 0 && info.bsoftlimit == 0 &&
+            info.ihardlimit == 0 && info.isoftlimit == 0 &&
+            info.curblocks == 0 && info.curinodes == 0) {
+            continue;
+        }
 
-    int fd = open(quota_file_path, O_RDONLY);
-    if (fd < 0) {
-        return errno;
+        // 缓冲区写满后只计数，调用方据此扩容重试
+        if (walk->count < walk->capacity) {
+            walk->items[walk->count] = info;
+        }
+        walk->count++;
     }
 
-    struct v2_disk_dqinfo dqinfo;
-    if (read(fd, &dqinfo, sizeof(dqinfo)) != sizeof(dqinfo)) {
-        close(fd);
-        return EIO;
-    }
+    return 0;
+}
 
-    list->count = 0;
-    list->capacity = 1024;
-    list->items = (EXT4QuotaInfo *)malloc(list->capacity * sizeof(EXT4QuotaInfo));
-    if (!list->items) {
-        close(fd);
-        return ENOMEM;
+static int walk_tree_block(QuotaTreeWalk *walk, uint32_t blk, int depth) {
+    if (blk < QT_TREEOFF || blk >= walk->blocks) {
+        return EIO;
     }
 
-#define BUFFER_SIZE 4096
-    struct v2_disk_dqblk buffer[BUFFER_SIZE];
-    ssize_t bytes_read;
-    int i;
+    const uint32_t *refs = (const uint32_t *)(walk->data + (size_t)blk * QT_BLKSIZE);
+    for (size_t i = 0; i < QT_REFS_PER_BLOCK; i++) {
+        uint32_t ref = le32toh(refs[i]);
+        if (ref == 0) {
+            continue;
+        }
 
-    while ((bytes_read = read(fd, buffer, sizeof(buffer))) > 0) {
-        int count = bytes_read / sizeof(struct v2_disk_dqblk);
-        
-        for (i = 0; i < count; i++) {
-            if (buffer[i].dqb_id == 0 || buffer[i].dqb_id == ~0U) {
-                continue;
+        int ret;
+        if (depth == QT_TREEDEPTH - 1) {
+            if (ref >= walk->blocks) {
+                return EIO;
             }
-
-            if (list->count >= list->capacity) {
-                list->capacity *= 2;
-                EXT4QuotaInfo *new_items = (EXT4QuotaInfo *)realloc(list->items, list->capacity * sizeof(EXT4QuotaInfo));
-                if (!new_items) {
-                    free(list->items);
-                    list->items = NULL;
-                    close(fd);
-                    return ENOMEM;
-                }
-                list->items = new_items;
+            // 同一数据块会被多个叶子引用，只解码一次
+            if (walk->visited[ref >> 3] & (1 << (ref & 7))) {
+                continue;
             }
+            walk->visited[ref >> 3] |= 1 << (ref & 7);
+            ret = decode_data_block(walk, ref);
+        } else {
+            ret = walk_tree_block(walk, ref, depth + 1);
+        }
 
-            EXT4QuotaInfo *info = &list->items[list->count];
-            info->id = buffer[i].dqb_id;
-            info->qtype = type;
-            info->bhardlimit = buffer[i].dqb_bhardlimit;
-            info->bsoftlimit = buffer[i].dqb_bsoftlimit;
-            info->curblocks = buffer[i].dqb_curspace / 1024;
-            info->ihardlimit = buffer[i].dqb_ihardlimit;
-            info->isoftlimit = buffer[i].dqb_isoftlimit;
-            info->curinodes = buffer[i].dqb_curinodes;
-            info->btime = buffer[i].dqb_btime;
-            info->itime = buffer[i].dqb_itime;
-            
-            list->count++;
+        if (ret != 0) {
+            return ret;
         }
     }
 
-    close(fd);
     return 0;
 }
 
-int ext4_list_quotas_direct(const char *path, int type, EXT4QuotaList *list, int max_id) {
-    if (!path || !list) {
+int ext4_parse_quota_tree_into(const void *data, size_t size, int type, int max_id,
+                               EXT4QuotaInfo *items, size_t capacity, size_t *count, int *more) {
+    if (!data || (!items && capacity > 0) || !count || !more || type < 0 || type > 2) {
         return EINVAL;
     }
 
-    list->count = 0;
-    list->capacity = 1024;
-    list->items = (EXT4QuotaInfo *)malloc(list->capacity * sizeof(EXT4QuotaInfo));
-    if (!list->items) {
+    if (size < 2 * QT_BLKSIZE) {
+        return EIO;
+    }
+
+    const struct v2_disk_dqheader *header = (const struct v2_disk_dqheader *)data;
+    uint32_t version = le32toh(header->dqh_version);
+    if (le32toh(header->dqh_magic) != v2_quota_magics[type] || version > 1) {
+        return EINVAL;
+    }
+
+    QuotaTreeWalk walk;
+    walk.data = (const unsigned char *)data;
+    walk.blocks = size / QT_BLKSIZE;
+    walk.type = type;
+    walk.revision = (int)version;
+    walk.max_id = max_id > 0 ? (uint32_t)max_id : 0;
+    walk.items = items;
+    walk.capacity = capacity;
+    walk.count = 0;
+    walk.visited = (unsigned char *)calloc((walk.blocks + 7) / 8, 1);
+    if (!walk.visited) {
         return ENOMEM;
     }
 
-    int ret = read_quota_file(path, type, list);
+    int ret = walk_tree_block(&walk, QT_TREEOFF, 0);
+    free(walk.visited);
+
     if (ret != 0) {
-        free(list->items);
-        list->items = NULL;
         return ret;
     }
 
+    *count = walk.count;
+    *more = walk.count > capacity;
     return 0;
 }
 
-int ext4_list_quotas_direct_debug(const char *path, int type, EXT4QuotaList *list, int max_id, char *error_msg, size_t error_msg_size) {
-    if (!path || !list) {
-        snprintf(error_msg, error_msg_size, "Invalid arguments");
+int ext4_parse_quota_tree(const void *data, size_t size, int type, EXT4QuotaList *list, int max_id) {
+    if (!list) {
         return EINVAL;
     }
 
+    list->items = NULL;
     list->count = 0;
-    list->capacity = 1024;
-    list->items = (EXT4QuotaInfo *)malloc(list->capacity * sizeof(EXT4QuotaInfo));
-    if (!list->items) {
-        snprintf(error_msg, error_msg_size, "Memory allocation failed");
-        return ENOMEM;
-    }
+    list->capacity = 0;
 
-    if (find_quota_file(path, type) != 0) {
-        snprintf(error_msg, error_msg_size, "find_quota_file failed for path=%s, type=%d", path, type);
-        free(list->items);
-        list->items = NULL;
-        return ENOENT;
-    }
+    size_t capacity = 1024;
+    for (;;) {
+        EXT4QuotaInfo *items = (EXT4QuotaInfo *)malloc(capacity * sizeof(EXT4QuotaInfo));
+        if (!items) {
+            return ENOMEM;
+        }
 
-    snprintf(error_msg, error_msg_size, "quota_file_path=%s", quota_file_path);
+        size_t count = 0;
+        int more = 0;
+        int ret = ext4_parse_quota_tree_into(data, size, type, max_id, items, capacity, &count, &more);
+        if (ret != 0) {
+            free(items);
+            return ret;
+        }
+
+        if (!more) {
+            list->items = items;
+            list->count = count;
+            list->capacity = capacity;
+            return 0;
+        }
+
+        free(items);
+        capacity = count;
+    }
+}
 
-    int fd = open(quota_file_path, O_RDONLY);
+// 以 mmap 方式读取配额文件，只解码树中实际引用的数据块。
+// 注意：内核会延迟回写 dquot，文件内容可能略落后于 quotactl 的结果。
+static int map_quota_file(const char *quota_file_path, void **data, size_t *size) {
+    int fd = open(quota_file_path, O_RDONLY | O_CLOEXEC);
     if (fd < 0) {
-        snprintf(error_msg, error_msg_size, "open failed for %s: %s", quota_file_path, strerror(errno));
-        free(list->items);
-        list->items = NULL;
         return errno;
     }
 
-    struct v2_disk_dqinfo dqinfo;
-    if (read(fd, &dqinfo, sizeof(dqinfo)) != sizeof(dqinfo)) {
-        snprintf(error_msg, error_msg_size, "read dqinfo failed");
+    struct stat st;
+    if (fstat(fd, &st) != 0) {
+        int err = errno;
+        close(fd);
+        return err;
+    }
+
+    if (st.st_size < 2 * QT_BLKSIZE) {
         close(fd);
-        free(list->items);
-        list->items = NULL;
         return EIO;
     }
 
+    void *map = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
     close(fd);
+    if (map == MAP_FAILED) {
+        return errno;
+    }
+
+    madvise(map, st.st_size, MADV_WILLNEED);
+
+    *data = map;
+    *size = st.st_size;
+    return 0;
+}
+
+static int read_quota_file(const char *quota_file_path, int type, EXT4QuotaList *list, int max_id) {
+    void *data;
+    size_t size;
+    int ret = map_quota_file(quota_file_path, &data, &size);
+    if (ret != 0) {
+        return ret;
+    }
+
+    ret = ext4_parse_quota_tree(data, size, type, list, max_id);
+    munmap(data, size);
+    return ret;
+}
+
+static int list_direct_into(const char *quota_file_path, int type, int max_id,
+                            EXT4QuotaInfo *items, size_t capacity, size_t *count, int *more) {
+    void *data;
+    size_t size;
+    int ret = map_quota_file(quota_file_path, &data, &size);
+    if (ret != 0) {
+        return ret;
+    }
+
+    ret = ext4_parse_quota_tree_into(data, size, type, max_id, items, capacity, count, more);
+    munmap(data, size);
+    return ret;
+}
+
+int ext4_list_quotas_direct_into(const char *path, int type, int max_id,
+                                 EXT4QuotaInfo *items, size_t capacity, size_t *count, int *more) {
+    if (!path) {
+        return EINVAL;
+    }
+
+    char quota_file_path[PATH_MAX];
+    if (find_quota_file(path, type, quota_file_path, sizeof(quota_file_path)) != 0) {
+        return ENOENT;
+    }
+
+    return list_direct_into(quota_file_path, type, max_id, items, capacity, count, more);
+}
+
+// 句柄已经带着挂载点，不再查挂载表
+int ext4_handle_list_quotas_direct_into(quota_handle_t *handle, int type, int max_id,
+                                        EXT4QuotaInfo *items, size_t capacity, size_t *count, int *more) {
+    const char *quota_file = quota_file_name(type);
+    if (!handle || !quota_file) {
+        return EINVAL;
+    }
+
+    char quota_file_path[PATH_MAX];
+    snprintf(quota_file_path, sizeof(quota_file_path), "%s/%s", quota_handle_mount_point(handle), quota_file);
+    return list_direct_into(quota_file_path, type, max_id, items, capacity, count, more);
+}
+
+int ext4_list_quotas_direct(const char *path, int type, EXT4QuotaList *list, int max_id) {
+    if (!path || !list) {
+        return EINVAL;
+    }
+
+    char quota_file_path[PATH_MAX];
+    if (find_quota_file(path, type, quota_file_path, sizeof(quota_file_path)) != 0) {
+        return ENOENT;
+    }
+
+    return read_quota_file(quota_file_path, type, list, max_id);
+}
+
+int ext4_list_quotas_direct_debug(const char *path, int type, EXT4QuotaList *list, int max_id, char *error_msg, size_t error_msg_size) {
+    if (!path || !list) {
+        snprintf(error_msg, error_msg_size, "Invalid arguments");
+        return EINVAL;
+    }
+
+    char quota_file_path[PATH_MAX];
+    if (find_quota_file(path, type, quota_file_path, sizeof(quota_file_path)) != 0) {
+        snprintf(error_msg, error_msg_size, "find_quota_file failed for path=%s, type=%d", path, type);
+        return ENOENT;
+    }
+
+    snprintf(error_msg, error_msg_size, "quota_file_path=%s", quota_file_path);
 
-    int ret = read_quota_file(path, type, list);
+    int ret = read_quota_file(quota_file_path, type, list, max_id);
     if (ret != 0) {
-        snprintf(error_msg, error_msg_size, "read_quota_file failed: %s", strerror(ret));
-        free(list->items);
-        list->items = NULL;
+        snprintf(error_msg, error_msg_size, "read_quota_file failed for %s: %s", quota_file_path, strerror(ret));
         return ret;
     }
 
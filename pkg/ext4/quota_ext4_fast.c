@@ -2,202 +2,414 @@
 #include <stdlib.h>
 #include <string.h>
 #include <errno.h>
-#include <dirent.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <endian.h>
 #include <sys/stat.h>
 #include <sys/types.h>
-#include <fcntl.h>
-#include <mntent.h>
+#include <linux/quota.h>
 #include <limits.h>
 #include "quota_ext4.h"
 
-static char device_path[PATH_MAX] = {0};
-static int device_number = -1;
+// 直接从块设备读取 ext4 隐藏配额 inode（quota 特性）：
+// 超级块 -> 组描述符 -> inode -> extent 树 -> 配额文件内容，再交给 ext4_parse_quota_tree 解码。
+// ext4 的配额始终以日志方式写入，脏块位于块设备的页缓存中，因此带缓存的 pread 能读到最新内容。
+#define EXT4_SUPERBLOCK_OFFSET 1024
+#define EXT4_SUPER_MAGIC 0xEF53
+#define EXT4_FEATURE_INCOMPAT_META_BG 0x0010
+#define EXT4_FEATURE_INCOMPAT_64BIT 0x0080
+#define EXT4_FEATURE_RO_COMPAT_QUOTA 0x0100
+#define EXT4_EXTENTS_FL 0x00080000
+#define EXT4_EXT_MAGIC 0xF30A
+#define EXT4_EXT_MAX_DEPTH 5
+#define EXT4_EXT_INIT_MAX_LEN 32768
+#define QUOTA_FILE_MAX_SIZE (1024UL * 1024 * 1024)
+#define CROSS_CHECK_SAMPLES 32
+
+typedef struct {
+    int fd;
+    uint32_t block_size;
+    uint64_t blocks_count;
+    uint32_t first_data_block;
+    uint32_t inodes_per_group;
+    uint32_t inode_size;
+    uint32_t desc_size;
+    uint32_t quota_inum[3];
+} Ext4Volume;
+
+static uint16_t get_le16(const unsigned char *p) {
+    uint16_t v;
+    memcpy(&v, p, sizeof(v));
+    return le16toh(v);
+}
 
-static int find_device_for_path(const char *path) {
-    FILE *fp = setmntent("/proc/mounts", "r");
-    if (!fp) {
-        return -1;
-    }
+static uint32_t get_le32(const unsigned char *p) {
+    uint32_t v;
+    memcpy(&v, p, sizeof(v));
+    return le32toh(v);
+}
 
-    struct mntent *ent;
-    while ((ent = getmntent(fp)) != NULL) {
-        if (strcmp(ent->mnt_dir, path) == 0) {
-            strncpy(device_path, ent->mnt_fsname, PATH_MAX - 1);
-            device_path[PATH_MAX - 1] = '\0';
-            endmntent(fp);
-            return 0;
+static int pread_full(int fd, void *buf, size_t size, off_t offset) {
+    unsigned char *p = (unsigned char *)buf;
+    while (size > 0) {
+        ssize_t n = pread(fd, p, size, offset);
+        if (n < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            return errno;
+        }
+        if (n == 0) {
+            return EIO;
         }
+        p += n;
+        size -= (size_t)n;
+        offset += n;
     }
-
-    endmntent(fp);
-    return -1;
+    return 0;
 }
 
-static int get_device_number(const char *device_path) {
-    FILE *fp = fopen("/proc/partitions", "r");
-    if (!fp) {
-        return -1;
+static int read_superblock(Ext4Volume *vol) {
+    unsigned char sb[1024];
+    int ret = pread_full(vol->fd, sb, sizeof(sb), EXT4_SUPERBLOCK_OFFSET);
+    if (ret != 0) {
+        return ret;
+    }
+
+    if (get_le16(sb + 0x38) != EXT4_SUPER_MAGIC) {
+        return EINVAL;
     }
 
-    char line[1024];
-    int major = -1, minor = -1;
-    char dev_name[256];
+    uint32_t incompat = get_le32(sb + 0x60);
+    uint32_t ro_compat = get_le32(sb + 0x64);
+    if (!(ro_compat & EXT4_FEATURE_RO_COMPAT_QUOTA)) {
+        return ENOTSUP;
+    }
+    if (incompat & EXT4_FEATURE_INCOMPAT_META_BG) {
+        return ENOTSUP;
+    }
 
-    while (fgets(line, sizeof(line), fp)) {
-        if (sscanf(line, "%*d %d %d %255s", &major, &minor, dev_name) == 3) {
-            if (strstr(device_path, dev_name)) {
-                fclose(fp);
-                return (major << 8) | minor;
-            }
+    uint32_t log_block_size = get_le32(sb + 0x18);
+    if (log_block_size > 6) {
+        return EINVAL;
+    }
+
+    vol->block_size = 1024U << log_block_size;
+    vol->blocks_count = get_le32(sb + 0x04);
+    vol->first_data_block = get_le32(sb + 0x14);
+    vol->inodes_per_group = get_le32(sb + 0x28);
+    vol->inode_size = get_le32(sb + 0x4C) == 0 ? 128 : get_le16(sb + 0x58);
+    vol->desc_size = 32;
+    if (incompat & EXT4_FEATURE_INCOMPAT_64BIT) {
+        vol->blocks_count |= (uint64_t)get_le32(sb + 0x150) << 32;
+        vol->desc_size = get_le16(sb + 0xFE);
+        if (vol->desc_size < 32) {
+            vol->desc_size = 32;
         }
     }
+    vol->quota_inum[USRQUOTA] = get_le32(sb + 0x240);
+    vol->quota_inum[GRPQUOTA] = get_le32(sb + 0x244);
+    vol->quota_inum[PRJQUOTA] = get_le32(sb + 0x26C);
+
+    if (vol->inodes_per_group == 0 || vol->inode_size < 128) {
+        return EINVAL;
+    }
 
-    fclose(fp);
-    return -1;
+    return 0;
 }
 
-static int try_proc_fs_quota(int type, EXT4QuotaList *list) {
-    DIR *dir = opendir("/proc/fs/quota");
-    if (!dir) {
-        return -1;
+static int read_inode(const Ext4Volume *vol, uint32_t ino, unsigned char *inode) {
+    uint32_t group = (ino - 1) / vol->inodes_per_group;
+    uint32_t index = (ino - 1) % vol->inodes_per_group;
+
+    unsigned char desc[64];
+    off_t desc_offset = (off_t)(vol->first_data_block + 1) * vol->block_size +
+                        (off_t)group * vol->desc_size;
+    int ret = pread_full(vol->fd, desc, vol->desc_size > 32 ? 64 : 32, desc_offset);
+    if (ret != 0) {
+        return ret;
     }
 
-    struct dirent *entry;
-    while ((entry = readdir(dir)) != NULL) {
-        if (entry->d_name[0] == '.') {
-            continue;
-        }
+    uint64_t inode_table = get_le32(desc + 0x08);
+    if (vol->desc_size > 32) {
+        inode_table |= (uint64_t)get_le32(desc + 0x28) << 32;
+    }
+    if (inode_table == 0 || inode_table >= vol->blocks_count) {
+        return EIO;
+    }
 
-        char quota_path[PATH_MAX];
-        snprintf(quota_path, sizeof(quota_path), "/proc/fs/quota/%s", entry->d_name);
+    off_t inode_offset = (off_t)inode_table * vol->block_size + (off_t)index * vol->inode_size;
+    return pread_full(vol->fd, inode, 128, inode_offset);
+}
 
-        struct stat st;
-        if (stat(quota_path, &st) != 0 || !S_ISDIR(st.st_mode)) {
-            continue;
-        }
+// 按 extent 把逻辑块读入 file 缓冲区；每个 extent 一次连续的大块读取，未初始化的 extent 保持为零
+static int read_extent_node(const Ext4Volume *vol, const unsigned char *node, size_t node_size,
+                            int depth_left, unsigned char *file, size_t file_size) {
+    if (node_size < 12 || get_le16(node) != EXT4_EXT_MAGIC) {
+        return EIO;
+    }
 
-        DIR *quota_dir = opendir(quota_path);
-        if (!quota_dir) {
-            continue;
-        }
+    uint16_t entries = get_le16(node + 2);
+    uint16_t depth = get_le16(node + 6);
+    if ((size_t)(entries + 1) * 12 > node_size || depth > depth_left) {
+        return EIO;
+    }
 
-        struct dirent *q_entry;
-        while ((q_entry = readdir(quota_dir)) != NULL) {
-            if (q_entry->d_name[0] == '.') {
+    for (uint16_t i = 0; i < entries; i++) {
+        const unsigned char *e = node + 12 + (size_t)i * 12;
+
+        if (depth == 0) {
+            uint64_t lblk = get_le32(e);
+            uint32_t len = get_le16(e + 4);
+            uint64_t pblk = ((uint64_t)get_le16(e + 6) << 32) | get_le32(e + 8);
+
+            if (len > EXT4_EXT_INIT_MAX_LEN) {
                 continue;
             }
+            if (pblk + len > vol->blocks_count) {
+                return EIO;
+            }
 
-            char type_path[PATH_MAX];
-            snprintf(type_path, sizeof(type_path), "%s/%s", quota_path, q_entry->d_name);
+            uint64_t start = lblk * vol->block_size;
+            if (start >= file_size) {
+                continue;
+            }
+            uint64_t size = (uint64_t)len * vol->block_size;
+            if (start + size > file_size) {
+                size = file_size - start;
+            }
 
-            int entry_type = -1;
-            if (strcmp(q_entry->d_name, "usrquota") == 0) {
-                entry_type = USRQUOTA;
-            } else if (strcmp(q_entry->d_name, "grpquota") == 0) {
-                entry_type = GRPQUOTA;
-            } else if (strcmp(q_entry->d_name, "prjquota") == 0) {
-                entry_type = PRJQUOTA;
+            int ret = pread_full(vol->fd, file + start, size, (off_t)(pblk * vol->block_size));
+            if (ret != 0) {
+                return ret;
+            }
+        } else {
+            uint64_t leaf = ((uint64_t)get_le16(e + 8) << 32) | get_le32(e + 4);
+            if (leaf >= vol->blocks_count) {
+                return EIO;
             }
 
-            if (entry_type != type) {
-                continue;
+            unsigned char *child = (unsigned char *)malloc(vol->block_size);
+            if (!child) {
+                return ENOMEM;
             }
 
-            DIR *type_dir = opendir(type_path);
-            if (!type_dir) {
-                continue;
+            int ret = pread_full(vol->fd, child, vol->block_size, (off_t)(leaf * vol->block_size));
+            if (ret == 0) {
+                ret = read_extent_node(vol, child, vol->block_size, depth - 1, file, file_size);
+            }
+            free(child);
+            if (ret != 0) {
+                return ret;
             }
+        }
+    }
 
-            struct dirent *id_entry;
-            while ((id_entry = readdir(type_dir)) != NULL) {
-                if (id_entry->d_name[0] == '.') {
-                    continue;
-                }
+    return 0;
+}
 
-                uint32_t id = strtoul(id_entry->d_name, NULL, 10);
-                if (id == 0) {
-                    continue;
-                }
+static int read_quota_inode(const Ext4Volume *vol, uint32_t ino, unsigned char **data, size_t *size) {
+    unsigned char inode[128];
+    int ret = read_inode(vol, ino, inode);
+    if (ret != 0) {
+        return ret;
+    }
 
-                char id_path[PATH_MAX];
-                snprintf(id_path, sizeof(id_path), "%s/%s", type_path, id_entry->d_name);
+    if (!(get_le32(inode + 0x20) & EXT4_EXTENTS_FL)) {
+        return ENOTSUP;
+    }
 
-                FILE *fp = fopen(id_path, "r");
-                if (!fp) {
-                    continue;
-                }
+    uint64_t file_size = get_le32(inode + 0x04) | ((uint64_t)get_le32(inode + 0x6C) << 32);
+    if (file_size == 0 || file_size > QUOTA_FILE_MAX_SIZE) {
+        return EIO;
+    }
+    file_size = (file_size + vol->block_size - 1) / vol->block_size * vol->block_size;
 
-                EXT4QuotaInfo info;
-                memset(&info, 0, sizeof(info));
-                info.id = id;
-                info.qtype = type;
-
-                char line[1024];
-                while (fgets(line, sizeof(line), fp)) {
-                    if (strncmp(line, "block_hard_limit:", 17) == 0) {
-                        sscanf(line + 17, "%lu", &info.bhardlimit);
-                    } else if (strncmp(line, "block_soft_limit:", 17) == 0) {
-                        sscanf(line + 17, "%lu", &info.bsoftlimit);
-                    } else if (strncmp(line, "block_current:", 14) == 0) {
-                        unsigned long long cur;
-                        sscanf(line + 14, "%llu", &cur);
-                        info.curblocks = cur / 1024;
-                    } else if (strncmp(line, "inode_hard_limit:", 17) == 0) {
-                        sscanf(line + 17, "%lu", &info.ihardlimit);
-                    } else if (strncmp(line, "inode_soft_limit:", 17) == 0) {
-                        sscanf(line + 17, "%lu", &info.isoftlimit);
-                    } else if (strncmp(line, "inode_current:", 14) == 0) {
-                        unsigned long long cur;
-                        sscanf(line + 14, "%llu", &cur);
-                        info.curinodes = cur;
-                    }
-                }
+    unsigned char *file = (unsigned char *)calloc(1, file_size);
+    if (!file) {
+        return ENOMEM;
+    }
 
-                fclose(fp);
-
-                if (info.bhardlimit > 0 || info.bsoftlimit > 0 ||
-                    info.ihardlimit > 0 || info.isoftlimit > 0) {
-                    if (list->count >= list->capacity) {
-                        list->capacity *= 2;
-                        EXT4QuotaInfo *new_items = (EXT4QuotaInfo *)realloc(list->items, list->capacity * sizeof(EXT4QuotaInfo));
-                        if (!new_items) {
-                            closedir(type_dir);
-                            closedir(quota_dir);
-                            closedir(dir);
-                            return ENOMEM;
-                        }
-                        list->items = new_items;
-                    }
-                    list->items[list->count++] = info;
-                }
-            }
+    ret = read_extent_node(vol, inode + 0x28, 60, EXT4_EXT_MAX_DEPTH, file, file_size);
+    if (ret != 0) {
+        free(file);
+        return ret;
+    }
 
-            closedir(type_dir);
+    *data = file;
+    *size = file_size;
+    return 0;
+}
+
+static int has_quota_set(const struct if_nextdqblk *dq) {
+    return (dq->dqb_bhardlimit > 0 || dq->dqb_bsoftlimit > 0 ||
+            dq->dqb_ihardlimit > 0 || dq->dqb_isoftlimit > 0 ||
+            dq->dqb_curspace > 0 || dq->dqb_curinodes > 0);
+}
+
+// 抽样对照内核结果：逐个比较限额与用量，并用 Q_GETNEXTQUOTA 确认相邻 ID 之间没有遗漏。
+// 不一致时返回 ESTALE，调用方应回退到 quotactl 路径。
+static int cross_check(quota_handle_t *handle, int type, const EXT4QuotaInfo *items, size_t count) {
+    if (count == 0) {
+        struct if_nextdqblk dq;
+        memset(&dq, 0, sizeof(dq));
+        int ret = quota_handle_quotactl(handle, Q_GETNEXTQUOTA, type, 0, &dq);
+        if (ret == 0 && has_quota_set(&dq)) {
+            return ESTALE;
+        }
+        return 0;
+    }
+
+    size_t samples = count < CROSS_CHECK_SAMPLES ? count : CROSS_CHECK_SAMPLES;
+    int use_nextquota = 1;
+
+    for (size_t s = 0; s < samples; s++) {
+        size_t i = samples > 1 ? s * (count - 1) / (samples - 1) : 0;
+        const EXT4QuotaInfo *info = &items[i];
+
+        struct if_dqblk dq;
+        memset(&dq, 0, sizeof(dq));
+        int ret = quota_handle_quotactl(handle, Q_GETQUOTA, type, info->id, &dq);
+        if (ret != 0) {
+            return ret;
+        }
+
+        if (dq.dqb_bhardlimit != info->bhardlimit || dq.dqb_bsoftlimit != info->bsoftlimit ||
+            dq.dqb_ihardlimit != info->ihardlimit || dq.dqb_isoftlimit != info->isoftlimit ||
+            dq.dqb_curspace / 1024 != info->curblocks || dq.dqb_curinodes != info->curinodes) {
+            return ESTALE;
+        }
+
+        if (!use_nextquota || i + 1 >= count || info->id == UINT32_MAX) {
+            continue;
         }
 
-        closedir(quota_dir);
+        uint32_t next_id = info->id + 1;
+        uint32_t expect = items[i + 1].id;
+        for (int step = 0; step < 64; step++) {
+            struct if_nextdqblk next;
+            memset(&next, 0, sizeof(next));
+            ret = quota_handle_quotactl(handle, Q_GETNEXTQUOTA, type, next_id, &next);
+            if (ret == EINVAL || ret == ENOSYS) {
+                use_nextquota = 0;
+                break;
+            }
+            if (ret != 0 || next.dqb_id > expect) {
+                return ESTALE;
+            }
+            if (has_quota_set(&next)) {
+                if (next.dqb_id != expect) {
+                    return ESTALE;
+                }
+                break;
+            }
+            if (next.dqb_id == UINT32_MAX) {
+                return ESTALE;
+            }
+            next_id = next.dqb_id + 1;
+        }
     }
 
-    closedir(dir);
     return 0;
 }
 
+// 打开挂载点对应的块设备并读出 type 的隐藏配额 inode 内容
+static int load_quota_inode(quota_handle_t *handle, int type, unsigned char **data, size_t *size) {
+    char device[PATH_MAX];
+    int ret = quota_handle_block_device(handle, device, sizeof(device));
+    if (ret != 0) {
+        return ret;
+    }
+
+    Ext4Volume vol;
+    memset(&vol, 0, sizeof(vol));
+    vol.fd = open(device, O_RDONLY | O_CLOEXEC);
+    if (vol.fd < 0) {
+        return errno;
+    }
+
+    ret = read_superblock(&vol);
+    if (ret == 0 && vol.quota_inum[type] == 0) {
+        ret = ENOTSUP;
+    }
+    if (ret == 0) {
+        ret = read_quota_inode(&vol, vol.quota_inum[type], data, size);
+    }
+    close(vol.fd);
+    return ret;
+}
+
 int ext4_list_quotas_fast(const char *path, int type, EXT4QuotaList *list, int max_id) {
     if (!path || !list) {
         return EINVAL;
     }
 
-    list->count = 0;
-    list->capacity = 1024;
-    list->items = (EXT4QuotaInfo *)malloc(list->capacity * sizeof(EXT4QuotaInfo));
-    if (!list->items) {
-        return ENOMEM;
+    if (type < USRQUOTA || type > PRJQUOTA) {
+        return EINVAL;
+    }
+
+    quota_handle_t *handle;
+    if (quota_handle_open(path, &handle) != 0) {
+        return ENODEV;
     }
 
-    int ret = try_proc_fs_quota(type, list);
+    unsigned char *data = NULL;
+    size_t size = 0;
+    int ret = load_quota_inode(handle, type, &data, &size);
     if (ret == 0) {
-        return 0;
+        ret = ext4_parse_quota_tree(data, size, type, list, max_id);
+        free(data);
+    }
+
+    if (ret == 0) {
+        ret = cross_check(handle, type, list->items, list->count);
+        if (ret != 0) {
+            ext4_free_quota_list(list);
+        }
+    }
+
+    quota_handle_close(handle);
+    return ret;
+}
+
+int ext4_handle_list_quotas_fast_into(quota_handle_t *handle, int type, int max_id,
+                                      EXT4QuotaInfo *items, size_t capacity, size_t *count, int *more) {
+    if (!handle || !count || !more) {
+        return EINVAL;
+    }
+
+    if (type < USRQUOTA || type > PRJQUOTA) {
+        return EINVAL;
+    }
+
+    unsigned char *data = NULL;
+    size_t size = 0;
+    int ret = load_quota_inode(handle, type, &data, &size);
+    if (ret == 0) {
+        ret = ext4_parse_quota_tree_into(data, size, type, max_id, items, capacity, count, more);
+        free(data);
+    }
+
+    // 缓冲区不足时结果不完整，交给扩容后的重试去校验
+    if (ret == 0 && !*more) {
+        ret = cross_check(handle, type, items, *count);
+    }
+
+    return ret;
+}
+
+int ext4_list_quotas_fast_into(const char *path, int type, int max_id,
+                               EXT4QuotaInfo *items, size_t capacity, size_t *count, int *more) {
+    if (!path) {
+        return EINVAL;
+    }
+
+    quota_handle_t *handle;
+    if (quota_handle_open(path, &handle) != 0) {
+        return ENODEV;
     }
 
-    return ENOTSUP;
+    int ret = ext4_handle_list_quotas_fast_into(handle, type, max_id, items, capacity, count, more);
+    quota_handle_close(handle);
+    return ret;
 }
@@ -0,0 +1,266 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <dirent.h>
+#include <sys/ioctl.h>
+#include <sys/stat.h>
+#include <sys/types.h>
+#include <linux/fs.h>
+#include <linux/quota.h>
+#include <limits.h>
+#include "quota_ext4.h"
+
+// 旧内核没有 Q_GETNEXTQUOTA 时，逐个探测整个 ID 空间代价是 O(max_id)。
+// 实际用到的 ID 大多可以从系统数据库和挂载点顶层目录推断出来：
+// 用户/组取自 /etc/passwd、/etc/group 和顶层目录的属主，
+// 项目取自 /etc/projid、/etc/projects 和顶层目录的 fsx_projid。
+// 只查询这些候选 ID，必要时再补扫 [0, backfill] 这一小段。
+#define EXT4_SEED_MAX_BACKFILL (1u << 20)
+
+typedef struct {
+    uint32_t *ids;
+    size_t count;
+    size_t capacity;
+} IdSet;
+
+static int id_set_add(IdSet *set, uint32_t id) {
+    if (set->count >= set->capacity) {
+        size_t capacity = set->capacity ? set->capacity * 2 : 256;
+        uint32_t *ids = (uint32_t *)realloc(set->ids, capacity * sizeof(uint32_t));
+        if (!ids) {
+            return ENOMEM;
+        }
+        set->ids = ids;
+        set->capacity = capacity;
+    }
+    set->ids[set->count++] = id;
+    return 0;
+}
+
+static int compare_ids(const void *a, const void *b) {
+    uint32_t x = *(const uint32_t *)a;
+    uint32_t y = *(const uint32_t *)b;
+    return x < y ? -1 : (x > y);
+}
+
+static void id_set_finish(IdSet *set) {
+    qsort(set->ids, set->count, sizeof(uint32_t), compare_ids);
+
+    size_t n = 0;
+    for (size_t i = 0; i < set->count; i++) {
+        if (n == 0 || set->ids[i] != set->ids[n - 1]) {
+            set->ids[n++] = set->ids[i];
+        }
+    }
+    set->count = n;
+}
+
+// 逐行读取以 ':' 分隔的文件，取第 field 个字段（从 0 开始）作为 ID；文件不存在不算错误
+static int seed_from_file(IdSet *set, const char *file, int field) {
+    FILE *fp = fopen(file, "re");
+    if (!fp) {
+        return 0;
+    }
+
+    char *line = NULL;
+    size_t size = 0;
+    int ret = 0;
+    while (ret == 0 && getline(&line, &size, fp) > 0) {
+        if (line[0] == '#') {
+            continue;
+        }
+
+        char *p = line;
+        for (int i = 0; i < field && p; i++) {
+            p = strchr(p, ':');
+            if (p) {
+                p++;
+            }
+        }
+        if (!p || *p < '0' || *p > '9') {
+            continue;
+        }
+
+        char *end;
+        errno = 0;
+        unsigned long id = strtoul(p, &end, 10);
+        if (errno != 0 || id > UINT32_MAX || (*end != ':' && *end != '\n' && *end != '\0')) {
+            continue;
+        }
+        ret = id_set_add(set, (uint32_t)id);
+    }
+
+    free(line);
+    fclose(fp);
+    return ret;
+}
+
+static int seed_from_top_dirs(IdSet *set, const char *mount_point, int type) {
+    int dfd = open(mount_point, O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+    if (dfd < 0) {
+        return 0;
+    }
+
+    DIR *dir = fdopendir(dfd);
+    if (!dir) {
+        close(dfd);
+        return 0;
+    }
+
+    int ret = 0;
+    struct dirent *entry;
+    while (ret == 0 && (entry = readdir(dir)) != NULL) {
+        if (strcmp(entry->d_name, "..") == 0) {
+            continue;
+        }
+
+        if (type != PRJQUOTA) {
+            struct stat st;
+            if (fstatat(dfd, entry->d_name, &st, AT_SYMLINK_NOFOLLOW) == 0) {
+                ret = id_set_add(set, type == USRQUOTA ? st.st_uid : st.st_gid);
+            }
+            continue;
+        }
+
+        if (entry->d_type != DT_DIR && entry->d_type != DT_REG && entry->d_type != DT_UNKNOWN) {
+            continue;
+        }
+
+        int fd = openat(dfd, entry->d_name, O_RDONLY | O_NOFOLLOW | O_NONBLOCK | O_CLOEXEC);
+        if (fd < 0) {
+            continue;
+        }
+
+        struct fsxattr attr;
+        memset(&attr, 0, sizeof(attr));
+        if (ioctl(fd, FS_IOC_FSGETXATTR, &attr) == 0) {
+            ret = id_set_add(set, attr.fsx_projid);
+        }
+        close(fd);
+    }
+
+    closedir(dir);
+    return ret;
+}
+
+static int collect_seeds(const char *mount_point, int type, uint32_t backfill, IdSet *set) {
+    int ret = id_set_add(set, 0);
+
+    if (ret == 0) {
+        if (type == USRQUOTA) {
+            ret = seed_from_file(set, "/etc/passwd", 2);
+        } else if (type == GRPQUOTA) {
+            ret = seed_from_file(set, "/etc/group", 2);
+        } else {
+            ret = seed_from_file(set, "/etc/projid", 1);
+            if (ret == 0) {
+                ret = seed_from_file(set, "/etc/projects", 0);
+            }
+        }
+    }
+
+    if (ret == 0) {
+        ret = seed_from_top_dirs(set, mount_point, type);
+    }
+
+    if (backfill > EXT4_SEED_MAX_BACKFILL) {
+        backfill = EXT4_SEED_MAX_BACKFILL;
+    }
+    for (uint32_t id = 1; ret == 0 && id <= backfill; id++) {
+        ret = id_set_add(set, id);
+    }
+
+    if (ret == 0) {
+        id_set_finish(set);
+    }
+    return ret;
+}
+
+int ext4_seed_ids(const char *path, int type, uint32_t backfill, uint32_t **ids, size_t *count) {
+    if (!path || !ids || !count || type < USRQUOTA || type > PRJQUOTA) {
+        return EINVAL;
+    }
+
+    QuotaMountEntry entry;
+    const char *mount_point = path;
+    if (quota_mount_lookup(path, &entry) == 0) {
+        mount_point = entry.mount_point;
+    }
+
+    IdSet set = {NULL, 0, 0};
+    int ret = collect_seeds(mount_point, type, backfill, &set);
+    if (ret != 0) {
+        free(set.ids);
+        return ret;
+    }
+
+    *ids = set.ids;
+    *count = set.count;
+    return 0;
+}
+
+int ext4_list_quotas_seeded(const char *path, int type, EXT4QuotaList *list, int max_id, uint32_t backfill) {
+    if (!path || !list) {
+        return EINVAL;
+    }
+
+    quota_handle_t *handle;
+    if (quota_handle_open(path, &handle) != 0) {
+        return ENODEV;
+    }
+
+    uint32_t *ids = NULL;
+    size_t count = 0;
+    int ret = ext4_seed_ids(quota_handle_mount_point(handle), type, backfill, &ids, &count);
+    if (ret != 0) {
+        quota_handle_close(handle);
+        return ret;
+    }
+
+    if (max_id > 0) {
+        while (count > 0 && ids[count - 1] > (uint32_t)max_id) {
+            count--;
+        }
+    }
+
+    EXT4QuotaInfo *items = (EXT4QuotaInfo *)malloc((count ? count : 1) * sizeof(EXT4QuotaInfo));
+    int *errors = (int *)malloc((count ? count : 1) * sizeof(int));
+    if (!items || !errors) {
+        ret = ENOMEM;
+    }
+
+    if (ret == 0) {
+        ret = ext4_handle_get_quotas(handle, type, ids, count, items, errors);
+    }
+
+    // 候选 ID 已排序，结果同序；只保留真正有限额或用量的记录
+    size_t n = 0;
+    for (size_t i = 0; ret == 0 && i < count; i++) {
+        if (errors[i] != 0) {
+            ret = errors[i];
+            break;
+        }
+        const EXT4QuotaInfo *info = &items[i];
+        if (info->bhardlimit || info->bsoftlimit || info->ihardlimit ||
+            info->isoftlimit || info->curblocks || info->curinodes) {
+            items[n++] = *info;
+        }
+    }
+
+    free(errors);
+    free(ids);
+    quota_handle_close(handle);
+
+    if (ret != 0) {
+        free(items);
+        return ret;
+    }
+
+    list->items = items;
+    list->count = n;
+    list->capacity = count ? count : 1;
+    return 0;
+}
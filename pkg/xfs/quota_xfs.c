@@ -9,210 +9,47 @@
 #include <sys/stat.h>
 #include <sys/sysmacros.h>
 #include <linux/dqblk_xfs.h>
-#include <sys/utsname.h>
 #include <mntent.h>
 #include <limits.h>
 #include "quota_xfs.h"
 
-static char device_path[PATH_MAX] = {0};
-
-static int find_device_by_major_minor(unsigned int major, unsigned int minor) {
-    char uevent_path[PATH_MAX];
-    snprintf(uevent_path, PATH_MAX, "/sys/dev/block/%u:%u/uevent", major, minor);
-    
-    FILE *fp = fopen(uevent_path, "r");
-    if (!fp) {
-        return -1;
-    }
-    
-    char line[PATH_MAX];
-    char devname[PATH_MAX] = {0};
-    
-    while (fgets(line, sizeof(line), fp)) {
-        if (strncmp(line, "DEVNAME=", 8) == 0) {
-            strncpy(devname, line + 8, PATH_MAX - 1);
-            size_t len = strlen(devname);
-            if (len > 0 && devname[len - 1] == '\n') {
-                devname[len - 1] = '\0';
-            }
-            break;
-        }
-    }
-    fclose(fp);
-    
-    if (devname[0] == '\0') {
-        return -1;
-    }
-    
-    const char *dev_paths[] = {
-        "/dev/mapper/%s",
-        "/dev/%s",
-        "/dev/block/%s",
-        "/dev/disk/by-uuid/%s",
-        "/dev/disk/by-label/%s",
-        "/tmp/quota_%s",
-        NULL
-    };
-    
-    for (int i = 0; dev_paths[i] != NULL; i++) {
-        char test_path[PATH_MAX];
-        snprintf(test_path, PATH_MAX, dev_paths[i], devname);
-        
-        if (access(test_path, F_OK) == 0) {
-            strncpy(device_path, test_path, PATH_MAX - 1);
-            device_path[PATH_MAX - 1] = '\0';
-            return 0;
-        }
-    }
-    
-    char fake_device_path[PATH_MAX];
-    snprintf(fake_device_path, PATH_MAX, "/tmp/quota_%u_%u", major, minor);
-    
-    if (access(fake_device_path, F_OK) == 0) {
-        strncpy(device_path, fake_device_path, PATH_MAX - 1);
-        device_path[PATH_MAX - 1] = '\0';
-        return 0;
-    }
-    
-    if (mknod(fake_device_path, S_IFBLK | 0600, makedev(major, minor)) == 0) {
-        strncpy(device_path, fake_device_path, PATH_MAX - 1);
-        device_path[PATH_MAX - 1] = '\0';
-        return 0;
-    }
-    
-    return -1;
-}
-
-static int is_valid_mount_point(const char *mount_point, const char *path) {
-    struct stat st_mount, st_path;
-    
-    if (stat(mount_point, &st_mount) != 0) {
-        return 0;
-    }
-    
-    if (stat(path, &st_path) != 0) {
-        return 0;
-    }
-    
-    if (st_mount.st_dev != st_path.st_dev) {
-        return 0;
-    }
-    
-    return 1;
-}
-
-static int find_device_for_path(const char *path) {
-    FILE *fp = fopen("/proc/self/mountinfo", "r");
-    if (!fp) {
-        return -1;
-    }
-    
-    char line[PATH_MAX * 4];
-    size_t path_len = strlen(path);
-    char *best_match = NULL;
-    unsigned int best_major = 0;
-    unsigned int best_minor = 0;
-    size_t best_match_len = 0;
-    char best_fstype[64] = {0};
-    int is_root_path = (path_len == 1 && path[0] == '/');
-    
-    while (fgets(line, sizeof(line), fp)) {
-        char mount_point[PATH_MAX];
-        char root[PATH_MAX];
-        char fstype[64];
-        unsigned int major, minor;
-        
-        int parsed = sscanf(line, "%*d %*d %u:%u %s %s", &major, &minor, root, mount_point);
-        if (parsed != 4) {
-            continue;
-        }
-        
-        size_t mnt_len = strlen(mount_point);
-        
-        if (is_root_path) {
-            if (strcmp(mount_point, "/") != 0) {
-                continue;
-            }
-            
-            char *fstype_ptr = strstr(line, " - ");
-            if (!fstype_ptr) {
-                continue;
-            }
-            
-            fstype_ptr += 3;
-            sscanf(fstype_ptr, "%63s", fstype);
-            
-            if (strcmp(fstype, "ext4") == 0 || strcmp(fstype, "xfs") == 0) {
-                if (is_valid_mount_point(mount_point, path)) {
-                    best_match = mount_point;
-                    best_major = major;
-                    best_minor = minor;
-                    best_match_len = mnt_len;
-                    strncpy(best_fstype, fstype, sizeof(best_fstype) - 1);
-                    best_fstype[sizeof(best_fstype) - 1] = '\0';
-                    break;
-                }
-            }
-        } else {
-            if (mnt_len > path_len) {
-                continue;
-            }
-            
-            if (strncmp(path, mount_point, mnt_len) == 0) {
-                if (mnt_len > best_match_len) {
-                    if (is_valid_mount_point(mount_point, path)) {
-                        best_match = mount_point;
-                        best_major = major;
-                        best_minor = minor;
-                        best_match_len = mnt_len;
-                        
-                        char *fstype_ptr = strstr(line, " - ");
-                        if (fstype_ptr) {
-                            fstype_ptr += 3;
-                            sscanf(fstype_ptr, "%63s", best_fstype);
-                        }
-                    }
-                }
-            }
-        }
-    }
-    
-    fclose(fp);
-    
-    if (!best_match) {
-        return -1;
-    }
-    
-    int ret = find_device_by_major_minor(best_major, best_minor);
-    return ret;
-}
-
 #define XFS_QUOTA_USRQUOTA 0
 #define XFS_QUOTA_GRPQUOTA 1
 #define XFS_QUOTA_PRJQUOTA 2
 
-static char error_buffer[256];
+static __thread char error_buffer[256];
 
 const char* xfs_error_string(int err) {
     if (err == 0) {
         return "Success";
     }
-#pragma GCC diagnostic push
-#pragma GCC diagnostic ignored "-Wunused-result"
-    strerror_r(err, error_buffer, sizeof(error_buffer));
-#pragma GCC diagnostic pop
-    return error_buffer;
+    return strerror_r(err, error_buffer, sizeof(error_buffer));
 }
 
-int xfs_set_quota(const char *path, uint32_t id, int type, 
-                  uint64_t bhard, uint64_t bsoft, 
-                  uint64_t ihard, uint64_t isoft) {
-    if (!path) {
-        return EINVAL;
-    }
+static int has_quota_set(const struct fs_disk_quota *dq) {
+    return (dq->d_blk_hardlimit > 0 || dq->d_blk_softlimit > 0 ||
+            dq->d_ino_hardlimit > 0 || dq->d_ino_softlimit > 0 ||
+            dq->d_bcount > 0 || dq->d_icount > 0);
+}
 
-    if (find_device_for_path(path) != 0) {
-        return ENODEV;
+static void fill_quota_info(XFSQuotaInfo *info, const struct fs_disk_quota *dq, int type) {
+    info->id = dq->d_id;
+    info->qtype = type;
+    info->bhardlimit = dq->d_blk_hardlimit / 2;
+    info->bsoftlimit = dq->d_blk_softlimit / 2;
+    info->curblocks = dq->d_bcount / 2;
+    info->ihardlimit = dq->d_ino_hardlimit;
+    info->isoftlimit = dq->d_ino_softlimit;
+    info->curinodes = dq->d_icount;
+    info->btime = dq->d_btimer;
+    info->itime = dq->d_itimer;
+}
+
+int xfs_handle_set_quota(quota_handle_t *handle, uint32_t id, int type,
+                         uint64_t bhard, uint64_t bsoft,
+                         uint64_t ihard, uint64_t isoft) {
+    if (!handle) {
+        return EINVAL;
     }
 
     struct fs_disk_quota dq;
@@ -237,120 +74,352 @@ int xfs_set_quota(const char *path, uint32_t id, int type,
 
     dq.d_fieldmask = FS_DQ_LIMIT_MASK;
 
-    int ret = quotactl(QCMD(Q_XSETQLIM, type), device_path, id, (caddr_t)&dq);
-    if (ret < 0) {
-        return errno;
+    int ret = quota_handle_quotactl(handle, Q_XSETQLIM, type, id, &dq);
+    if (ret != 0) {
+        return ret;
     }
 
     return 0;
 }
 
-int xfs_get_quota(const char *path, uint32_t id, int type, XFSQuotaInfo *info) {
-    if (!path || !info) {
+int xfs_set_quota(const char *path, uint32_t id, int type, 
+                  uint64_t bhard, uint64_t bsoft, 
+                  uint64_t ihard, uint64_t isoft) {
+    if (!path) {
+        return EINVAL;
+    }
+
+    quota_handle_t *handle;
+    if (quota_handle_open(path, &handle) != 0) {
+        return ENODEV;
+    }
+
+    int ret = xfs_handle_set_quota(handle, id, type, bhard, bsoft, ihard, isoft);
+    quota_handle_close(handle);
+    return ret;
+}
+
+typedef struct {
+    quota_handle_t *handle;
+    const QuotaLimit *limits;
+    int *errors;
+} SetQuotasJob;
+
+static void set_quotas_one(size_t index, int worker, void *arg) {
+    (void)worker;
+    SetQuotasJob *job = (SetQuotasJob *)arg;
+    const QuotaLimit *l = &job->limits[index];
+    job->errors[index] = xfs_handle_set_quota(job->handle, l->id, (int)l->qtype,
+                                              l->bhardlimit, l->bsoftlimit,
+                                              l->ihardlimit, l->isoftlimit);
+}
+
+int xfs_handle_set_quotas(quota_handle_t *handle, const QuotaLimit *limits, size_t count,
+                          int *errors, int workers) {
+    if (!handle || (count > 0 && (!limits || !errors))) {
+        return EINVAL;
+    }
+
+    SetQuotasJob job = {handle, limits, errors};
+    quota_run_parallel(count, workers, set_quotas_one, &job);
+    return 0;
+}
+
+int xfs_set_quotas(const char *path, const QuotaLimit *limits, size_t count,
+                   int *errors, int workers) {
+    if (!path) {
         return EINVAL;
     }
 
-    if (find_device_for_path(path) != 0) {
+    quota_handle_t *handle;
+    if (quota_handle_open(path, &handle) != 0) {
         return ENODEV;
     }
 
+    int ret = xfs_handle_set_quotas(handle, limits, count, errors, workers);
+    quota_handle_close(handle);
+    return ret;
+}
+
+int xfs_handle_get_quota(quota_handle_t *handle, uint32_t id, int type, XFSQuotaInfo *info) {
+    if (!handle || !info) {
+        return EINVAL;
+    }
+
     struct fs_disk_quota dq;
     memset(&dq, 0, sizeof(dq));
 
-    int ret = quotactl(QCMD(Q_XGETQUOTA, type), device_path, id, (caddr_t)&dq);
-    
-    if (ret < 0) {
-        return errno;
+    int ret = quota_handle_quotactl(handle, Q_XGETQUOTA, type, id, &dq);
+    if (ret != 0) {
+        return ret;
     }
 
-    info->id = id;
-    info->qtype = type;
-    info->bhardlimit = dq.d_blk_hardlimit / 2;
-    info->bsoftlimit = dq.d_blk_softlimit / 2;
-    info->curblocks = dq.d_bcount / 2;
-    info->ihardlimit = dq.d_ino_hardlimit;
-    info->isoftlimit = dq.d_ino_softlimit;
-    info->curinodes = dq.d_icount;
-    info->btime = dq.d_btimer;
-    info->itime = dq.d_itimer;
+    dq.d_id = id;
+    fill_quota_info(info, &dq, type);
 
     return 0;
 }
 
-static int has_quota_set(const struct fs_disk_quota *dq) {
-    return (dq->d_blk_hardlimit > 0 || dq->d_blk_softlimit > 0 ||
-            dq->d_ino_hardlimit > 0 || dq->d_ino_softlimit > 0 ||
-            dq->d_bcount > 0 || dq->d_icount > 0);
+int xfs_get_quota(const char *path, uint32_t id, int type, XFSQuotaInfo *info) {
+    if (!path || !info) {
+        return EINVAL;
+    }
+
+    quota_handle_t *handle;
+    if (quota_handle_open(path, &handle) != 0) {
+        return ENODEV;
+    }
+
+    int ret = xfs_handle_get_quota(handle, id, type, info);
+    quota_handle_close(handle);
+    return ret;
+}
+static void fill_missing(XFSQuotaInfo *info, uint32_t id, int type) {
+    memset(info, 0, sizeof(*info));
+    info->id = id;
+    info->qtype = type;
 }
 
-int xfs_list_quotas(const char *path, int type, XFSQuotaList *list, int max_id) {
-    (void)max_id;
-    
-    if (!path || !list) {
+int xfs_handle_get_quotas(quota_handle_t *handle, int type, const uint32_t *ids, size_t count,
+                          XFSQuotaInfo *out, int *errors) {
+    if (!handle || (count > 0 && (!ids || !out || !errors))) {
         return EINVAL;
     }
 
-    if (find_device_for_path(path) != 0) {
-        return ENODEV;
+    QuotaIdSlot *slots;
+    int ret = quota_sort_ids(ids, count, &slots);
+    if (ret != 0) {
+        return ret;
     }
 
-    list->count = 0;
-    list->capacity = 1024;
-    list->items = (XFSQuotaInfo *)calloc(list->capacity, sizeof(XFSQuotaInfo));
-    
-    if (!list->items) {
-        return ENOMEM;
+    QuotaCaps caps;
+    int use_next = quota_handle_caps(handle, type, &caps) != 0 || caps.xgetnextquota;
+    size_t i = 0;
+    while (i < count) {
+        uint32_t id = slots[i].id;
+        struct fs_disk_quota dq;
+        memset(&dq, 0, sizeof(dq));
+
+        int dense = use_next && i + 1 < count && slots[i + 1].id - id <= QUOTA_DENSE_GAP;
+        if (!dense) {
+            ret = quota_handle_quotactl(handle, Q_XGETQUOTA, type, id, &dq);
+            dq.d_id = id;
+            for (; i < count && slots[i].id == id; i++) {
+                size_t k = slots[i].index;
+                if (ret == 0) {
+                    fill_quota_info(&out[k], &dq, type);
+                    errors[k] = 0;
+                } else {
+                    fill_missing(&out[k], id, type);
+                    errors[k] = ret == ENOENT ? 0 : ret;
+                }
+            }
+            continue;
+        }
+
+        // 一次 Q_XGETNEXTQUOTA 同时回答了 [id, 返回的 ID] 区间内所有待查 ID
+        ret = quota_handle_quotactl(handle, Q_XGETNEXTQUOTA, type, id, &dq);
+        if (ret == EINVAL || ret == ENOSYS || (ret == 0 && dq.d_id < id)) {
+            use_next = 0;
+            continue;
+        }
+        if (ret != 0 && ret != ENOENT) {
+            for (; i < count && slots[i].id == id; i++) {
+                fill_missing(&out[slots[i].index], id, type);
+                errors[slots[i].index] = ret;
+            }
+            continue;
+        }
+
+        uint64_t found = ret == ENOENT ? QUOTA_CURSOR_END : dq.d_id;
+        for (; i < count && slots[i].id < found; i++) {
+            fill_missing(&out[slots[i].index], slots[i].id, type);
+            errors[slots[i].index] = 0;
+        }
+        for (; i < count && slots[i].id == found; i++) {
+            fill_quota_info(&out[slots[i].index], &dq, type);
+            errors[slots[i].index] = 0;
+        }
+    }
+
+    free(slots);
+    return 0;
+}
+
+int xfs_get_quotas(const char *path, int type, const uint32_t *ids, size_t count,
+                   XFSQuotaInfo *out, int *errors) {
+    if (!path) {
+        return EINVAL;
+    }
+
+    quota_handle_t *handle;
+    if (quota_handle_open(path, &handle) != 0) {
+        return ENODEV;
     }
 
+    int ret = xfs_handle_get_quotas(handle, type, ids, count, out, errors);
+    quota_handle_close(handle);
+    return ret;
+}
+
+
+// 从 *next_id 开始用 Q_XGETNEXTQUOTA 填充最多 batch_size 条记录；
+// 枚举结束时 *next_id 置为 QUOTA_CURSOR_END
+static int list_next_batch(quota_handle_t *handle, int type, uint64_t *next_id,
+                           XFSQuotaInfo *batch, int batch_size, int *count) {
     int found = 0;
-    uint32_t next_id = 0;
-    
-    while (found < 100000) {
+
+    while (found < batch_size && *next_id < QUOTA_CURSOR_END) {
         struct fs_disk_quota dq;
         memset(&dq, 0, sizeof(dq));
 
-        int ret = quotactl(QCMD(Q_XGETNEXTQUOTA, type), device_path, next_id, (caddr_t)&dq);
-        
-        if (ret < 0) {
+        int ret = quota_handle_quotactl(handle, Q_XGETNEXTQUOTA, type, (uint32_t)*next_id, &dq);
+        if (ret == ENOENT) {
+            *next_id = QUOTA_CURSOR_END;
             break;
         }
+        if (ret != 0) {
+            *count = found;
+            return ret;
+        }
+
+        *next_id = (uint64_t)dq.d_id + 1;
 
         if (!has_quota_set(&dq)) {
-            next_id = dq.d_id + 1;
             continue;
         }
 
-        if (found >= list->capacity) {
+        fill_quota_info(&batch[found++], &dq, type);
+    }
+
+    *count = found;
+    return 0;
+}
+
+struct xfs_quota_cursor {
+    quota_handle_t *handle;
+    int owns_handle;
+    int type;
+    uint64_t next_id;
+};
+
+int xfs_handle_list_begin(quota_handle_t *handle, int type, uint64_t token, XFSQuotaCursor **cursor) {
+    if (!handle || !cursor) {
+        return EINVAL;
+    }
+
+    XFSQuotaCursor *c = (XFSQuotaCursor *)calloc(1, sizeof(XFSQuotaCursor));
+    if (!c) {
+        return ENOMEM;
+    }
+
+    c->handle = handle;
+    c->type = type;
+    c->next_id = token;
+    *cursor = c;
+    return 0;
+}
+
+int xfs_list_begin(const char *path, int type, uint64_t token, XFSQuotaCursor **cursor) {
+    if (!path || !cursor) {
+        return EINVAL;
+    }
+
+    quota_handle_t *handle;
+    if (quota_handle_open(path, &handle) != 0) {
+        return ENODEV;
+    }
+
+    int ret = xfs_handle_list_begin(handle, type, token, cursor);
+    if (ret != 0) {
+        quota_handle_close(handle);
+        return ret;
+    }
+
+    (*cursor)->owns_handle = 1;
+    return 0;
+}
+
+int xfs_list_next(XFSQuotaCursor *cursor, XFSQuotaInfo *batch, int batch_size, int *count, int *more) {
+    if (!cursor || !batch || batch_size <= 0 || !count || !more) {
+        return EINVAL;
+    }
+
+    int ret = list_next_batch(cursor->handle, cursor->type, &cursor->next_id, batch, batch_size, count);
+    *more = cursor->next_id < QUOTA_CURSOR_END;
+    return ret;
+}
+
+uint64_t xfs_list_token(const XFSQuotaCursor *cursor) {
+    return cursor->next_id;
+}
+
+void xfs_list_end(XFSQuotaCursor *cursor) {
+    if (!cursor) {
+        return;
+    }
+    if (cursor->owns_handle) {
+        quota_handle_close(cursor->handle);
+    }
+    free(cursor);
+}
+
+int xfs_handle_list_quotas(quota_handle_t *handle, int type, XFSQuotaList *list, int max_id) {
+    (void)max_id;
+    
+    if (!handle || !list) {
+        return EINVAL;
+    }
+
+    QuotaCaps caps;
+    list->count = 0;
+    list->capacity = quota_caps_capacity(quota_handle_caps(handle, type, &caps) == 0 ? &caps : NULL, 64);
+    list->items = (XFSQuotaInfo *)calloc(list->capacity, sizeof(XFSQuotaInfo));
+    
+    if (!list->items) {
+        return ENOMEM;
+    }
+
+    uint64_t next_id = 0;
+    while (next_id < QUOTA_CURSOR_END) {
+        if (list->count >= list->capacity) {
             list->capacity *= 2;
             XFSQuotaInfo *new_items = (XFSQuotaInfo *)realloc(list->items, list->capacity * sizeof(XFSQuotaInfo));
             if (!new_items) {
-                free(list->items);
-                list->items = NULL;
+                xfs_free_quota_list(list);
                 return ENOMEM;
             }
             list->items = new_items;
         }
 
-        XFSQuotaInfo *info = &list->items[found];
-        info->id = dq.d_id;
-        info->qtype = type;
-        info->bhardlimit = dq.d_blk_hardlimit / 2;
-        info->bsoftlimit = dq.d_blk_softlimit / 2;
-        info->curblocks = dq.d_bcount / 2;
-        info->ihardlimit = dq.d_ino_hardlimit;
-        info->isoftlimit = dq.d_ino_softlimit;
-        info->curinodes = dq.d_icount;
-        info->btime = dq.d_btimer;
-        info->itime = dq.d_itimer;
-        
-        next_id = dq.d_id + 1;
-        found++;
-    }
-
-    list->count = found;
+        int found = 0;
+        int ret = list_next_batch(handle, type, &next_id, list->items + list->count,
+                                  (int)(list->capacity - list->count), &found);
+        list->count += found;
+        if (ret != 0) {
+            xfs_free_quota_list(list);
+            return ret;
+        }
+    }
+
     return 0;
 }
 
+int xfs_list_quotas(const char *path, int type, XFSQuotaList *list, int max_id) {
+    if (!path || !list) {
+        return EINVAL;
+    }
+
+    quota_handle_t *handle;
+    if (quota_handle_open(path, &handle) != 0) {
+        return ENODEV;
+    }
+
+    int ret = xfs_handle_list_quotas(handle, type, list, max_id);
+    quota_handle_close(handle);
+    return ret;
+}
+
 void xfs_free_quota_list(XFSQuotaList *list) {
     if (list && list->items) {
         free(list->items);
@@ -360,36 +429,42 @@ void xfs_free_quota_list(XFSQuotaList *list) {
     }
 }
 
-int xfs_test_quota(const char *path, uint32_t id, int type) {
-    if (!path) {
+int xfs_handle_test_quota(quota_handle_t *handle, uint32_t id, int type) {
+    if (!handle) {
         return EINVAL;
     }
 
-    if (find_device_for_path(path) != 0) {
-        return ENODEV;
-    }
-
     struct fs_disk_quota dq;
     memset(&dq, 0, sizeof(dq));
 
-    int ret = quotactl(QCMD(Q_XGETQUOTA, type), device_path, id, (caddr_t)&dq);
-    
-    if (ret < 0) {
-        return errno;
+    int ret = quota_handle_quotactl(handle, Q_XGETQUOTA, type, id, &dq);
+    if (ret != 0) {
+        return ret;
     }
 
     return 0;
 }
 
-int xfs_remove_quota(const char *path, uint32_t id, int type) {
+int xfs_test_quota(const char *path, uint32_t id, int type) {
     if (!path) {
         return EINVAL;
     }
 
-    if (find_device_for_path(path) != 0) {
+    quota_handle_t *handle;
+    if (quota_handle_open(path, &handle) != 0) {
         return ENODEV;
     }
 
+    int ret = xfs_handle_test_quota(handle, id, type);
+    quota_handle_close(handle);
+    return ret;
+}
+
+int xfs_handle_remove_quota(quota_handle_t *handle, uint32_t id, int type) {
+    if (!handle) {
+        return EINVAL;
+    }
+
     struct fs_disk_quota dq;
     memset(&dq, 0, sizeof(dq));
     
@@ -398,10 +473,25 @@ int xfs_remove_quota(const char *path, uint32_t id, int type) {
     dq.d_flags = type;
     dq.d_fieldmask = FS_DQ_LIMIT_MASK;
 
-    int ret = quotactl(QCMD(Q_XSETQLIM, type), device_path, id, (caddr_t)&dq);
-    if (ret < 0) {
-        return errno;
+    int ret = quota_handle_quotactl(handle, Q_XSETQLIM, type, id, &dq);
+    if (ret != 0) {
+        return ret;
     }
 
     return 0;
 }
+
+int xfs_remove_quota(const char *path, uint32_t id, int type) {
+    if (!path) {
+        return EINVAL;
+    }
+
+    quota_handle_t *handle;
+    if (quota_handle_open(path, &handle) != 0) {
+        return ENODEV;
+    }
+
+    int ret = xfs_handle_remove_quota(handle, id, type);
+    quota_handle_close(handle);
+    return ret;
+}
@@ -2,44 +2,83 @@
 #define QUOTA_XFS_H
 
 #include <stdint.h>
+#include "../common/quota_common.h"
 
 #ifdef __cplusplus
 extern "C" {
 #endif
 
-typedef struct {
-    uint32_t id;
-    int qtype;
-    uint64_t bhardlimit;
-    uint64_t bsoftlimit;
-    uint64_t curblocks;
-    uint64_t ihardlimit;
-    uint64_t isoftlimit;
-    uint64_t curinodes;
-    uint64_t btime;
-    uint64_t itime;
-} XFSQuotaInfo;
+typedef QuotaRecord XFSQuotaInfo;
 
-typedef struct {
-    XFSQuotaInfo *items;
-    int count;
-    int capacity;
-} XFSQuotaList;
+typedef QuotaRecordList XFSQuotaList;
+
+typedef struct xfs_quota_cursor XFSQuotaCursor;
 
 int xfs_set_quota(const char *path, uint32_t id, int type, 
                   uint64_t bhard, uint64_t bsoft, 
                   uint64_t ihard, uint64_t isoft);
 
+int xfs_handle_set_quota(quota_handle_t *handle, uint32_t id, int type,
+                         uint64_t bhard, uint64_t bsoft,
+                         uint64_t ihard, uint64_t isoft);
+
+// 解析一次设备后依次应用 limits；errors[i] 为第 i 条的结果（0 或 errno）
+int xfs_set_quotas(const char *path, const QuotaLimit *limits, size_t count,
+                   int *errors, int workers);
+
+int xfs_handle_set_quotas(quota_handle_t *handle, const QuotaLimit *limits, size_t count,
+                          int *errors, int workers);
+
 int xfs_get_quota(const char *path, uint32_t id, int type, XFSQuotaInfo *info);
 
+int xfs_handle_get_quota(quota_handle_t *handle, uint32_t id, int type, XFSQuotaInfo *info);
+
+// 查询一组 ID：结果按输入顺序写入 out，errors[i] 为第 i 个 ID 的结果。
+// 没有配额记录的 ID 得到一条全零记录，不视为错误。
+int xfs_get_quotas(const char *path, int type, const uint32_t *ids, size_t count,
+                   XFSQuotaInfo *out, int *errors);
+
+int xfs_handle_get_quotas(quota_handle_t *handle, int type, const uint32_t *ids, size_t count,
+                          XFSQuotaInfo *out, int *errors);
+
 int xfs_list_quotas(const char *path, int type, XFSQuotaList *list, int max_id);
 
+int xfs_handle_list_quotas(quota_handle_t *handle, int type, XFSQuotaList *list, int max_id);
+
 void xfs_free_quota_list(XFSQuotaList *list);
 
+int xfs_list_begin(const char *path, int type, uint64_t token, XFSQuotaCursor **cursor);
+
+int xfs_handle_list_begin(quota_handle_t *handle, int type, uint64_t token, XFSQuotaCursor **cursor);
+
+// 把最多 batch_size 条记录写入调用方缓冲区；*more 为 0 表示枚举已结束
+int xfs_list_next(XFSQuotaCursor *cursor, XFSQuotaInfo *batch, int batch_size, int *count, int *more);
+
+uint64_t xfs_list_token(const XFSQuotaCursor *cursor);
+
+void xfs_list_end(XFSQuotaCursor *cursor);
+
 int xfs_test_quota(const char *path, uint32_t id, int type);
 
+int xfs_handle_test_quota(quota_handle_t *handle, uint32_t id, int type);
+
 int xfs_remove_quota(const char *path, uint32_t id, int type);
 
+int xfs_handle_remove_quota(quota_handle_t *handle, uint32_t id, int type);
+
+typedef struct {
+    uint64_t inodes;  // 扫描到的 inode 数
+    uint32_t version; // 实际使用的 bulkstat 版本：5 为 XFS_IOC_BULKSTAT，1 为 XFS_IOC_FSBULKSTAT
+    uint32_t ags;     // 按分配组并行扫描时的分配组数，v1 时为 0
+} XFSCensusStats;
+
+// 用 bulkstat 按 inode 顺序扫描整个文件系统，按 type 对应的属主（uid/gid/projid）
+// 汇总 inode 数与占用空间，结果按 ID 升序写入 list：curinodes 为 inode 数，
+// curblocks 为占用空间（1 KiB，含延迟分配），限额字段为 0。需要 CAP_SYS_ADMIN。
+int xfs_census(const char *path, int type, int workers, XFSQuotaList *list, XFSCensusStats *stats);
+
+int xfs_handle_census(quota_handle_t *handle, int type, int workers, XFSQuotaList *list, XFSCensusStats *stats);
+
 const char* xfs_error_string(int err);
 
 #ifdef __cplusplus
@@ -0,0 +1,421 @@
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <sys/ioctl.h>
+#include <linux/types.h>
+#include "quota_xfs.h"
+
+// 以下结构来自 xfsprogs 的 xfs_fs.h。内核 uapi 不导出它们，
+// 这里按原样定义，避免引入 xfsprogs-devel 依赖。
+
+typedef struct {
+    uint32_t blocksize;
+    uint32_t rtextsize;
+    uint32_t agblocks;
+    uint32_t agcount;
+    uint32_t logblocks;
+    uint32_t sectsize;
+    uint32_t inodesize;
+    uint32_t imaxpct;
+    uint64_t datablocks;
+    uint64_t rtblocks;
+    uint64_t rtextents;
+    uint64_t logstart;
+    unsigned char uuid[16];
+    uint32_t sunit;
+    uint32_t swidth;
+    int32_t version;
+    uint32_t flags;
+    uint32_t logsectsize;
+    uint32_t rtsectsize;
+    uint32_t dirblocksize;
+} census_fsop_geom_v1;
+
+// v5 bulkstat（Linux 5.2+）：可以限定在单个分配组内扫描
+typedef struct {
+    uint64_t bs_ino;
+    uint64_t bs_size;
+    uint64_t bs_blocks; // 文件系统块，含延迟分配
+    uint64_t bs_xflags;
+    int64_t bs_atime;
+    int64_t bs_mtime;
+    int64_t bs_ctime;
+    int64_t bs_btime;
+    uint32_t bs_gen;
+    uint32_t bs_uid;
+    uint32_t bs_gid;
+    uint32_t bs_projectid;
+    uint32_t bs_atime_nsec;
+    uint32_t bs_mtime_nsec;
+    uint32_t bs_ctime_nsec;
+    uint32_t bs_btime_nsec;
+    uint32_t bs_blksize;
+    uint32_t bs_rdev;
+    uint32_t bs_cowextsize_blks;
+    uint32_t bs_extsize_blks;
+    uint32_t bs_nlink;
+    uint32_t bs_extents;
+    uint32_t bs_aextents;
+    uint16_t bs_version;
+    uint16_t bs_forkoff;
+    uint16_t bs_sick;
+    uint16_t bs_checked;
+    uint16_t bs_mode;
+    uint16_t bs_pad2;
+    uint64_t bs_extents64;
+    uint64_t bs_pad[6];
+} census_bulkstat;
+
+typedef struct {
+    uint64_t ino;
+    uint32_t flags;
+    uint32_t icount;
+    uint32_t ocount;
+    uint32_t agno;
+    uint64_t reserved[5];
+} census_bulk_ireq;
+
+typedef struct {
+    census_bulk_ireq hdr;
+    census_bulkstat bulkstat[];
+} census_bulkstat_req;
+
+// v1 bulkstat：所有内核都有，只能整盘顺序扫描
+typedef struct {
+    long tv_sec;
+    int32_t tv_nsec;
+} census_bstime;
+
+typedef struct {
+    uint64_t bs_ino;
+    uint16_t bs_mode;
+    uint16_t bs_nlink16;
+    uint32_t bs_uid;
+    uint32_t bs_gid;
+    uint32_t bs_rdev;
+    int32_t bs_blksize;
+    int64_t bs_size;
+    census_bstime bs_atime;
+    census_bstime bs_mtime;
+    census_bstime bs_ctime;
+    int64_t bs_blocks; // 文件系统块，含延迟分配
+    uint32_t bs_xflags;
+    int32_t bs_extsize;
+    int32_t bs_extents;
+    uint32_t bs_gen;
+    uint16_t bs_projid_lo;
+    uint16_t bs_forkoff;
+    uint16_t bs_projid_hi;
+    uint16_t bs_sick;
+    uint16_t bs_checked;
+    unsigned char bs_pad[2];
+    uint32_t bs_cowextsize;
+    uint32_t bs_dmevmask;
+    uint16_t bs_dmstate;
+    uint16_t bs_aextents;
+} census_bstat;
+
+typedef struct {
+    uint64_t *lastip;
+    int32_t icount;
+    void *ubuffer;
+    int32_t *ocount;
+} census_fsop_bulkreq;
+
+_Static_assert(sizeof(census_fsop_geom_v1) == 112, "xfs_fsop_geom_v1 layout");
+_Static_assert(sizeof(census_bulkstat) == 192, "xfs_bulkstat layout");
+_Static_assert(sizeof(census_bulk_ireq) == 64, "xfs_bulk_ireq layout");
+_Static_assert(sizeof(census_bstat) == 136, "xfs_bstat layout");
+
+#define CENSUS_IOC_FSGEOMETRY_V1 _IOR('X', 100, census_fsop_geom_v1)
+#define CENSUS_IOC_FSBULKSTAT _IOWR('X', 101, census_fsop_bulkreq)
+#define CENSUS_IOC_BULKSTAT _IOR('X', 127, census_bulkstat_req)
+
+#define XFS_QUOTA_USRQUOTA 0
+#define XFS_QUOTA_GRPQUOTA 1
+#define XFS_QUOTA_PRJQUOTA 2
+
+#define CENSUS_BULK_IREQ_AGNO (1U << 0)
+
+// 每次 ioctl 取回的记录数；v5 时每个线程一块约 768 KiB 的缓冲
+#define CENSUS_BATCH 4096
+
+typedef struct {
+    uint32_t id;
+    uint32_t used;
+    uint64_t inodes;
+    uint64_t bytes;
+} CensusSlot;
+
+// 以 ID 为键的开放寻址表，每个线程一张，最后合并
+typedef struct {
+    CensusSlot *slots;
+    size_t capacity;
+    size_t count;
+} CensusMap;
+
+static size_t census_slot(uint32_t id, size_t capacity) {
+    return (size_t)((id * 2654435761u) & (capacity - 1));
+}
+
+static int census_map_grow(CensusMap *map) {
+    size_t capacity = map->capacity ? map->capacity * 2 : 256;
+    CensusSlot *slots = (CensusSlot *)calloc(capacity, sizeof(CensusSlot));
+    if (!slots) {
+        return ENOMEM;
+    }
+    for (size_t i = 0; i < map->capacity; i++) {
+        if (map->slots[i].used) {
+            size_t j = census_slot(map->slots[i].id, capacity);
+            while (slots[j].used) {
+                j = (j + 1) & (capacity - 1);
+            }
+            slots[j] = map->slots[i];
+        }
+    }
+    free(map->slots);
+    map->slots = slots;
+    map->capacity = capacity;
+    return 0;
+}
+
+static int census_add(CensusMap *map, uint32_t id, uint64_t inodes, uint64_t bytes) {
+    if ((map->count + 1) * 2 > map->capacity && census_map_grow(map) != 0) {
+        return ENOMEM;
+    }
+    size_t i = census_slot(id, map->capacity);
+    while (map->slots[i].used && map->slots[i].id != id) {
+        i = (i + 1) & (map->capacity - 1);
+    }
+    if (!map->slots[i].used) {
+        map->slots[i].used = 1;
+        map->slots[i].id = id;
+        map->count++;
+    }
+    map->slots[i].inodes += inodes;
+    map->slots[i].bytes += bytes;
+    return 0;
+}
+
+static uint32_t census_owner(int type, uint32_t uid, uint32_t gid, uint32_t projid) {
+    return type == XFS_QUOTA_USRQUOTA ? uid : type == XFS_QUOTA_GRPQUOTA ? gid : projid;
+}
+
+typedef struct {
+    int fd;
+    int type;
+    int error;
+    CensusMap maps[QUOTA_MAX_WORKERS];
+    census_bulkstat_req *bufs[QUOTA_MAX_WORKERS];
+    uint64_t inodes[QUOTA_MAX_WORKERS];
+} CensusJob;
+
+static void census_fail(CensusJob *job, int err) {
+    int expected = 0;
+    __atomic_compare_exchange_n(&job->error, &expected, err, 0, __ATOMIC_RELAXED, __ATOMIC_RELAXED);
+}
+
+// 扫描一个分配组；bulkstat 每次把 hdr.ino 推进到下一个待取的 inode
+static void census_scan_ag(size_t index, int worker, void *arg) {
+    CensusJob *job = (CensusJob *)arg;
+    if (__atomic_load_n(&job->error, __ATOMIC_RELAXED) != 0) {
+        return;
+    }
+
+    census_bulkstat_req *req = job->bufs[worker];
+    if (!req) {
+        req = (census_bulkstat_req *)malloc(sizeof(census_bulkstat_req) + CENSUS_BATCH * sizeof(census_bulkstat));
+        if (!req) {
+            census_fail(job, ENOMEM);
+            return;
+        }
+        job->bufs[worker] = req;
+    }
+
+    memset(&req->hdr, 0, sizeof(req->hdr));
+    req->hdr.flags = CENSUS_BULK_IREQ_AGNO;
+    req->hdr.agno = (uint32_t)index;
+
+    for (;;) {
+        req->hdr.icount = CENSUS_BATCH;
+        req->hdr.ocount = 0;
+        if (ioctl(job->fd, CENSUS_IOC_BULKSTAT, req) < 0) {
+            census_fail(job, errno);
+            return;
+        }
+        if (req->hdr.ocount == 0) {
+            return;
+        }
+
+        for (uint32_t i = 0; i < req->hdr.ocount; i++) {
+            const census_bulkstat *bs = &req->bulkstat[i];
+            uint32_t id = census_owner(job->type, bs->bs_uid, bs->bs_gid, bs->bs_projectid);
+            if (census_add(&job->maps[worker], id, 1, bs->bs_blocks * bs->bs_blksize) != 0) {
+                census_fail(job, ENOMEM);
+                return;
+            }
+        }
+        job->inodes[worker] += req->hdr.ocount;
+    }
+}
+
+static void census_scan_rest(size_t index, int worker, void *arg) {
+    census_scan_ag(index + 1, worker, arg);
+}
+
+// 旧内核没有 v5 时整盘单线程扫描
+static int census_scan_v1(CensusJob *job) {
+    census_bstat *buf = (census_bstat *)malloc(CENSUS_BATCH * sizeof(census_bstat));
+    if (!buf) {
+        return ENOMEM;
+    }
+
+    uint64_t last = 0;
+    int32_t count = 0;
+    census_fsop_bulkreq req = {&last, CENSUS_BATCH, buf, &count};
+
+    int ret = 0;
+    for (;;) {
+        if (ioctl(job->fd, CENSUS_IOC_FSBULKSTAT, &req) < 0) {
+            ret = errno;
+            break;
+        }
+        if (count <= 0) {
+            break;
+        }
+
+        for (int32_t i = 0; i < count; i++) {
+            const census_bstat *bs = &buf[i];
+            uint32_t projid = ((uint32_t)bs->bs_projid_hi << 16) | bs->bs_projid_lo;
+            uint32_t id = census_owner(job->type, bs->bs_uid, bs->bs_gid, projid);
+            if ((ret = census_add(&job->maps[0], id, 1, (uint64_t)bs->bs_blocks * (uint64_t)bs->bs_blksize)) != 0) {
+                break;
+            }
+        }
+        if (ret != 0) {
+            break;
+        }
+        job->inodes[0] += (uint64_t)count;
+    }
+
+    free(buf);
+    return ret;
+}
+
+static int compare_records(const void *a, const void *b) {
+    uint32_t x = ((const XFSQuotaInfo *)a)->id;
+    uint32_t y = ((const XFSQuotaInfo *)b)->id;
+    return x < y ? -1 : (x > y);
+}
+
+// 合并各线程的表，按 ID 排序输出
+static int census_collect(CensusJob *job, int type, XFSQuotaList *list, XFSCensusStats *stats) {
+    CensusMap *total = &job->maps[0];
+    for (int w = 1; w < QUOTA_MAX_WORKERS; w++) {
+        CensusMap *map = &job->maps[w];
+        for (size_t i = 0; i < map->capacity; i++) {
+            if (map->slots[i].used &&
+                census_add(total, map->slots[i].id, map->slots[i].inodes, map->slots[i].bytes) != 0) {
+                return ENOMEM;
+            }
+        }
+        stats->inodes += job->inodes[w];
+    }
+    stats->inodes += job->inodes[0];
+
+    size_t capacity = total->count ? total->count : 1;
+    XFSQuotaInfo *items = (XFSQuotaInfo *)calloc(capacity, sizeof(XFSQuotaInfo));
+    if (!items) {
+        return ENOMEM;
+    }
+
+    size_t n = 0;
+    for (size_t i = 0; i < total->capacity; i++) {
+        if (total->slots[i].used) {
+            items[n].id = total->slots[i].id;
+            items[n].qtype = (uint32_t)type;
+            items[n].curinodes = total->slots[i].inodes;
+            items[n].curblocks = (total->slots[i].bytes + 1023) / 1024;
+            n++;
+        }
+    }
+    qsort(items, n, sizeof(XFSQuotaInfo), compare_records);
+
+    list->items = items;
+    list->count = n;
+    list->capacity = capacity;
+    return 0;
+}
+
+int xfs_handle_census(quota_handle_t *handle, int type, int workers, XFSQuotaList *list, XFSCensusStats *stats) {
+    if (!handle || !list || !stats || type < XFS_QUOTA_USRQUOTA || type > XFS_QUOTA_PRJQUOTA) {
+        return EINVAL;
+    }
+    memset(stats, 0, sizeof(*stats));
+
+    CensusJob *job = (CensusJob *)calloc(1, sizeof(CensusJob));
+    if (!job) {
+        return ENOMEM;
+    }
+    job->type = type;
+    job->fd = open(quota_handle_mount_point(handle), O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+    if (job->fd < 0) {
+        int err = errno;
+        free(job);
+        return err;
+    }
+
+    // 先在调用线程扫描 0 号分配组，顺便探测 v5 是否可用
+    int ret = 0;
+    census_fsop_geom_v1 geom;
+    memset(&geom, 0, sizeof(geom));
+    if (ioctl(job->fd, CENSUS_IOC_FSGEOMETRY_V1, &geom) < 0) {
+        ret = errno;
+    } else {
+        census_scan_ag(0, 0, job);
+        if (job->error == ENOTTY || job->error == EINVAL) {
+            // 内核不认识 XFS_IOC_BULKSTAT（或 AGNO 标志）
+            job->error = 0;
+            job->inodes[0] = 0;
+            free(job->maps[0].slots);
+            memset(&job->maps[0], 0, sizeof(job->maps[0]));
+            stats->version = 1;
+            ret = census_scan_v1(job);
+        } else {
+            stats->version = 5;
+            stats->ags = geom.agcount;
+            if (job->error == 0 && geom.agcount > 1) {
+                // 其余分配组并行扫描，下标从 1 开始
+                quota_run_parallel(geom.agcount - 1, workers, census_scan_rest, job);
+            }
+            ret = job->error;
+        }
+    }
+
+    if (ret == 0) {
+        ret = census_collect(job, type, list, stats);
+    }
+
+    for (int w = 0; w < QUOTA_MAX_WORKERS; w++) {
+        free(job->maps[w].slots);
+        free(job->bufs[w]);
+    }
+    close(job->fd);
+    free(job);
+    return ret;
+}
+
+int xfs_census(const char *path, int type, int workers, XFSQuotaList *list, XFSCensusStats *stats) {
+    quota_handle_t *handle;
+    if (quota_handle_open(path, &handle) != 0) {
+        return ENODEV;
+    }
+
+    int ret = xfs_handle_census(handle, type, workers, list, stats);
+    quota_handle_close(handle);
+    return ret;
+}
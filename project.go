@@ -1,88 +1,179 @@
 package quota
 
+/*
+#cgo LDFLAGS: ${SRCDIR}/pkg/common/quota_project.o
+#include <stdlib.h>
+#include "pkg/common/quota_common.h"
+*/
+import "C"
+
 import (
 	"fmt"
-	"os"
-	"path/filepath"
+	"runtime"
+	"sync/atomic"
+	"syscall"
+	"time"
+	"unsafe"
 )
 
 // GetFilesystemType 获取指定路径的文件系统类型
 func GetFilesystemType(path string) (FileSystemType, error) {
-	return DetectFileSystem(path)
+	return lookupFileSystem(path)
 }
 
 // SetProjectIDXFS 在XFS文件系统上设置project ID（使用ioctl系统调用）
 func SetProjectIDXFS(path string, projectID int) error {
-	return setProjectIDXFS(path, projectID)
+	if err := setProjectIDXFS(path, projectID); err != nil {
+		return err
+	}
+	return noteProjectID(path, false)
 }
 
 // SetProjectIDExt4 在ext4文件系统上设置project ID（使用ioctl系统调用）
 func SetProjectIDExt4(path string, projectID int) error {
-	return setProjectIDExt4(path, projectID)
+	if err := setProjectIDExt4(path, projectID); err != nil {
+		return err
+	}
+	return noteProjectID(path, false)
 }
 
 // SetProjectID 设置文件或目录的project ID（使用ioctl系统调用）
 func SetProjectID(path string, projectID int) error {
-	fsType, err := DetectFileSystem(path)
+	fsType, err := lookupFileSystem(path)
 	if err != nil {
 		return err
 	}
 
 	switch fsType {
 	case FileSystemXFS:
-		return setProjectIDXFS(path, projectID)
+		err = setProjectIDXFS(path, projectID)
 	case FileSystemEXT4:
-		return setProjectIDExt4(path, projectID)
+		err = setProjectIDExt4(path, projectID)
 	default:
 		return fmt.Errorf("不支持的文件系统类型: %s", fsType)
 	}
+	if err != nil {
+		return err
+	}
+	return noteProjectID(path, false)
+}
+
+// ProjectTagStats 是递归设置项目 ID 的进度与结果
+type ProjectTagStats struct {
+	Dirs      uint64 // 已处理的目录（含无需改写的）
+	Files     uint64 // 已处理的普通文件（含无需改写的）
+	Unchanged uint64 // 其中已经正确、没有写入的项
+	Resumed   uint64 // 按检查点跳过的、上次已完成的子树
+	Skipped   uint64 // 跳过的符号链接、设备/管道/套接字、其他文件系统上的目录、遍历中消失的项
+	Errors    uint64 // 设置失败的项
+	Elapsed   time.Duration
+}
+
+// Rate 返回每秒处理的目录与文件数
+func (s ProjectTagStats) Rate() float64 {
+	if s.Elapsed <= 0 {
+		return 0
+	}
+	return float64(s.Dirs+s.Files) / s.Elapsed.Seconds()
+}
+
+// ProjectTagOptions 控制 SetProjectIDRecursiveWithOptions
+type ProjectTagOptions struct {
+	Workers          int                   // 遍历线程数，<= 0 时取 CPU 数
+	Progress         func(ProjectTagStats) // 非空时按 ProgressInterval 周期回调，结束时再回调一次
+	ProgressInterval time.Duration         // 默认 1 秒
+	// Checkpoint 非空时定期把已完成子树记录到该文件；中断后以相同 path 和 projectID 重跑会跳过这些子树，
+	// 全部完成后文件被删除。文件属于别的根目录或项目 ID 时被忽略。
+	Checkpoint string
 }
 
 // SetProjectIDRecursive 递归设置目录及其所有子目录和文件的project ID
 func SetProjectIDRecursive(path string, projectID int) error {
-	fsType, err := DetectFileSystem(path)
+	_, err := SetProjectIDRecursiveWithOptions(path, projectID, ProjectTagOptions{})
+	return err
+}
+
+// SetProjectIDRecursiveWithOptions 在 C 端用 openat/getdents64 多线程遍历并设置 project ID，
+// 整个遍历只跨越一次 cgo。projid 与 PROJINHERIT 已经正确的项只读不写。
+// 不跟随符号链接，不进入挂载在树内的其他文件系统；
+// 遇到第一个错误即停止，返回的统计反映停止前的进度。
+func SetProjectIDRecursiveWithOptions(path string, projectID int, opts ProjectTagOptions) (ProjectTagStats, error) {
+	fsType, err := lookupFileSystem(path)
 	if err != nil {
-		return err
+		return ProjectTagStats{}, err
 	}
-
-	switch fsType {
-	case FileSystemXFS:
-		return setProjectIDXFSRecursive(path, projectID)
-	case FileSystemEXT4:
-		return setProjectIDExt4Recursive(path, projectID)
-	default:
-		return fmt.Errorf("不支持的文件系统类型: %s", fsType)
+	if fsType != FileSystemXFS && fsType != FileSystemEXT4 {
+		return ProjectTagStats{}, fmt.Errorf("不支持的文件系统类型: %s", fsType)
 	}
-}
 
-// setProjectIDXFSRecursive 在XFS文件系统上递归设置project ID
-func setProjectIDXFSRecursive(path string, projectID int) error {
-	return filepath.Walk(path, func(filePath string, info os.FileInfo, err error) error {
-		if err != nil {
-			return err
-		}
+	workers := opts.Workers
+	if workers <= 0 {
+		workers = runtime.NumCPU()
+	}
+	interval := opts.ProgressInterval
+	if interval <= 0 {
+		interval = time.Second
+	}
 
-		if err := setProjectIDXFS(filePath, projectID); err != nil {
-			return err
-		}
+	cPath := C.CString(path)
+	defer C.free(unsafe.Pointer(cPath))
 
-		return nil
-	})
-}
+	var cCheckpoint *C.char
+	if opts.Checkpoint != "" {
+		cCheckpoint = C.CString(opts.Checkpoint)
+		defer C.free(unsafe.Pointer(cCheckpoint))
+	}
 
-// setProjectIDExt4Recursive 在ext4文件系统上递归设置project ID
-func setProjectIDExt4Recursive(path string, projectID int) error {
-	return filepath.Walk(path, func(filePath string, info os.FileInfo, err error) error {
-		if err != nil {
-			return err
+	// 统计放在 C 内存中：C 线程原子累加，Go 端在遍历期间原子读取
+	cStats := (*C.QuotaTagStats)(C.calloc(1, C.size_t(unsafe.Sizeof(C.QuotaTagStats{}))))
+	if cStats == nil {
+		return ProjectTagStats{}, syscall.ENOMEM
+	}
+	defer C.free(unsafe.Pointer(cStats))
+
+	start := time.Now()
+	snapshot := func() ProjectTagStats {
+		return ProjectTagStats{
+			Dirs:      atomic.LoadUint64((*uint64)(unsafe.Pointer(&cStats.dirs))),
+			Files:     atomic.LoadUint64((*uint64)(unsafe.Pointer(&cStats.files))),
+			Unchanged: atomic.LoadUint64((*uint64)(unsafe.Pointer(&cStats.unchanged))),
+			Resumed:   atomic.LoadUint64((*uint64)(unsafe.Pointer(&cStats.resumed))),
+			Skipped:   atomic.LoadUint64((*uint64)(unsafe.Pointer(&cStats.skipped))),
+			Errors:    atomic.LoadUint64((*uint64)(unsafe.Pointer(&cStats.errors))),
+			Elapsed:   time.Since(start),
 		}
+	}
 
-		if err := setProjectIDExt4(filePath, projectID); err != nil {
-			return err
+	done := make(chan C.int, 1)
+	go func() {
+		done <- C.quota_tag_project(cPath, C.uint32_t(projectID), C.int(workers), cCheckpoint, cStats)
+	}()
+
+	var ret C.int
+	if opts.Progress == nil {
+		ret = <-done
+	} else {
+		ticker := time.NewTicker(interval)
+		defer ticker.Stop()
+	wait:
+		for {
+			select {
+			case ret = <-done:
+				break wait
+			case <-ticker.C:
+				opts.Progress(snapshot())
+			}
 		}
+	}
 
-		return nil
-	})
+	stats := snapshot()
+	if opts.Progress != nil {
+		opts.Progress(stats)
+	}
+	if ret != 0 {
+		return stats, fmt.Errorf("递归设置project ID失败: %s", syscall.Errno(ret).Error())
+	}
+	return stats, noteProjectID(path, true)
 }
 
 // GetProjectID 获取文件或目录的project ID（使用ioctl系统调用）
@@ -92,5 +183,8 @@ func GetProjectID(path string) (int, error) {
 
 // ClearProjectID 清除文件或目录的project ID（使用ioctl系统调用）
 func ClearProjectID(path string) error {
-	return clearProjectID(path)
+	if err := clearProjectID(path); err != nil {
+		return err
+	}
+	return noteProjectID(path, false)
 }
@@ -0,0 +1,356 @@
+package quota
+
+/*
+#cgo LDFLAGS: ${SRCDIR}/pkg/common/quota_project_roots.o
+#include <stdlib.h>
+#include "pkg/common/quota_common.h"
+*/
+import "C"
+
+import (
+	"encoding/json"
+	"fmt"
+	"os"
+	"path/filepath"
+	"runtime"
+	"sort"
+	"strings"
+	"sync"
+	"syscall"
+	"time"
+	"unsafe"
+)
+
+const projectIndexVersion = 1
+
+// ProjectIndex 是项目 ID 到其根目录（PROJINHERIT 开始生效的目录）的反向索引，持久化在一个 JSON 文件里。
+// 由 BuildProjectIndex 扫描一次建立；打开期间本库的 SetProjectID、SetProjectIDRecursive*
+// 和 ClearProjectID 对 Root 下目录的修改会同步写入索引。绕过本库的修改需要重新扫描。
+type ProjectIndex struct {
+	mu     sync.RWMutex
+	file   string
+	root   string
+	built  time.Time
+	roots  map[uint32][]string
+	byPath map[string]uint32
+}
+
+type projectIndexFile struct {
+	Version  int                 `json:"version"`
+	Root     string              `json:"root"`
+	BuiltAt  time.Time           `json:"built_at"`
+	Projects map[uint32][]string `json:"projects"`
+}
+
+// projectIndexes 是当前打开的索引；SetProjectID* 成功后逐个更新覆盖该路径的索引
+var projectIndexes = struct {
+	sync.RWMutex
+	list []*ProjectIndex
+}{}
+
+// indexPath 把路径规范成扫描时使用的形式：绝对路径并解析符号链接
+func indexPath(path string) (string, error) {
+	abs, err := filepath.Abs(path)
+	if err != nil {
+		return "", err
+	}
+	return filepath.EvalSymlinks(abs)
+}
+
+func underRoot(root, path string) bool {
+	return path == root || strings.HasPrefix(path, strings.TrimSuffix(root, "/")+"/")
+}
+
+// BuildProjectIndex 多线程扫描 root 下的全部目录建立索引，写入 file 并打开。
+// 扫描只读目录的 fsxattr，不碰普通文件；workers <= 0 时取 CPU 数。
+func BuildProjectIndex(root, file string, workers int) (*ProjectIndex, error) {
+	root, err := indexPath(root)
+	if err != nil {
+		return nil, err
+	}
+	if workers <= 0 {
+		workers = runtime.NumCPU()
+	}
+
+	cRoot := C.CString(root)
+	defer C.free(unsafe.Pointer(cRoot))
+
+	var list C.QuotaProjectRootList
+	ret := C.quota_scan_project_roots(cRoot, C.int(workers), &list, nil)
+	if ret != 0 {
+		return nil, fmt.Errorf("扫描项目根目录失败: %s", syscall.Errno(ret).Error())
+	}
+	defer C.quota_free_project_roots(&list)
+
+	x := &ProjectIndex{
+		file:   file,
+		root:   root,
+		built:  time.Now(),
+		roots:  make(map[uint32][]string),
+		byPath: make(map[string]uint32),
+	}
+	for _, r := range unsafe.Slice(list.items, int(list.count)) {
+		x.add(C.GoString(r.path), uint32(r.project_id))
+	}
+
+	if err := x.save(); err != nil {
+		return nil, err
+	}
+	x.register()
+	return x, nil
+}
+
+// OpenProjectIndex 打开 BuildProjectIndex 写下的索引文件
+func OpenProjectIndex(file string) (*ProjectIndex, error) {
+	data, err := os.ReadFile(file)
+	if err != nil {
+		return nil, err
+	}
+
+	var f projectIndexFile
+	if err := json.Unmarshal(data, &f); err != nil {
+		return nil, fmt.Errorf("解析项目索引失败: %w", err)
+	}
+	if f.Version != projectIndexVersion {
+		return nil, fmt.Errorf("不支持的项目索引版本: %d", f.Version)
+	}
+
+	x := &ProjectIndex{
+		file:   file,
+		root:   f.Root,
+		built:  f.BuiltAt,
+		roots:  make(map[uint32][]string),
+		byPath: make(map[string]uint32),
+	}
+	for id, paths := range f.Projects {
+		for _, p := range paths {
+			x.add(p, id)
+		}
+	}
+	x.register()
+	return x, nil
+}
+
+// Root 返回索引覆盖的目录
+func (x *ProjectIndex) Root() string {
+	return x.root
+}
+
+// BuiltAt 返回建立索引的扫描时间
+func (x *ProjectIndex) BuiltAt() time.Time {
+	return x.built
+}
+
+// Lookup 返回带有 projectID 的根目录，按路径排序；不存在时返回 nil
+func (x *ProjectIndex) Lookup(projectID uint32) []string {
+	x.mu.RLock()
+	defer x.mu.RUnlock()
+	return append([]string(nil), x.roots[projectID]...)
+}
+
+// Projects 返回索引中的全部项目 ID，升序
+func (x *ProjectIndex) Projects() []uint32 {
+	x.mu.RLock()
+	defer x.mu.RUnlock()
+	ids := make([]uint32, 0, len(x.roots))
+	for id := range x.roots {
+		ids = append(ids, id)
+	}
+	sort.Slice(ids, func(i, j int) bool { return ids[i] < ids[j] })
+	return ids
+}
+
+// Close 停止随 SetProjectID* 更新索引；文件保留
+func (x *ProjectIndex) Close() error {
+	projectIndexes.Lock()
+	defer projectIndexes.Unlock()
+	for i, other := range projectIndexes.list {
+		if other == x {
+			projectIndexes.list = append(projectIndexes.list[:i], projectIndexes.list[i+1:]...)
+			break
+		}
+	}
+	return nil
+}
+
+func (x *ProjectIndex) register() {
+	projectIndexes.Lock()
+	projectIndexes.list = append(projectIndexes.list, x)
+	projectIndexes.Unlock()
+}
+
+func (x *ProjectIndex) add(path string, id uint32) {
+	if old, ok := x.byPath[path]; ok {
+		if old == id {
+			return
+		}
+		x.remove(path)
+	}
+	paths := x.roots[id]
+	i := sort.SearchStrings(paths, path)
+	paths = append(paths, "")
+	copy(paths[i+1:], paths[i:])
+	paths[i] = path
+	x.roots[id] = paths
+	x.byPath[path] = id
+}
+
+func (x *ProjectIndex) remove(path string) {
+	id, ok := x.byPath[path]
+	if !ok {
+		return
+	}
+	delete(x.byPath, path)
+	paths := x.roots[id]
+	if i := sort.SearchStrings(paths, path); i < len(paths) && paths[i] == path {
+		paths = append(paths[:i], paths[i+1:]...)
+	}
+	if len(paths) == 0 {
+		delete(x.roots, id)
+	} else {
+		x.roots[id] = paths
+	}
+}
+
+// projectChange 是一次成功的 SetProjectID*，path 为目录
+type projectChange struct {
+	path      string
+	recursive bool // 整棵子树都已设置
+	fresh     bool // 刚建的空目录，没有需要重新判定的子目录
+}
+
+// update 把一批修改应用到索引，整批只写一次文件
+func (x *ProjectIndex) update(changes []projectChange) error {
+	x.mu.Lock()
+	defer x.mu.Unlock()
+
+	for _, c := range changes {
+		x.apply(c)
+	}
+	return x.save()
+}
+
+// apply 在 c.path 的项目 ID 被修改后重新判定它是否为根。recursive 时整棵子树已是同一项目，其下原有的根全部作废；
+// 否则直接子目录与它的继承关系可能变了（原先继承旧 ID 的子目录成了旧项目的根），逐个重新判定。
+func (x *ProjectIndex) apply(c projectChange) {
+	x.recheck(c.path)
+	if c.recursive {
+		prefix := strings.TrimSuffix(c.path, "/") + "/"
+		for p := range x.byPath {
+			if strings.HasPrefix(p, prefix) {
+				x.remove(p)
+			}
+		}
+	} else if !c.fresh {
+		if entries, err := os.ReadDir(c.path); err == nil {
+			for _, entry := range entries {
+				if entry.IsDir() {
+					x.recheck(filepath.Join(c.path, entry.Name()))
+				}
+			}
+		}
+	}
+}
+
+// recheck 按扫描时 roots_check 的规则重新判定一个目录：带 PROJINHERIT 的非 0 项目目录，
+// 且父目录不是带 PROJINHERIT 的同一项目，才是根；读不到父目录时按不继承处理
+func (x *ProjectIndex) recheck(path string) {
+	x.remove(path)
+	id, inherit, err := getProjectAttr(path)
+	if err != nil || !inherit || id == 0 {
+		return
+	}
+	if path != "/" {
+		if parent, parentInherit, err := getProjectAttr(filepath.Dir(path)); err == nil && parentInherit && parent == id {
+			return
+		}
+	}
+	x.add(path, uint32(id))
+}
+
+// save 写临时文件再改名，调用方持有锁（或索引尚未发布）
+func (x *ProjectIndex) save() error {
+	f := projectIndexFile{
+		Version:  projectIndexVersion,
+		Root:     x.root,
+		BuiltAt:  x.built,
+		Projects: x.roots,
+	}
+	data, err := json.Marshal(&f)
+	if err != nil {
+		return err
+	}
+
+	tmp := x.file + ".tmp"
+	fp, err := os.OpenFile(tmp, os.O_WRONLY|os.O_CREATE|os.O_TRUNC, 0644)
+	if err != nil {
+		return err
+	}
+	if _, err = fp.Write(data); err == nil {
+		err = fp.Sync()
+	}
+	if cerr := fp.Close(); err == nil {
+		err = cerr
+	}
+	if err == nil {
+		err = os.Rename(tmp, x.file)
+	}
+	if err != nil {
+		os.Remove(tmp)
+	}
+	return err
+}
+
+// noteProjectID 在 SetProjectID* 成功后更新所有覆盖 path 的已打开索引
+func noteProjectID(path string, recursive bool) error {
+	return noteProjectIDs([]projectChange{{path: path, recursive: recursive}})[0]
+}
+
+// noteProjectIDs 在一批 SetProjectID* 成功后更新所有覆盖这些路径的已打开索引，每个索引只写一次文件；
+// 返回的错误与 changes 一一对应。只有目录可能是根，其他路径直接忽略
+func noteProjectIDs(changes []projectChange) []error {
+	errs := make([]error, len(changes))
+	projectIndexes.RLock()
+	indexes := append([]*ProjectIndex(nil), projectIndexes.list...)
+	projectIndexes.RUnlock()
+	if len(indexes) == 0 {
+		return errs
+	}
+
+	resolved := make([]projectChange, len(changes))
+	for i, c := range changes {
+		path, err := indexPath(c.path)
+		if err != nil {
+			errs[i] = err
+			continue
+		}
+		if st, err := os.Stat(path); err != nil || !st.IsDir() {
+			errs[i] = err
+			continue
+		}
+		c.path = path
+		resolved[i] = c
+	}
+
+	for _, x := range indexes {
+		var covered []int
+		var batch []projectChange
+		for i, c := range resolved {
+			if c.path != "" && underRoot(x.root, c.path) {
+				covered = append(covered, i)
+				batch = append(batch, c)
+			}
+		}
+		if len(batch) == 0 {
+			continue
+		}
+		if err := x.update(batch); err != nil {
+			for _, i := range covered {
+				if errs[i] == nil {
+					errs[i] = fmt.Errorf("project ID 已设置，但更新项目索引 %s 失败: %w", x.file, err)
+				}
+			}
+		}
+	}
+	return errs
+}
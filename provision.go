@@ -0,0 +1,373 @@
+package quota
+
+import (
+	"errors"
+	"fmt"
+	"os"
+	"path/filepath"
+	"syscall"
+	"time"
+)
+
+// ProvisionSpec 描述一个要配置的项目目录
+type ProvisionSpec struct {
+	Path string
+	// ProjectID 为 0 时由同一文件系统上的分配器分配，见 ProvisionOptions
+	ProjectID      uint32
+	BlockHardLimit uint64 // 1 KiB 块
+	BlockSoftLimit uint64
+	InodeHardLimit uint64
+	InodeSoftLimit uint64
+	Mode           os.FileMode // 新建目录的权限，0 时为 0755
+}
+
+// ProvisionResult 是单个目录的结果；Err 非空时该目录已回滚
+type ProvisionResult struct {
+	Path      string
+	ProjectID uint32
+	Created   bool // 目录是本次新建的
+	Err       error
+}
+
+// ProvisionTimings 是各阶段在整个批次上的耗时
+type ProvisionTimings struct {
+	Resolve   time.Duration // 解析挂载点与分配项目 ID
+	Mkdir     time.Duration
+	ProjectID time.Duration // 设置 projid 与 PROJINHERIT
+	Limits    time.Duration // 批量设置限额
+	Verify    time.Duration
+	Rollback  time.Duration
+}
+
+// ProvisionOptions 控制 ProvisionProjects
+type ProvisionOptions struct {
+	// Allocator 与 Allocators 为 ProjectID 为 0 的条目分配 ID：每个条目使用建在同一文件系统上的分配器，
+	// 每个文件系统至多一个；失败条目的 ID 会被释放
+	Allocator  *ProjectIDAllocator
+	Allocators []*ProjectIDAllocator
+	Verify     bool // 设置后读回限额核对
+}
+
+// provisionEntry 记录一个条目做到了哪一步，回滚时按相反顺序撤销
+type provisionEntry struct {
+	spec       ProvisionSpec
+	result     *ProvisionResult
+	mount      *mountHandle
+	allocator  *ProjectIDAllocator // 本条目的 ID 由它分配，回滚时释放
+	oldProjID  int                 // 目录原有的项目 ID，新建目录为 -1
+	oldInherit bool                // 目录原有的 PROJINHERIT
+	tagged     bool
+	prior      QuotaInfo // 显式指定的 ID 在设置前的限额
+	hadLimits  bool
+	limited    bool
+}
+
+// ProvisionProjects 为一批目录依次完成：建目录、设置带 PROJINHERIT 的项目 ID、设置项目限额。
+// 挂载点只经注册表解析一次，同一文件系统上的限额用一次批量 quotactl 设置。
+// 目录已存在时沿用。任何一步失败的条目都会回滚：
+// 显式指定的 ID 原有的限额被恢复，本次分配或原本没有限额的 ID 的配额被移除；
+// 恢复原项目 ID 与 PROJINHERIT（或删除本次新建的空目录），释放分配的 ID。
+// 返回的 error 只汇总失败数，逐条原因见结果。
+func ProvisionProjects(specs []ProvisionSpec, opts ProvisionOptions) ([]ProvisionResult, ProvisionTimings, error) {
+	var timings ProvisionTimings
+	results := make([]ProvisionResult, len(specs))
+	entries := make([]*provisionEntry, len(specs))
+
+	allocators := make(map[uint64]*ProjectIDAllocator)
+	for _, a := range append([]*ProjectIDAllocator{opts.Allocator}, opts.Allocators...) {
+		if a == nil {
+			continue
+		}
+		if other, ok := allocators[a.dev]; ok && other != a {
+			return nil, timings, fmt.Errorf("分配器 %s 与 %s 属于同一文件系统", other.path, a.path)
+		}
+		allocators[a.dev] = a
+	}
+
+	start := time.Now()
+	for i, spec := range specs {
+		e := &provisionEntry{spec: spec, result: &results[i], oldProjID: -1}
+		e.result.Path = spec.Path
+		entries[i] = e
+
+		m, err := acquireBackend(filepath.Dir(filepath.Clean(spec.Path)))
+		if err != nil {
+			e.result.Err = err
+			continue
+		}
+		e.mount = m
+		if m.fstype != FileSystemXFS && m.fstype != FileSystemEXT4 {
+			e.result.Err = fmt.Errorf("不支持的文件系统类型: %s", m.fstype)
+		}
+	}
+	defer func() {
+		for _, e := range entries {
+			if e.mount != nil {
+				e.mount.release()
+			}
+		}
+	}()
+
+	// 需要分配 ID 的条目按文件系统分组，每个分配器一次性取；项目 ID 只在各自的文件系统上有意义
+	pending := make(map[*ProjectIDAllocator][]*provisionEntry)
+	var order []*ProjectIDAllocator
+	for _, e := range entries {
+		e.result.ProjectID = e.spec.ProjectID
+		if e.result.Err != nil || e.spec.ProjectID != 0 {
+			continue
+		}
+		a := allocators[e.mount.dev]
+		if a == nil {
+			e.result.Err = fmt.Errorf("未指定项目 ID，也没有 %s 所在文件系统的分配器", e.spec.Path)
+			continue
+		}
+		if len(pending[a]) == 0 {
+			order = append(order, a)
+		}
+		pending[a] = append(pending[a], e)
+	}
+	for _, a := range order {
+		ids, err := a.AllocateN(len(pending[a]))
+		for i, e := range pending[a] {
+			if i < len(ids) {
+				e.result.ProjectID = ids[i]
+				e.allocator = a
+			} else {
+				e.result.Err = err
+			}
+		}
+	}
+	timings.Resolve = time.Since(start)
+
+	start = time.Now()
+	for _, e := range entries {
+		if e.result.Err != nil {
+			continue
+		}
+		mode := e.spec.Mode
+		if mode == 0 {
+			mode = 0755
+		}
+		err := os.Mkdir(e.spec.Path, mode)
+		switch {
+		case err == nil:
+			e.result.Created = true
+		case errors.Is(err, os.ErrExist):
+			if st, serr := os.Stat(e.spec.Path); serr != nil || !st.IsDir() {
+				e.result.Err = fmt.Errorf("%s 已存在且不是目录", e.spec.Path)
+			}
+		default:
+			e.result.Err = err
+		}
+	}
+	timings.Mkdir = time.Since(start)
+
+	start = time.Now()
+	for _, e := range entries {
+		if e.result.Err != nil {
+			continue
+		}
+		if !e.result.Created {
+			old, inherit, err := getProjectAttr(e.spec.Path)
+			if err != nil {
+				e.result.Err = err
+				continue
+			}
+			e.oldProjID = old
+			e.oldInherit = inherit
+		}
+		e.result.Err = setProjectIDOn(e.mount.fstype, e.spec.Path, int(e.result.ProjectID))
+		e.tagged = e.result.Err == nil
+	}
+	timings.ProjectID = time.Since(start)
+
+	start = time.Now()
+	for _, group := range groupByMount(entries) {
+		// 显式指定的 ID 可能已有限额（重新配置的卷、多个目录共用），先整批读出供回滚恢复
+		var explicit []*provisionEntry
+		var ids []uint32
+		for _, e := range group {
+			if e.allocator == nil {
+				explicit = append(explicit, e)
+				ids = append(ids, e.result.ProjectID)
+			}
+		}
+		if len(ids) > 0 {
+			infos, errs, err := group[0].mount.backend.getQuotas(group[0].mount.handle, int(ProjQuota), ids)
+			for i, e := range explicit {
+				switch {
+				case err != nil:
+					e.result.Err = err
+				case errs[i] != nil:
+					e.result.Err = errs[i]
+				default:
+					e.prior = infos[i]
+					e.hadLimits = hasLimits(infos[i])
+				}
+			}
+			if group = pruneFailed(group); len(group) == 0 {
+				continue
+			}
+		}
+
+		limits := make([]QuotaLimit, len(group))
+		for i, e := range group {
+			limits[i] = QuotaLimit{
+				ID:             e.result.ProjectID,
+				Type:           ProjQuota,
+				BlockHardLimit: e.spec.BlockHardLimit,
+				BlockSoftLimit: e.spec.BlockSoftLimit,
+				InodeHardLimit: e.spec.InodeHardLimit,
+				InodeSoftLimit: e.spec.InodeSoftLimit,
+			}
+		}
+		errs, err := group[0].mount.backend.setQuotas(group[0].mount.handle, limits)
+		for i, e := range group {
+			switch {
+			case err != nil:
+				e.result.Err = err
+			case errs[i] != nil:
+				e.result.Err = errs[i]
+			default:
+				e.limited = true
+			}
+		}
+	}
+	timings.Limits = time.Since(start)
+
+	if opts.Verify {
+		start = time.Now()
+		for _, group := range groupByMount(entries) {
+			ids := make([]uint32, len(group))
+			for i, e := range group {
+				ids[i] = e.result.ProjectID
+			}
+			infos, errs, err := group[0].mount.backend.getQuotas(group[0].mount.handle, int(ProjQuota), ids)
+			for i, e := range group {
+				switch {
+				case err != nil:
+					e.result.Err = err
+				case errs[i] != nil:
+					e.result.Err = errs[i]
+				case infos[i].BlockHardLimit != e.spec.BlockHardLimit || infos[i].BlockSoftLimit != e.spec.BlockSoftLimit ||
+					infos[i].InodeHardLimit != e.spec.InodeHardLimit || infos[i].InodeSoftLimit != e.spec.InodeSoftLimit:
+					e.result.Err = fmt.Errorf("项目 %d 读回的限额与设置不一致", e.result.ProjectID)
+				}
+			}
+		}
+		timings.Verify = time.Since(start)
+	}
+
+	start = time.Now()
+	// 同一批里其他目录成功用上的 ID，回滚时不能动它的限额
+	type mountID struct {
+		mount *mountHandle
+		id    uint32
+	}
+	kept := make(map[mountID]bool)
+	for _, e := range entries {
+		if e.result.Err == nil {
+			kept[mountID{e.mount, e.result.ProjectID}] = true
+		}
+	}
+	failed := 0
+	var done []*provisionEntry
+	var changes []projectChange
+	for _, e := range entries {
+		if e.result.Err != nil {
+			failed++
+			if kept[mountID{e.mount, e.result.ProjectID}] {
+				e.limited = false
+			}
+			e.rollback()
+		} else {
+			done = append(done, e)
+			changes = append(changes, projectChange{path: e.spec.Path, fresh: e.result.Created})
+		}
+	}
+	timings.Rollback = time.Since(start)
+
+	// 整批更新一次索引；目录已配置好，只是索引没跟上的不回滚
+	for i, err := range noteProjectIDs(changes) {
+		if err != nil {
+			done[i].result.Err = err
+			failed++
+		}
+	}
+
+	if failed > 0 {
+		return results, timings, fmt.Errorf("%d/%d 个目录配置失败", failed, len(specs))
+	}
+	return results, timings, nil
+}
+
+// groupByMount 把仍然成功的条目按挂载点分组，每组一次批量调用
+func groupByMount(entries []*provisionEntry) [][]*provisionEntry {
+	index := make(map[*mountHandle]int)
+	var groups [][]*provisionEntry
+	for _, e := range entries {
+		if e.result.Err != nil {
+			continue
+		}
+		i, ok := index[e.mount]
+		if !ok {
+			i = len(groups)
+			index[e.mount] = i
+			groups = append(groups, nil)
+		}
+		groups[i] = append(groups[i], e)
+	}
+	return groups
+}
+
+func setProjectIDOn(fstype FileSystemType, path string, projectID int) error {
+	if fstype == FileSystemXFS {
+		return setProjectIDXFS(path, projectID)
+	}
+	return setProjectIDExt4(path, projectID)
+}
+
+// pruneFailed 去掉读取原有限额时失败的条目
+func pruneFailed(entries []*provisionEntry) []*provisionEntry {
+	kept := entries[:0:0]
+	for _, e := range entries {
+		if e.result.Err == nil {
+			kept = append(kept, e)
+		}
+	}
+	return kept
+}
+
+// rollback 按相反顺序撤销已经完成的步骤，尽力而为；撤销失败的原因附在 Err 后
+func (e *provisionEntry) rollback() {
+	var errs []error
+	if e.limited {
+		var err error
+		if e.allocator != nil || !e.hadLimits {
+			err = e.mount.backend.removeQuota(e.mount.handle, e.result.ProjectID, int(ProjQuota))
+		} else {
+			err = e.mount.backend.setQuota(e.mount.handle, e.result.ProjectID, int(ProjQuota),
+				e.prior.BlockHardLimit, e.prior.BlockSoftLimit, e.prior.InodeHardLimit, e.prior.InodeSoftLimit)
+		}
+		if err != nil {
+			errs = append(errs, err)
+		}
+	}
+	if e.result.Created {
+		if err := os.Remove(e.spec.Path); err != nil && !errors.Is(err, syscall.ENOENT) {
+			errs = append(errs, err)
+		}
+	} else if e.tagged {
+		if err := setProjectAttr(e.spec.Path, e.oldProjID, e.oldInherit); err != nil {
+			errs = append(errs, err)
+		}
+	}
+	if e.allocator != nil {
+		if err := e.allocator.Release(e.result.ProjectID); err != nil {
+			errs = append(errs, err)
+		}
+	}
+	if len(errs) > 0 {
+		e.result.Err = fmt.Errorf("%w（回滚未完成: %v）", e.result.Err, errors.Join(errs...))
+	}
+}
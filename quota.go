@@ -2,12 +2,11 @@ package quota
 
 import (
 	"fmt"
-	"os/exec"
-	"strings"
 	"syscall"
 )
 
-type QuotaType int
+// QuotaType 为 32 位，对应 QuotaRecord.qtype
+type QuotaType int32
 
 const (
 	UserQuota  QuotaType = 0
@@ -22,6 +21,8 @@ const (
 	FileSystemEXT4 FileSystemType = "ext4"
 )
 
+// QuotaInfo 与 C 端 QuotaRecord 逐字节对应（64 字节），C 可以直接写入 []QuotaInfo。
+// 块限额与用量的单位统一为 1 KiB。
 type QuotaInfo struct {
 	ID             uint32
 	Type           QuotaType
@@ -31,8 +32,18 @@ type QuotaInfo struct {
 	InodeHardLimit uint64
 	InodeSoftLimit uint64
 	CurrentInodes  uint64
-	BlockTime      uint64
-	InodeTime      uint64
+	BlockTime      uint32
+	InodeTime      uint32
+}
+
+// QuotaLimit 是 SetQuotas 的一条输入，与 C 端 QuotaLimit 逐字节对应；块限额单位为 1 KiB
+type QuotaLimit struct {
+	ID             uint32
+	Type           QuotaType
+	BlockHardLimit uint64
+	BlockSoftLimit uint64
+	InodeHardLimit uint64
+	InodeSoftLimit uint64
 }
 
 type QuotaError struct {
@@ -46,8 +57,11 @@ func (e *QuotaError) Error() string {
 
 type QuotaManager interface {
 	SetQuota(path string, id uint32, qtype QuotaType, bhard, bsoft, ihard, isoft uint64) error
+	SetQuotas(path string, limits []QuotaLimit) ([]error, error)
 	GetQuota(path string, id uint32, qtype QuotaType) (*QuotaInfo, error)
+	GetQuotas(path string, qtype QuotaType, ids []uint32) ([]QuotaInfo, []error, error)
 	ListQuotas(path string, qtype QuotaType, maxID uint32) ([]QuotaInfo, error)
+	IterateQuotas(path string, qtype QuotaType, token uint64, batchSize int) (QuotaIterator, error)
 	RemoveQuota(path string, id uint32, qtype QuotaType) error
 	TestQuota(path string, id uint32, qtype QuotaType) error
 }
@@ -70,69 +84,92 @@ func DetectFileSystem(path string) (FileSystemType, error) {
 	}
 }
 
+// DetectFileSystemByCommand 保留旧接口，现在与 DetectFileSystem 相同，不再启动 df 进程。
+//
+// Deprecated: 使用 DetectFileSystem。
 func DetectFileSystemByCommand(path string) (FileSystemType, error) {
-	cmd := exec.Command("df", "-T", path)
-	output, err := cmd.Output()
-	if err != nil {
-		return "", err
-	}
+	return DetectFileSystem(path)
+}
 
-	lines := strings.Split(string(output), "\n")
-	if len(lines) < 2 {
-		return "", fmt.Errorf("invalid df output")
-	}
+// 以下包级函数经挂载点注册表直接调用对应后端：命中时只有一次 stat，
+// 不再每次 statfs、新建管理器和打开句柄。
 
-	fields := strings.Fields(lines[1])
-	if len(fields) < 2 {
-		return "", fmt.Errorf("invalid df output format")
+func SetQuota(path string, id uint32, qtype QuotaType, bhard, bsoft, ihard, isoft uint64) error {
+	m, err := acquireBackend(path)
+	if err != nil {
+		return err
 	}
+	defer m.release()
+	return m.backend.setQuota(m.handle, id, int(qtype), bhard, bsoft, ihard, isoft)
+}
 
-	fstype := strings.ToLower(fields[1])
-	if strings.Contains(fstype, "xfs") {
-		return FileSystemXFS, nil
-	} else if strings.Contains(fstype, "ext4") {
-		return FileSystemEXT4, nil
+// SetQuotas 只解析一次设备就应用全部 limits，返回与 limits 一一对应的错误（成功为 nil）；
+// 第二个返回值表示整批无法执行，例如路径不在支持的文件系统上。
+func SetQuotas(path string, limits []QuotaLimit) ([]error, error) {
+	m, err := acquireBackend(path)
+	if err != nil {
+		return nil, err
 	}
+	defer m.release()
+	return m.backend.setQuotas(m.handle, limits)
+}
 
-	return "", fmt.Errorf("unsupported filesystem: %s", fstype)
+func GetQuota(path string, id uint32, qtype QuotaType) (*QuotaInfo, error) {
+	m, err := acquireBackend(path)
+	if err != nil {
+		return nil, err
+	}
+	defer m.release()
+	return m.backend.getQuota(m.handle, id, int(qtype))
 }
 
-func SetQuota(path string, id uint32, qtype QuotaType, bhard, bsoft, ihard, isoft uint64) error {
-	mgr, err := NewQuotaManager(path)
+// GetQuotas 一次查询一组 ID，结果与错误都按 ids 的顺序返回；
+// 没有配额记录的 ID 得到 ID/Type 之外全为零的记录。
+func GetQuotas(path string, qtype QuotaType, ids []uint32) ([]QuotaInfo, []error, error) {
+	m, err := acquireBackend(path)
 	if err != nil {
-		return err
+		return nil, nil, err
 	}
-	return mgr.SetQuota(path, id, qtype, bhard, bsoft, ihard, isoft)
+	defer m.release()
+	return m.backend.getQuotas(m.handle, int(qtype), ids)
 }
 
-func GetQuota(path string, id uint32, qtype QuotaType) (*QuotaInfo, error) {
-	mgr, err := NewQuotaManager(path)
+func ListQuotas(path string, qtype QuotaType, maxID uint32) ([]QuotaInfo, error) {
+	m, err := acquireBackend(path)
 	if err != nil {
 		return nil, err
 	}
-	return mgr.GetQuota(path, id, qtype)
+	defer m.release()
+	return m.backend.list(m, path, int(qtype), maxID)
 }
 
-func ListQuotas(path string, qtype QuotaType, maxID uint32) ([]QuotaInfo, error) {
-	mgr, err := NewQuotaManager(path)
+func IterateQuotas(path string, qtype QuotaType, token uint64, batchSize int) (QuotaIterator, error) {
+	m, err := acquireBackend(path)
+	if err != nil {
+		return nil, err
+	}
+	it, err := m.backend.iterate(m.handle, int(qtype), token, batchSize, m.release)
 	if err != nil {
+		m.release()
 		return nil, err
 	}
-	return mgr.ListQuotas(path, qtype, maxID)
+	return it, nil
 }
 
 func RemoveQuota(path string, id uint32, qtype QuotaType) error {
-	mgr, err := NewQuotaManager(path)
+	m, err := acquireBackend(path)
 	if err != nil {
 		return err
 	}
-	return mgr.RemoveQuota(path, id, qtype)
+	defer m.release()
+	return m.backend.removeQuota(m.handle, id, int(qtype))
 }
 
 func TestQuota(path string, id uint32, qtype QuotaType) error {
-	mgr, err := NewQuotaManager(path)
+	m, err := acquireBackend(path)
 	if err != nil {
 		return err
 	}
-	return mgr.TestQuota(path, id, qtype)
+	defer m.release()
+	return m.backend.testQuota(m.handle, id, int(qtype))
 }
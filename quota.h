@@ -1,51 +1,9 @@
 #ifndef QUOTA_H
 #define QUOTA_H
 
-#include <stdint.h>
-
-#ifdef __cplusplus
-extern "C" {
-#endif
-
-typedef struct {
-    uint32_t id;
-    int qtype;
-    uint64_t bhardlimit;
-    uint64_t bsoftlimit;
-    uint64_t curblocks;
-    uint64_t ihardlimit;
-    uint64_t isoftlimit;
-    uint64_t curinodes;
-    uint64_t btime;
-    uint64_t itime;
-} XFSQuotaInfo;
-
-typedef struct {
-    XFSQuotaInfo *items;
-    int count;
-    int capacity;
-} XFSQuotaList;
-
-int xfs_set_quota(const char *path, uint32_t id, int type, 
-                  uint64_t bhard, uint64_t bsoft, 
-                  uint64_t ihard, uint64_t isoft);
-
-int xfs_get_quota(const char *path, uint32_t id, int type, XFSQuotaInfo *info);
-
-int xfs_list_quotas(const char *path, int type, XFSQuotaList *list, int max_id);
-
-int xfs_list_quotas_simple(const char *path, int type, XFSQuotaList *list, int max_id);
-
-void xfs_free_quota_list(XFSQuotaList *list);
-
-int xfs_test_quota(const char *path, uint32_t id, int type);
-
-int xfs_remove_quota(const char *path, uint32_t id, int type);
-
-const char* xfs_error_string(int err);
-
-#ifdef __cplusplus
-}
-#endif
+// 汇总头文件：配额记录类型 QuotaRecord 定义在 pkg/common/quota_common.h，
+// 两个后端的接口分别见 pkg/xfs/quota_xfs.h 与 pkg/ext4/quota_ext4.h
+#include "pkg/xfs/quota_xfs.h"
+#include "pkg/ext4/quota_ext4.h"
 
 #endif
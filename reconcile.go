@@ -0,0 +1,202 @@
+package quota
+
+import (
+	"fmt"
+	"sort"
+	"sync"
+	"time"
+)
+
+// ReconcileOptions 控制 ReconcileWithOptions
+type ReconcileOptions struct {
+	DryRun bool // 只计算差异，不写入
+	// KeepUnlisted 为 true 时不移除期望状态里没有的配额；
+	// 默认移除，但只针对 desired 中出现过的配额类型，且从不移除 ID 0（XFS 上它保存默认限额）
+	KeepUnlisted bool
+	Workers      int // 并行写入的线程数，<= 0 时为 DefaultReconcileWorkers
+}
+
+// DefaultReconcileWorkers 是 ReconcileOptions.Workers <= 0 时的写入并发数
+const DefaultReconcileWorkers = 8
+
+// ReconcileFailure 是一条写入失败的差异
+type ReconcileFailure struct {
+	ID   uint32
+	Type QuotaType
+	Err  error
+}
+
+// ReconcileReport 是一次对账的差异报告
+type ReconcileReport struct {
+	Listed    int          // 枚举到的配额记录数
+	Unchanged int          // 期望状态中已经满足的条目数
+	Set       []QuotaLimit // 新建或修改的限额
+	Removed   []QuotaInfo  // 移除的配额（移除前的记录）
+	Failed    []ReconcileFailure
+	Elapsed   time.Duration
+}
+
+// Reconcile 把 path 所在文件系统的配额限额调整到 desired，见 ReconcileWithOptions
+func Reconcile(path string, desired []QuotaLimit) (*ReconcileReport, error) {
+	return ReconcileWithOptions(path, desired, ReconcileOptions{})
+}
+
+// ReconcileWithOptions 对 desired 中出现的每种配额类型做一次流式枚举，与按 ID 排序的期望状态归并，
+// 只对限额不同、缺失或多余的 ID 发出写入，写入按线程数分片并行。
+// 限额全为 0 的期望条目与没有记录等价。报告中的 Set、Removed 在 DryRun 时表示将要做的改动。
+func ReconcileWithOptions(path string, desired []QuotaLimit, opts ReconcileOptions) (*ReconcileReport, error) {
+	if opts.Workers <= 0 {
+		opts.Workers = DefaultReconcileWorkers
+	}
+
+	start := time.Now()
+	m, err := acquireBackend(path)
+	if err != nil {
+		return nil, err
+	}
+	defer m.release()
+
+	byType := make(map[QuotaType][]QuotaLimit)
+	for _, l := range desired {
+		byType[l.Type] = append(byType[l.Type], l)
+	}
+	types := make([]QuotaType, 0, len(byType))
+	for qtype, limits := range byType {
+		sort.Slice(limits, func(i, j int) bool { return limits[i].ID < limits[j].ID })
+		for i := 1; i < len(limits); i++ {
+			if limits[i].ID == limits[i-1].ID {
+				return nil, fmt.Errorf("期望状态中类型 %d 的配额 ID %d 重复", qtype, limits[i].ID)
+			}
+		}
+		types = append(types, qtype)
+	}
+	sort.Slice(types, func(i, j int) bool { return types[i] < types[j] })
+
+	report := &ReconcileReport{}
+	for _, qtype := range types {
+		if err := reconcileDiff(m, qtype, byType[qtype], opts, report); err != nil {
+			return nil, err
+		}
+	}
+
+	if !opts.DryRun {
+		reconcileApply(m, report, opts.Workers)
+	}
+
+	report.Elapsed = time.Since(start)
+	if len(report.Failed) > 0 {
+		return report, fmt.Errorf("%d 条配额差异写入失败", len(report.Failed))
+	}
+	return report, nil
+}
+
+// reconcileDiff 枚举按 ID 升序返回，与排好序的 desired 一次归并，内存只随差异数增长
+func reconcileDiff(m *mountHandle, qtype QuotaType, desired []QuotaLimit, opts ReconcileOptions, report *ReconcileReport) error {
+	it, err := m.backend.iterate(m.handle, int(qtype), 0, 0, func() {})
+	if err != nil {
+		return err
+	}
+	defer it.Close()
+
+	j := 0
+	want := func(l QuotaLimit) {
+		if l.BlockHardLimit == 0 && l.BlockSoftLimit == 0 && l.InodeHardLimit == 0 && l.InodeSoftLimit == 0 {
+			report.Unchanged++
+		} else {
+			report.Set = append(report.Set, l)
+		}
+	}
+
+	next := uint64(0)
+	for it.Next() {
+		for _, info := range it.Batch() {
+			if uint64(info.ID) < next {
+				return fmt.Errorf("类型 %d 的配额枚举未按 ID 升序返回", qtype)
+			}
+			next = uint64(info.ID) + 1
+			report.Listed++
+
+			for j < len(desired) && desired[j].ID < info.ID {
+				want(desired[j])
+				j++
+			}
+			switch {
+			case j < len(desired) && desired[j].ID == info.ID:
+				if sameLimits(desired[j], info) {
+					report.Unchanged++
+				} else {
+					report.Set = append(report.Set, desired[j])
+				}
+				j++
+			case !opts.KeepUnlisted && info.ID != 0 && hasLimits(info):
+				info.Type = qtype
+				report.Removed = append(report.Removed, info)
+			}
+		}
+	}
+	if err := it.Err(); err != nil {
+		return err
+	}
+	for ; j < len(desired); j++ {
+		want(desired[j])
+	}
+	return nil
+}
+
+func sameLimits(l QuotaLimit, info QuotaInfo) bool {
+	return l.BlockHardLimit == info.BlockHardLimit && l.BlockSoftLimit == info.BlockSoftLimit &&
+		l.InodeHardLimit == info.InodeHardLimit && l.InodeSoftLimit == info.InodeSoftLimit
+}
+
+// reconcileApply 把差异切成 workers 片并行写入；句柄上的 quotactl 不带状态，可以共用
+func reconcileApply(m *mountHandle, report *ReconcileReport, workers int) {
+	var mu sync.Mutex
+	var wg sync.WaitGroup
+	fail := func(id uint32, qtype QuotaType, err error) {
+		mu.Lock()
+		report.Failed = append(report.Failed, ReconcileFailure{ID: id, Type: qtype, Err: err})
+		mu.Unlock()
+	}
+
+	sets := splitBounds(len(report.Set), workers)
+	removes := splitBounds(len(report.Removed), workers)
+	for w := 0; w < workers; w++ {
+		if sets[w] == sets[w+1] && removes[w] == removes[w+1] {
+			continue
+		}
+		wg.Add(1)
+		go func(set []QuotaLimit, removed []QuotaInfo) {
+			defer wg.Done()
+			if len(set) > 0 {
+				errs, err := m.backend.setQuotas(m.handle, set)
+				for i, l := range set {
+					if err != nil {
+						fail(l.ID, l.Type, err)
+					} else if errs[i] != nil {
+						fail(l.ID, l.Type, errs[i])
+					}
+				}
+			}
+			for _, info := range removed {
+				if err := m.backend.removeQuota(m.handle, info.ID, int(info.Type)); err != nil {
+					fail(info.ID, info.Type, err)
+				}
+			}
+		}(report.Set[sets[w]:sets[w+1]], report.Removed[removes[w]:removes[w+1]])
+	}
+	wg.Wait()
+
+	sort.Slice(report.Failed, func(i, j int) bool {
+		a, b := report.Failed[i], report.Failed[j]
+		return a.Type < b.Type || (a.Type == b.Type && a.ID < b.ID)
+	})
+}
+
+// splitBounds 返回把 n 个元素均分成 parts 片的 parts+1 个边界
+func splitBounds(n, parts int) []int {
+	bounds := make([]int, parts+1)
+	for i := range bounds {
+		bounds[i] = n * i / parts
+	}
+	return bounds
+}
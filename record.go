@@ -0,0 +1,27 @@
+package quota
+
+/*
+#include "pkg/common/quota_common.h"
+*/
+import "C"
+
+import (
+	"unsafe"
+)
+
+// QuotaInfo 的内存布局必须与 C 端 QuotaRecord 完全一致
+var _ [unsafe.Sizeof(QuotaInfo{}) - C.sizeof_QuotaRecord]struct{}
+var _ [C.sizeof_QuotaRecord - unsafe.Sizeof(QuotaInfo{})]struct{}
+
+// QuotaLimit 的内存布局必须与 C 端 QuotaLimit 完全一致
+var _ [unsafe.Sizeof(QuotaLimit{}) - C.sizeof_QuotaLimit]struct{}
+var _ [C.sizeof_QuotaLimit - unsafe.Sizeof(QuotaLimit{})]struct{}
+
+// recordPtr 返回 buf 的首地址；QuotaInfo 不含 Go 指针，可以在 cgo 调用期间直接交给 C 写入
+func recordPtr(buf []QuotaInfo) *C.QuotaRecord {
+	return (*C.QuotaRecord)(unsafe.Pointer(unsafe.SliceData(buf)))
+}
+
+func limitPtr(limits []QuotaLimit) *C.QuotaLimit {
+	return (*C.QuotaLimit)(unsafe.Pointer(unsafe.SliceData(limits)))
+}
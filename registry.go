@@ -0,0 +1,224 @@
+package quota
+
+/*
+#include <stdlib.h>
+#include "pkg/common/quota_common.h"
+*/
+import "C"
+
+import (
+	"sync"
+	"sync/atomic"
+	"syscall"
+	"unsafe"
+)
+
+// quotaBackend 是某种文件系统基于已打开句柄的实现，注册表命中后直接调用，不再解析路径
+type quotaBackend struct {
+	setQuota  func(h *C.quota_handle_t, id uint32, qtype int, bhard, bsoft, ihard, isoft uint64) error
+	setQuotas func(h *C.quota_handle_t, limits []QuotaLimit) ([]error, error)
+	getQuota  func(h *C.quota_handle_t, id uint32, qtype int) (*QuotaInfo, error)
+	getQuotas func(h *C.quota_handle_t, qtype int, ids []uint32) ([]QuotaInfo, []error, error)
+	list      func(m *mountHandle, path string, qtype int, maxID uint32) ([]QuotaInfo, error)
+	// iterate 成功时迭代器借用句柄，Close 时调用 done 归还
+	iterate     func(h *C.quota_handle_t, qtype int, token uint64, batchSize int, done func()) (QuotaIterator, error)
+	removeQuota func(h *C.quota_handle_t, id uint32, qtype int) error
+	testQuota   func(h *C.quota_handle_t, id uint32, qtype int) error
+}
+
+// mountHandle 是注册表中一个挂载点（按 st_dev）的常驻记录：
+// 探测出的文件系统类型、打开的 quota 句柄以及各配额类型的能力记录
+type mountHandle struct {
+	dev        uint64
+	generation uint64
+	fstype     FileSystemType
+	fsErr      error // 文件系统不受支持时的原因，此时 backend 为 nil
+	backend    *quotaBackend
+	handle     *C.quota_handle_t
+
+	// 注册表本身持有一个引用；最后一个引用释放时关闭句柄
+	refs atomic.Int64
+
+	capsMu sync.Mutex
+	caps   [3]*QuotaCapabilities
+}
+
+func (m *mountHandle) release() {
+	if m.refs.Add(-1) == 0 {
+		C.quota_handle_close(m.handle)
+	}
+}
+
+// capabilities 返回 qtype 的能力记录；配额未开启时不缓存，下次重新探测
+func (m *mountHandle) capabilities(qtype QuotaType) (*QuotaCapabilities, error) {
+	if qtype < UserQuota || qtype > ProjQuota {
+		return nil, &QuotaError{Code: int(syscall.EINVAL), Message: syscall.EINVAL.Error()}
+	}
+
+	m.capsMu.Lock()
+	defer m.capsMu.Unlock()
+	if caps := m.caps[qtype]; caps != nil {
+		return caps, nil
+	}
+
+	var caps C.QuotaCaps
+	if ret := C.quota_handle_caps(m.handle, C.int(qtype), &caps); ret != 0 {
+		return nil, &QuotaError{Code: int(ret), Message: syscall.Errno(ret).Error()}
+	}
+
+	m.caps[qtype] = &QuotaCapabilities{
+		GetNextQuota:  caps.getnextquota != 0,
+		XGetNextQuota: caps.xgetnextquota != 0,
+		QuotactlFd:    caps.quotactl_fd != 0,
+		Accounting:    caps.accounting != 0,
+		Enforcement:   caps.enforcement != 0,
+		Format:        uint32(caps.format),
+		BlockGrace:    uint32(caps.block_grace),
+		InodeGrace:    uint32(caps.inode_grace),
+		IncoreDquots:  uint64(caps.incore_dquots),
+	}
+	return m.caps[qtype], nil
+}
+
+// mounts 是进程级的挂载点注册表；挂载表变化（代数改变）后整体作废
+var mounts = struct {
+	sync.RWMutex
+	generation uint64
+	entries    map[uint64]*mountHandle
+}{entries: make(map[uint64]*mountHandle)}
+
+// purgeMountsLocked 移出全部条目并归还注册表的引用，正在使用的句柄在用完后关闭
+func purgeMountsLocked() {
+	for dev, m := range mounts.entries {
+		delete(mounts.entries, dev)
+		m.release()
+	}
+}
+
+func purgeMounts() {
+	mounts.Lock()
+	purgeMountsLocked()
+	mounts.Unlock()
+}
+
+// acquireMount 返回 path 所在挂载点的记录并增加一个引用，调用方用完后必须 release。
+// 命中时只需一次 stat 和一次挂载表代数检查。
+func acquireMount(path string) (*mountHandle, error) {
+	dev, err := pathDev(path)
+	if err != nil {
+		return nil, err
+	}
+	generation := mountGeneration()
+
+	mounts.RLock()
+	if m, ok := mounts.entries[dev]; ok && mounts.generation == generation {
+		m.refs.Add(1)
+		mounts.RUnlock()
+		return m, nil
+	}
+	mounts.RUnlock()
+
+	m, err := openMount(path, dev, generation)
+	if err != nil {
+		return nil, err
+	}
+
+	mounts.Lock()
+	defer mounts.Unlock()
+	if generation < mounts.generation {
+		// 打开期间挂载表又变了：不入表，调用方持有唯一的引用
+		return m, nil
+	}
+	if generation > mounts.generation {
+		purgeMountsLocked()
+		mounts.generation = generation
+	}
+	if existing, ok := mounts.entries[dev]; ok {
+		// 并发填充时保留先到的记录
+		m.release()
+		m = existing
+	} else {
+		mounts.entries[dev] = m
+	}
+	m.refs.Add(1)
+	return m, nil
+}
+
+// openMount 在注册表之外打开句柄并探测文件系统类型；冷路径，每个挂载点每代只走一次
+func openMount(path string, dev, generation uint64) (*mountHandle, error) {
+	cPath := C.CString(path)
+	defer C.free(unsafe.Pointer(cPath))
+
+	m := &mountHandle{dev: dev, generation: generation}
+	m.fstype, m.fsErr = DetectFileSystem(path)
+	switch m.fstype {
+	case FileSystemXFS:
+		m.backend = &xfsBackend
+	case FileSystemEXT4:
+		m.backend = &ext4Backend
+	}
+
+	if ret := C.quota_handle_open(cPath, &m.handle); ret != 0 {
+		if m.fsErr != nil {
+			return nil, m.fsErr
+		}
+		return nil, &QuotaError{Code: int(syscall.ENODEV), Message: syscall.ENODEV.Error()}
+	}
+	m.refs.Store(1)
+	return m, nil
+}
+
+// withMount 在 path 所在挂载点的记录上执行 fn，期间持有引用
+func withMount[T any](path string, fn func(m *mountHandle) (T, error)) (T, error) {
+	m, err := acquireMount(path)
+	if err != nil {
+		var zero T
+		return zero, err
+	}
+	defer m.release()
+	return fn(m)
+}
+
+// acquireBackend 与 acquireMount 相同，但要求挂载点是受支持的文件系统
+func acquireBackend(path string) (*mountHandle, error) {
+	m, err := acquireMount(path)
+	if err != nil {
+		return nil, err
+	}
+	if m.backend == nil {
+		m.release()
+		return nil, m.fsErr
+	}
+	return m, nil
+}
+
+// lookupFileSystem 返回注册表中记录的文件系统类型，命中时不再 statfs
+func lookupFileSystem(path string) (FileSystemType, error) {
+	return withMount(path, func(m *mountHandle) (FileSystemType, error) {
+		return m.fstype, m.fsErr
+	})
+}
+
+// doMount 是只返回 error 的 withMount
+func doMount(path string, fn func(m *mountHandle) error) error {
+	m, err := acquireMount(path)
+	if err != nil {
+		return err
+	}
+	defer m.release()
+	return fn(m)
+}
+
+// iterateWith 为迭代器获取引用：成功时由迭代器 Close 归还，失败时立即归还
+func iterateWith(path string, fn func(m *mountHandle) (QuotaIterator, error)) (QuotaIterator, error) {
+	m, err := acquireMount(path)
+	if err != nil {
+		return nil, err
+	}
+	it, err := fn(m)
+	if err != nil {
+		m.release()
+		return nil, err
+	}
+	return it, nil
+}
@@ -0,0 +1,140 @@
+package quota
+
+// #include "pkg/common/quota_common.h"
+import "C"
+
+import (
+	"sync"
+	"syscall"
+	"time"
+)
+
+// EXT4ListStrategy 是 EXT4Manager.ListQuotas 实际采用的枚举方式
+type EXT4ListStrategy string
+
+const (
+	EXT4ListDirect   EXT4ListStrategy = "direct"   // 解析挂载点下的 aquota.* 文件
+	EXT4ListFast     EXT4ListStrategy = "fast"     // 从块设备读取隐藏配额 inode
+	EXT4ListQuotactl EXT4ListStrategy = "quotactl" // Q_GETNEXTQUOTA 或逐个探测
+)
+
+// EXT4StrategyInfo 记录某个挂载点上探测出的枚举方式及其耗时
+type EXT4StrategyInfo struct {
+	Strategy EXT4ListStrategy
+	Duration time.Duration
+	ProbedAt time.Time
+}
+
+type ext4StrategyEntry struct {
+	info       EXT4StrategyInfo
+	generation uint64
+}
+
+// aquota.* 文件与隐藏 inode 按配额类型各自存在，所以选择结果按 (st_dev, 类型) 区分
+type ext4StrategyKey struct {
+	dev   uint64
+	qtype int
+}
+
+// ext4Strategies 缓存每个挂载点选中的枚举方式；挂载表变化（代数改变）后重新探测
+var ext4Strategies = struct {
+	sync.Mutex
+	entries map[ext4StrategyKey]ext4StrategyEntry
+}{entries: make(map[ext4StrategyKey]ext4StrategyEntry)}
+
+// ext4ListFunc 直接在注册表的句柄上枚举，不再按路径查挂载点、打开句柄
+type ext4ListFunc func(h *C.quota_handle_t, qtype int, maxID uint32) ([]QuotaInfo, error)
+
+var ext4ListOrder = []struct {
+	strategy EXT4ListStrategy
+	list     ext4ListFunc
+}{
+	{EXT4ListDirect, ext4ListQuotasDirect},
+	{EXT4ListFast, ext4ListQuotasFast},
+	{EXT4ListQuotactl, ext4ListQuotas},
+}
+
+func ext4ListFor(strategy EXT4ListStrategy) ext4ListFunc {
+	for _, s := range ext4ListOrder {
+		if s.strategy == strategy {
+			return s.list
+		}
+	}
+	return ext4ListQuotas
+}
+
+func pathDev(path string) (uint64, error) {
+	var st syscall.Stat_t
+	if err := syscall.Stat(path, &st); err != nil {
+		return 0, err
+	}
+	return uint64(st.Dev), nil
+}
+
+func cachedEXT4Strategy(key ext4StrategyKey, generation uint64) (EXT4StrategyInfo, bool) {
+	ext4Strategies.Lock()
+	defer ext4Strategies.Unlock()
+	entry, ok := ext4Strategies.entries[key]
+	if !ok || entry.generation != generation {
+		return EXT4StrategyInfo{}, false
+	}
+	return entry.info, true
+}
+
+func storeEXT4Strategy(key ext4StrategyKey, generation uint64, info EXT4StrategyInfo) {
+	ext4Strategies.Lock()
+	ext4Strategies.entries[key] = ext4StrategyEntry{info: info, generation: generation}
+	ext4Strategies.Unlock()
+}
+
+func forgetEXT4Strategy(key ext4StrategyKey) {
+	ext4Strategies.Lock()
+	delete(ext4Strategies.entries, key)
+	ext4Strategies.Unlock()
+}
+
+// probeEXT4List 按优先级依次尝试各枚举方式，记住第一个成功的方式及其耗时
+func probeEXT4List(h *C.quota_handle_t, qtype int, maxID uint32, key ext4StrategyKey, generation uint64) ([]QuotaInfo, error) {
+	var lastErr error
+	for _, s := range ext4ListOrder {
+		start := time.Now()
+		infos, err := s.list(h, qtype, maxID)
+		if err != nil {
+			lastErr = err
+			continue
+		}
+		storeEXT4Strategy(key, generation, EXT4StrategyInfo{
+			Strategy: s.strategy,
+			Duration: time.Since(start),
+			ProbedAt: start,
+		})
+		return infos, nil
+	}
+	return nil, lastErr
+}
+
+// listEXT4Adaptive 直接使用该挂载点已选定的方式；选定的方式失败时清掉记录重新探测。
+// 挂载点的 st_dev 与句柄都由注册表提供。
+func listEXT4Adaptive(m *mountHandle, qtype int, maxID uint32) ([]QuotaInfo, error) {
+	key := ext4StrategyKey{dev: m.dev, qtype: qtype}
+	generation := mountGeneration()
+
+	if info, ok := cachedEXT4Strategy(key, generation); ok {
+		infos, err := ext4ListFor(info.Strategy)(m.handle, qtype, maxID)
+		if err == nil {
+			return infos, nil
+		}
+		forgetEXT4Strategy(key)
+	}
+
+	return probeEXT4List(m.handle, qtype, maxID, key, generation)
+}
+
+// EXT4Strategy 返回 path 所在挂载点上 qtype 类型的 ListQuotas 选定的枚举方式；尚未探测过时 ok 为 false
+func EXT4Strategy(path string, qtype QuotaType) (info EXT4StrategyInfo, ok bool) {
+	dev, err := pathDev(path)
+	if err != nil {
+		return EXT4StrategyInfo{}, false
+	}
+	return cachedEXT4Strategy(ext4StrategyKey{dev: dev, qtype: int(qtype)}, mountGeneration())
+}
@@ -2,7 +2,7 @@ package quota
 
 /*
 #cgo CFLAGS: -Wall -Wextra
-#cgo LDFLAGS: ${SRCDIR}/pkg/xfs/quota_xfs.o
+#cgo LDFLAGS: ${SRCDIR}/pkg/xfs/quota_xfs.o ${SRCDIR}/pkg/xfs/quota_xfs_census.o
 #define _GNU_SOURCE
 #include <stdio.h>
 #include <stdlib.h>
@@ -20,17 +20,13 @@ package quota
 #include <stdint.h>
 #include "pkg/xfs/quota_xfs.h"
 
-static char error_buffer[256];
+static __thread char error_buffer[256];
 
 const char* project_error_string(int error_code) {
     if (error_code == 0) {
         return "Success";
     }
-#pragma GCC diagnostic push
-#pragma GCC diagnostic ignored "-Wunused-result"
-    strerror_r(error_code, error_buffer, sizeof(error_buffer));
-#pragma GCC diagnostic pop
-    return error_buffer;
+    return strerror_r(error_code, error_buffer, sizeof(error_buffer));
 }
 
 int set_project_id_xfs(const char *path, uint32_t project_id) {
@@ -104,6 +100,58 @@ int get_project_id(const char *path, uint32_t *project_id) {
     return 0;
 }
 
+// get_project_attr 读取项目 ID 与 PROJINHERIT 标志
+int get_project_attr(const char *path, uint32_t *project_id, int *inherit) {
+    int fd = open(path, O_RDONLY);
+    if (fd < 0) {
+        return errno;
+    }
+
+    struct fsxattr attr;
+    memset(&attr, 0, sizeof(attr));
+
+    if (ioctl(fd, FS_IOC_FSGETXATTR, &attr) < 0) {
+        close(fd);
+        return errno;
+    }
+
+    *project_id = attr.fsx_projid;
+    *inherit = (attr.fsx_xflags & FS_XFLAG_PROJINHERIT) != 0;
+    close(fd);
+    return 0;
+}
+
+// set_project_attr 把项目 ID 与 PROJINHERIT 标志恢复成给定值，其他标志不动
+int set_project_attr(const char *path, uint32_t project_id, int inherit) {
+    int fd = open(path, O_RDONLY);
+    if (fd < 0) {
+        return errno;
+    }
+
+    struct fsxattr attr;
+    memset(&attr, 0, sizeof(attr));
+
+    if (ioctl(fd, FS_IOC_FSGETXATTR, &attr) < 0) {
+        close(fd);
+        return errno;
+    }
+
+    attr.fsx_projid = project_id;
+    if (inherit) {
+        attr.fsx_xflags |= FS_XFLAG_PROJINHERIT;
+    } else {
+        attr.fsx_xflags &= ~FS_XFLAG_PROJINHERIT;
+    }
+
+    if (ioctl(fd, FS_IOC_FSSETXATTR, &attr) < 0) {
+        close(fd);
+        return errno;
+    }
+
+    close(fd);
+    return 0;
+}
+
 int clear_project_id(const char *path) {
     int fd = open(path, O_RDONLY);
     if (fd < 0) {
@@ -133,83 +181,88 @@ import "C"
 
 import (
 	"fmt"
+	"runtime"
 	"unsafe"
 )
 
 type XFSManager struct{}
 
+var xfsBackend = quotaBackend{
+	setQuota:  xfsSetQuota,
+	setQuotas: xfsSetQuotas,
+	getQuota:  xfsGetQuota,
+	getQuotas: xfsGetQuotas,
+	list: func(m *mountHandle, path string, qtype int, maxID uint32) ([]QuotaInfo, error) {
+		return xfsListQuotas(m.handle, qtype, maxID)
+	},
+	iterate:     xfsIterateQuotas,
+	removeQuota: xfsRemoveQuota,
+	testQuota:   xfsTestQuota,
+}
+
 func (m *XFSManager) SetQuota(path string, id uint32, qtype QuotaType, bhard, bsoft, ihard, isoft uint64) error {
-	return xfsSetQuota(path, id, int(qtype), bhard, bsoft, ihard, isoft)
+	return doMount(path, func(mh *mountHandle) error {
+		return xfsSetQuota(mh.handle, id, int(qtype), bhard, bsoft, ihard, isoft)
+	})
+}
+
+func (m *XFSManager) SetQuotas(path string, limits []QuotaLimit) ([]error, error) {
+	return withMount(path, func(mh *mountHandle) ([]error, error) {
+		return xfsSetQuotas(mh.handle, limits)
+	})
 }
 
 func (m *XFSManager) GetQuota(path string, id uint32, qtype QuotaType) (*QuotaInfo, error) {
-	info, err := xfsGetQuota(path, id, int(qtype))
+	return withMount(path, func(mh *mountHandle) (*QuotaInfo, error) {
+		return xfsGetQuota(mh.handle, id, int(qtype))
+	})
+}
+
+func (m *XFSManager) GetQuotas(path string, qtype QuotaType, ids []uint32) ([]QuotaInfo, []error, error) {
+	mh, err := acquireMount(path)
 	if err != nil {
-		return nil, err
+		return nil, nil, err
 	}
-	return &QuotaInfo{
-		ID:             info.ID,
-		Type:           QuotaType(info.Type),
-		BlockHardLimit: info.BlockHardLimit,
-		BlockSoftLimit: info.BlockSoftLimit,
-		CurrentBlocks:  info.CurrentBlocks,
-		InodeHardLimit: info.InodeHardLimit,
-		InodeSoftLimit: info.InodeSoftLimit,
-		CurrentInodes:  info.CurrentInodes,
-		BlockTime:      info.BlockTime,
-		InodeTime:      info.InodeTime,
-	}, nil
+	defer mh.release()
+	return xfsGetQuotas(mh.handle, int(qtype), ids)
 }
 
 func (m *XFSManager) ListQuotas(path string, qtype QuotaType, maxID uint32) ([]QuotaInfo, error) {
-	infos, err := xfsListQuotas(path, int(qtype), maxID)
-	if err != nil {
-		return nil, err
-	}
-	result := make([]QuotaInfo, len(infos))
-	for i, info := range infos {
-		result[i] = QuotaInfo{
-			ID:             info.ID,
-			Type:           QuotaType(info.Type),
-			BlockHardLimit: info.BlockHardLimit,
-			BlockSoftLimit: info.BlockSoftLimit,
-			CurrentBlocks:  info.CurrentBlocks,
-			InodeHardLimit: info.InodeHardLimit,
-			InodeSoftLimit: info.InodeSoftLimit,
-			CurrentInodes:  info.CurrentInodes,
-			BlockTime:      info.BlockTime,
-			InodeTime:      info.InodeTime,
-		}
-	}
-	return result, nil
+	return withMount(path, func(mh *mountHandle) ([]QuotaInfo, error) {
+		return xfsListQuotas(mh.handle, int(qtype), maxID)
+	})
 }
 
-func (m *XFSManager) RemoveQuota(path string, id uint32, qtype QuotaType) error {
-	return xfsRemoveQuota(path, id, int(qtype))
+func (m *XFSManager) IterateQuotas(path string, qtype QuotaType, token uint64, batchSize int) (QuotaIterator, error) {
+	return iterateWith(path, func(mh *mountHandle) (QuotaIterator, error) {
+		return xfsIterateQuotas(mh.handle, int(qtype), token, batchSize, mh.release)
+	})
 }
 
-func (m *XFSManager) TestQuota(path string, id uint32, qtype QuotaType) error {
-	return xfsTestQuota(path, id, int(qtype))
+func (m *XFSManager) RemoveQuota(path string, id uint32, qtype QuotaType) error {
+	return doMount(path, func(mh *mountHandle) error {
+		return xfsRemoveQuota(mh.handle, id, int(qtype))
+	})
 }
 
-type xfsQuotaInfo struct {
-	ID             uint32
-	Type           int32
-	BlockHardLimit uint64
-	BlockSoftLimit uint64
-	CurrentBlocks  uint64
-	InodeHardLimit uint64
-	InodeSoftLimit uint64
-	CurrentInodes  uint64
-	BlockTime      uint64
-	InodeTime      uint64
+// Census 用 bulkstat 扫描 path 所在的整个文件系统，按 qtype 的属主汇总实际用量
+func (m *XFSManager) Census(path string, qtype QuotaType) ([]QuotaInfo, CensusStats, error) {
+	mh, err := acquireMount(path)
+	if err != nil {
+		return nil, CensusStats{}, err
+	}
+	defer mh.release()
+	return xfsCensus(mh.handle, int(qtype), runtime.NumCPU())
 }
 
-func xfsSetQuota(path string, id uint32, qtype int, bhard, bsoft, ihard, isoft uint64) error {
-	cPath := C.CString(path)
-	defer C.free(unsafe.Pointer(cPath))
+func (m *XFSManager) TestQuota(path string, id uint32, qtype QuotaType) error {
+	return doMount(path, func(mh *mountHandle) error {
+		return xfsTestQuota(mh.handle, id, int(qtype))
+	})
+}
 
-	ret := C.xfs_set_quota(cPath, C.uint32_t(id), C.int(qtype),
+func xfsSetQuota(h *C.quota_handle_t, id uint32, qtype int, bhard, bsoft, ihard, isoft uint64) error {
+	ret := C.xfs_handle_set_quota(h, C.uint32_t(id), C.int(qtype),
 		C.ulong(bhard), C.ulong(bsoft), C.ulong(ihard), C.ulong(isoft))
 
 	if ret != 0 {
@@ -220,71 +273,113 @@ func xfsSetQuota(path string, id uint32, qtype int, bhard, bsoft, ihard, isoft u
 	return nil
 }
 
-func xfsGetQuota(path string, id uint32, qtype int) (*xfsQuotaInfo, error) {
-	cPath := C.CString(path)
-	defer C.free(unsafe.Pointer(cPath))
+func xfsSetQuotas(h *C.quota_handle_t, limits []QuotaLimit) ([]error, error) {
+	if len(limits) == 0 {
+		return nil, nil
+	}
 
-	var info C.XFSQuotaInfo
-	ret := C.xfs_get_quota(cPath, C.uint32_t(id), C.int(qtype), &info)
+	codes := make([]int32, len(limits))
+	ret := C.xfs_handle_set_quotas(h, limitPtr(limits), C.size_t(len(limits)),
+		(*C.int)(unsafe.Pointer(&codes[0])), C.int(batchWorkers(len(limits))))
 
 	if ret != 0 {
 		errMsg := C.GoString(C.xfs_error_string(C.int(ret)))
 		return nil, &QuotaError{Code: int(ret), Message: errMsg}
 	}
 
-	return &xfsQuotaInfo{
-		ID:             uint32(info.id),
-		Type:           int32(info.qtype),
-		BlockHardLimit: uint64(info.bhardlimit),
-		BlockSoftLimit: uint64(info.bsoftlimit),
-		CurrentBlocks:  uint64(info.curblocks),
-		InodeHardLimit: uint64(info.ihardlimit),
-		InodeSoftLimit: uint64(info.isoftlimit),
-		CurrentInodes:  uint64(info.curinodes),
-		BlockTime:      uint64(info.btime),
-		InodeTime:      uint64(info.itime),
-	}, nil
+	return batchErrors(codes, func(code int32) string {
+		return C.GoString(C.xfs_error_string(C.int(code)))
+	}), nil
 }
 
-func xfsListQuotas(path string, qtype int, maxID uint32) ([]xfsQuotaInfo, error) {
-	cPath := C.CString(path)
-	defer C.free(unsafe.Pointer(cPath))
+func xfsGetQuota(h *C.quota_handle_t, id uint32, qtype int) (*QuotaInfo, error) {
+	var info QuotaInfo
+	ret := C.xfs_handle_get_quota(h, C.uint32_t(id), C.int(qtype), (*C.QuotaRecord)(unsafe.Pointer(&info)))
 
-	var list C.XFSQuotaList
-	ret := C.xfs_list_quotas(cPath, C.int(qtype), &list, C.int(maxID))
+	if ret != 0 {
+		errMsg := C.GoString(C.xfs_error_string(C.int(ret)))
+		return nil, &QuotaError{Code: int(ret), Message: errMsg}
+	}
+
+	return &info, nil
+}
+
+func xfsGetQuotas(h *C.quota_handle_t, qtype int, ids []uint32) ([]QuotaInfo, []error, error) {
+	if len(ids) == 0 {
+		return nil, nil, nil
+	}
+
+	infos := make([]QuotaInfo, len(ids))
+	codes := make([]int32, len(ids))
+	ret := C.xfs_handle_get_quotas(h, C.int(qtype), (*C.uint32_t)(unsafe.Pointer(&ids[0])), C.size_t(len(ids)),
+		recordPtr(infos), (*C.int)(unsafe.Pointer(&codes[0])))
 
+	if ret != 0 {
+		errMsg := C.GoString(C.xfs_error_string(C.int(ret)))
+		return nil, nil, &QuotaError{Code: int(ret), Message: errMsg}
+	}
+
+	return infos, batchErrors(codes, func(code int32) string {
+		return C.GoString(C.xfs_error_string(C.int(code)))
+	}), nil
+}
+
+func xfsListQuotas(h *C.quota_handle_t, qtype int, maxID uint32) ([]QuotaInfo, error) {
+	_ = maxID
+
+	var cursor *C.XFSQuotaCursor
+	ret := C.xfs_handle_list_begin(h, C.int(qtype), 0, &cursor)
 	if ret != 0 {
 		errMsg := C.GoString(C.xfs_error_string(C.int(ret)))
 		return nil, &QuotaError{Code: int(ret), Message: errMsg}
 	}
+	defer C.xfs_list_end(cursor)
+
+	return drainQuotas(func(buf []QuotaInfo) (int, bool, error) {
+		var count, more C.int
+		ret := C.xfs_list_next(cursor, recordPtr(buf), C.int(len(buf)), &count, &more)
+		if ret != 0 {
+			errMsg := C.GoString(C.xfs_error_string(C.int(ret)))
+			return int(count), false, &QuotaError{Code: int(ret), Message: errMsg}
+		}
+		return int(count), more != 0, nil
+	})
+}
+
+func xfsIterateQuotas(h *C.quota_handle_t, qtype int, token uint64, batchSize int, done func()) (QuotaIterator, error) {
+	if batchSize <= 0 {
+		batchSize = DefaultIteratorBatchSize
+	}
 
-	defer C.xfs_free_quota_list(&list)
+	var cursor *C.XFSQuotaCursor
+	ret := C.xfs_handle_list_begin(h, C.int(qtype), C.uint64_t(token), &cursor)
+	if ret != 0 {
+		errMsg := C.GoString(C.xfs_error_string(C.int(ret)))
+		return nil, &QuotaError{Code: int(ret), Message: errMsg}
+	}
 
-	infos := make([]xfsQuotaInfo, int(list.count))
-	for i := 0; i < int(list.count); i++ {
-		item := (*[1 << 28]C.XFSQuotaInfo)(unsafe.Pointer(list.items))[i]
-		infos[i] = xfsQuotaInfo{
-			ID:             uint32(item.id),
-			Type:           int32(item.qtype),
-			BlockHardLimit: uint64(item.bhardlimit),
-			BlockSoftLimit: uint64(item.bsoftlimit),
-			CurrentBlocks:  uint64(item.curblocks),
-			InodeHardLimit: uint64(item.ihardlimit),
-			InodeSoftLimit: uint64(item.isoftlimit),
-			CurrentInodes:  uint64(item.curinodes),
-			BlockTime:      uint64(item.btime),
-			InodeTime:      uint64(item.itime),
+	fetch := func(buf []QuotaInfo) (int, error) {
+		var count, more C.int
+		ret := C.xfs_list_next(cursor, recordPtr(buf), C.int(len(buf)), &count, &more)
+		if ret != 0 {
+			errMsg := C.GoString(C.xfs_error_string(C.int(ret)))
+			return int(count), &QuotaError{Code: int(ret), Message: errMsg}
 		}
+		return int(count), nil
+	}
+	tokenFn := func() uint64 {
+		return uint64(C.xfs_list_token(cursor))
+	}
+	end := func() {
+		C.xfs_list_end(cursor)
+		done()
 	}
 
-	return infos, nil
+	return newBatchIterator(batchSize, fetch, tokenFn, end), nil
 }
 
-func xfsRemoveQuota(path string, id uint32, qtype int) error {
-	cPath := C.CString(path)
-	defer C.free(unsafe.Pointer(cPath))
-
-	ret := C.xfs_remove_quota(cPath, C.uint32_t(id), C.int(qtype))
+func xfsRemoveQuota(h *C.quota_handle_t, id uint32, qtype int) error {
+	ret := C.xfs_handle_remove_quota(h, C.uint32_t(id), C.int(qtype))
 
 	if ret != 0 {
 		errMsg := C.GoString(C.xfs_error_string(C.int(ret)))
@@ -294,11 +389,8 @@ func xfsRemoveQuota(path string, id uint32, qtype int) error {
 	return nil
 }
 
-func xfsTestQuota(path string, id uint32, qtype int) error {
-	cPath := C.CString(path)
-	defer C.free(unsafe.Pointer(cPath))
-
-	ret := C.xfs_test_quota(cPath, C.uint32_t(id), C.int(qtype))
+func xfsTestQuota(h *C.quota_handle_t, id uint32, qtype int) error {
+	ret := C.xfs_handle_test_quota(h, C.uint32_t(id), C.int(qtype))
 
 	if ret != 0 {
 		errMsg := C.GoString(C.xfs_error_string(C.int(ret)))
@@ -308,6 +400,25 @@ func xfsTestQuota(path string, id uint32, qtype int) error {
 	return nil
 }
 
+func xfsCensus(h *C.quota_handle_t, qtype int, workers int) ([]QuotaInfo, CensusStats, error) {
+	var list C.XFSQuotaList
+	var stats C.XFSCensusStats
+	ret := C.xfs_handle_census(h, C.int(qtype), C.int(workers), &list, &stats)
+	if ret != 0 {
+		errMsg := C.GoString(C.xfs_error_string(C.int(ret)))
+		return nil, CensusStats{}, &QuotaError{Code: int(ret), Message: errMsg}
+	}
+	defer C.xfs_free_quota_list(&list)
+
+	infos := make([]QuotaInfo, int(list.count))
+	copy(infos, unsafe.Slice((*QuotaInfo)(unsafe.Pointer(list.items)), int(list.count)))
+	return infos, CensusStats{
+		Inodes:      uint64(stats.inodes),
+		BulkVersion: int(stats.version),
+		AGs:         int(stats.ags),
+	}, nil
+}
+
 // setProjectIDXFS 在XFS文件系统上设置project ID（使用ioctl系统调用）
 func setProjectIDXFS(path string, projectID int) error {
 	cPath := C.CString(path)
@@ -348,6 +459,38 @@ func getProjectID(path string) (int, error) {
 	return int(projectID), nil
 }
 
+// getProjectAttr 获取project ID 以及是否带 PROJINHERIT
+func getProjectAttr(path string) (int, bool, error) {
+	cPath := C.CString(path)
+	defer C.free(unsafe.Pointer(cPath))
+
+	var projectID C.uint32_t
+	var inherit C.int
+	ret := C.get_project_attr(cPath, &projectID, &inherit)
+	if ret != 0 {
+		errMsg := C.GoString(C.project_error_string(C.int(ret)))
+		return 0, false, fmt.Errorf("获取project ID失败: %s", errMsg)
+	}
+	return int(projectID), inherit != 0, nil
+}
+
+// setProjectAttr 设置project ID，并按 inherit 设置或清除 PROJINHERIT
+func setProjectAttr(path string, projectID int, inherit bool) error {
+	cPath := C.CString(path)
+	defer C.free(unsafe.Pointer(cPath))
+
+	cInherit := C.int(0)
+	if inherit {
+		cInherit = 1
+	}
+	ret := C.set_project_attr(cPath, C.uint32_t(projectID), cInherit)
+	if ret != 0 {
+		errMsg := C.GoString(C.project_error_string(C.int(ret)))
+		return fmt.Errorf("恢复project ID失败: %s", errMsg)
+	}
+	return nil
+}
+
 // clearProjectID 清除文件或目录的project ID（使用ioctl系统调用）
 func clearProjectID(path string) error {
 	cPath := C.CString(path)